@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "admin.h"
+#include "metrics.h"
+#include "room.h"
+
+/*
+  The admin socket answers one request per connection and then hangs up.
+  A request is a single line naming what to report:
+
+    metrics - every counter of the server, in the Prometheus text format
+              (also sent for an empty request)
+    phases  - tables of how long each phase of a round takes
+
+  A line starting with "GET " is read as an HTTP request for /metrics or
+  /phases instead, and answered in HTTP, so the socket can be scraped with
+  tools that speak HTTP over Unix sockets, like
+  `curl --unix-socket <path> http://localhost/metrics`.
+*/
+
+/**
+ * Reads the first line of an admin request, giving up after
+ * ADMIN_REQUEST_TIMEOUT_MS
+ *
+ * \param fd - the admin client's socket
+ * \param request - filled in with the line, without its line ending
+ */
+void read_admin_request(int fd, char* request) {
+  size_t len = 0;
+  while (len < MAX_ADMIN_REQUEST - 1) {
+    ssize_t n = read(fd, request + len, MAX_ADMIN_REQUEST - 1 - len);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+    if (memchr(request, '\n', len) != NULL) break;
+  }
+  request[len] = '\0';
+  request[strcspn(request, "\r\n")] = '\0';
+}
+
+/**
+ * Answers a single admin client
+ *
+ * \param fd - the admin client's socket; closed once answered
+ */
+void answer_admin_client(int fd) {
+  struct timeval timeout = {ADMIN_REQUEST_TIMEOUT_MS / 1000, (ADMIN_REQUEST_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char request[MAX_ADMIN_REQUEST];
+  read_admin_request(fd, request);
+
+  FILE* out = fdopen(fd, "w");
+  if (out == NULL) {
+    perror("Unable to answer admin client");
+    close(fd);
+    return;
+  }
+
+  // HTTP requests name what they want in their path
+  int is_http = strncmp(request, "GET ", 4) == 0;
+  char* what = request;
+  if (is_http) {
+    what = request + 4;
+    what[strcspn(what, " ")] = '\0';
+    if (*what == '/') what++;
+  }
+
+  if (strcmp(what, "metrics") == 0 || (!is_http && *what == '\0')) {
+    if (is_http) fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n");
+    print_metrics(out);
+  } else if (strcmp(what, "phases") == 0) {
+    if (is_http) fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n");
+    print_phase_times(out);
+  } else if (is_http) {
+    fprintf(out, "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\nTry /metrics or /phases\n");
+  } else {
+    fprintf(out, "Unknown request \"%s\"; try metrics or phases\n", what);
+  }
+  fclose(out);
+}
+
+/**
+ * Thread function that answers admin clients one at a time, forever
+ *
+ * \param listen_fd - the admin socket, cast to a pointer
+ * \return - NULL
+ */
+void* serve_admin(void* listen_fd) {
+  int fd = (int)(intptr_t)listen_fd;
+  while (1) {
+    int client_fd = accept(fd, NULL, NULL);
+    if (client_fd == -1) {
+      if (errno != EINTR) perror("Admin accept failed");
+      continue;
+    }
+    answer_admin_client(client_fd);
+  }
+  return NULL;
+}
+
+/**
+ * Opens the admin socket at a path and starts answering admin clients on
+ * a thread of their own. Anything already at the path is replaced, so a
+ * socket left over from an earlier run doesn't stop the server.
+ *
+ * \param path - where in the file system to put the socket
+ * \return - boolean, True if the socket was opened
+ */
+int admin_start(const char* path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Admin socket path %s is too long\n", path);
+    return 0;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    perror("Unable to create admin socket");
+    return 0;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+    perror("Unable to open admin socket");
+    close(fd);
+    return 0;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, serve_admin, (void*)(intptr_t)fd)) {
+    perror("PTHREAD CREATE FAILED:");
+    close(fd);
+    return 0;
+  }
+  pthread_detach(thread);
+  return 1;
+}
@@ -0,0 +1,12 @@
+#ifndef __ADMIN__
+#define __ADMIN__
+
+// Longest an admin client gets to send its request before it's answered
+// as if it sent nothing, so a stuck client can't hold up the others
+#define ADMIN_REQUEST_TIMEOUT_MS 1000
+// Longest admin request read
+#define MAX_ADMIN_REQUEST 1024
+
+int admin_start(const char* path);
+
+#endif
@@ -0,0 +1,112 @@
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "barrier.h"
+
+/**
+ * Sets up a barrier that opens once the given number of threads wait on it
+ *
+ * \param barrier - the barrier to initialize
+ * \param parties - the number of threads that must arrive each phase
+ */
+void barrier_init(phase_barrier_t* barrier, int parties) {
+  pthread_mutex_init(&barrier->lock, NULL);
+
+  // time outs are measured on the monotonic clock so that changes to the
+  // system time don't cut waits short (or make them last forever)
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&barrier->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  barrier->parties = parties;
+  barrier->waiting = 0;
+  barrier->generation = 0;
+  barrier->broken = 0;
+}
+
+/**
+ * Frees the resources of a barrier nobody is waiting on anymore
+ *
+ * \param barrier - the barrier to destroy
+ */
+void barrier_destroy(phase_barrier_t* barrier) {
+  pthread_cond_destroy(&barrier->cond);
+  pthread_mutex_destroy(&barrier->lock);
+}
+
+/**
+ * Blocks until every party has arrived at the barrier for the current
+ * phase, the barrier is broken, or the time out expires. A thread that
+ * times out withdraws from the phase, so it is as if it never arrived.
+ *
+ * \param barrier - the barrier to wait on
+ * \param timeout_ms - the longest to wait in milliseconds, or -1 to wait
+ *                     as long as it takes
+ * \return - a barrier_result; BARRIER_LAST for exactly one of the threads
+ *           of each phase, BARRIER_PASSED for the rest
+ */
+int barrier_wait(phase_barrier_t* barrier, int timeout_ms) {
+  struct timespec deadline;
+  if (timeout_ms >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&barrier->lock);
+  if (barrier->broken) {
+    pthread_mutex_unlock(&barrier->lock);
+    return BARRIER_BROKEN;
+  }
+
+  // the last thread to arrive starts the next phase and wakes the others
+  if (++barrier->waiting == barrier->parties) {
+    barrier->waiting = 0;
+    barrier->generation++;
+    pthread_cond_broadcast(&barrier->cond);
+    pthread_mutex_unlock(&barrier->lock);
+    return BARRIER_LAST;
+  }
+
+  unsigned long generation = barrier->generation;
+  int result = BARRIER_PASSED;
+  while (generation == barrier->generation) {
+    if (barrier->broken) {
+      result = BARRIER_BROKEN;
+      break;
+    }
+    int err = timeout_ms >= 0
+      ? pthread_cond_timedwait(&barrier->cond, &barrier->lock, &deadline)
+      : pthread_cond_wait(&barrier->cond, &barrier->lock);
+    if (err == ETIMEDOUT && generation == barrier->generation) {
+      result = BARRIER_TIMEOUT;
+      break;
+    }
+  }
+
+  // leaving without the phase completing, so take back our arrival
+  if (result != BARRIER_PASSED) barrier->waiting--;
+  pthread_mutex_unlock(&barrier->lock);
+  return result;
+}
+
+/**
+ * Breaks a barrier, waking every waiting thread and making every later wait
+ * return BARRIER_BROKEN straight away. Used to give up on a phase that will
+ * never complete.
+ *
+ * \param barrier - the barrier to break
+ */
+void barrier_break(phase_barrier_t* barrier) {
+  pthread_mutex_lock(&barrier->lock);
+  barrier->broken = 1;
+  pthread_cond_broadcast(&barrier->cond);
+  pthread_mutex_unlock(&barrier->lock);
+}
@@ -0,0 +1,33 @@
+#ifndef __BARRIER__
+#define __BARRIER__
+#include <pthread.h>
+
+// Results of waiting on a barrier
+enum barrier_result {
+  BARRIER_BROKEN = -2,  // the barrier was broken while (or before) waiting
+  BARRIER_TIMEOUT = -1, // gave up waiting before everyone arrived
+  BARRIER_PASSED = 0,   // everyone arrived
+  BARRIER_LAST = 1      // everyone arrived, and the caller was the last to
+};
+
+/**
+ * A reusable barrier for a fixed number of threads. Waiting threads sleep
+ * on a condition variable instead of spinning. The generation counter tells
+ * waiters of one phase apart from the next, so the barrier can be reused
+ * immediately for the next phase without resetting it.
+ */
+typedef struct phase_barrier {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int parties;
+  int waiting;
+  unsigned long generation;
+  int broken; // boolean, set once the barrier can't be passed anymore
+} phase_barrier_t;
+
+void barrier_init(phase_barrier_t* barrier, int parties);
+void barrier_destroy(phase_barrier_t* barrier);
+int barrier_wait(phase_barrier_t* barrier, int timeout_ms);
+void barrier_break(phase_barrier_t* barrier);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __BENCH__
+#define __BENCH__
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../clock.h"
+
+// Each sample runs the benchmark for at least this long
+#define BENCH_SAMPLE_NS (50 * 1000 * 1000)
+// Samples taken of each benchmark; the median is reported
+#define BENCH_SAMPLES 7
+
+/**
+ * Where benchmarks add up their results, so the work being timed can't be
+ * optimized away
+ */
+static volatile uint64_t bench_sink;
+
+/**
+ * Where results are printed; stdout, once bench_init has run
+ */
+static FILE* bench_out;
+
+/**
+ * Keeps stdout for results only: anything else the code being timed prints
+ * on stdout goes to stderr instead. Must be called before anything is
+ * printed.
+ */
+static void bench_init() {
+  bench_out = fdopen(dup(STDOUT_FILENO), "w");
+  if (bench_out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+    perror("Unable to set up the benchmark output");
+    exit(2);
+  }
+}
+
+/**
+ * Orders doubles for qsort
+ */
+static int bench_compare(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Times a benchmark and prints the result as a line of JSON on bench_out:
+ *
+ *   {"benchmark": name, "ns_per_op": median, "min_ns_per_op": fastest,
+ *    "max_ns_per_op": slowest, "ops": ops per sample, "samples": samples}
+ *
+ * plus "mb_per_s" if the benchmark reads a known number of bytes. The
+ * number of calls per sample is found by doubling until a sample takes
+ * BENCH_SAMPLE_NS, and the median of BENCH_SAMPLES samples is reported so
+ * a single hiccup doesn't skew it.
+ *
+ * \param name - the name of the benchmark
+ * \param run - runs the benchmark once; does ops_per_run operations
+ * \param arg - passed to run
+ * \param ops_per_run - the number of operations done by each call of run
+ * \param bytes_per_op - bytes processed by each operation, or 0
+ * \return - the median time of an operation, in nanoseconds
+ */
+static double bench_run(const char* name, void (*run)(void*), void* arg,
+                        double ops_per_run, double bytes_per_op) {
+  // warm up, and find how many calls make up a sample
+  int64_t calls = 1;
+  while (1) {
+    int64_t start = monotonic_ns();
+    for (int64_t i = 0; i < calls; i++) run(arg);
+    if (monotonic_ns() - start >= BENCH_SAMPLE_NS || calls >= ((int64_t)1 << 40)) break;
+    calls *= 2;
+  }
+
+  double ns_per_op[BENCH_SAMPLES];
+  double ops = calls * ops_per_run;
+  for (int sample = 0; sample < BENCH_SAMPLES; sample++) {
+    int64_t start = monotonic_ns();
+    for (int64_t i = 0; i < calls; i++) run(arg);
+    ns_per_op[sample] = (monotonic_ns() - start) / ops;
+  }
+  qsort(ns_per_op, BENCH_SAMPLES, sizeof(double), bench_compare);
+  double median = ns_per_op[BENCH_SAMPLES / 2];
+
+  fprintf(bench_out, "{\"benchmark\": \"%s\", \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+          "\"max_ns_per_op\": %.2f, \"ops\": %.0f, \"samples\": %d",
+          name, median, ns_per_op[0], ns_per_op[BENCH_SAMPLES - 1], ops, BENCH_SAMPLES);
+  if (bytes_per_op > 0) fprintf(bench_out, ", \"mb_per_s\": %.2f", bytes_per_op / median * 1e9 / 1e6);
+  fprintf(bench_out, "}\n");
+  fflush(bench_out);
+  return median;
+}
+
+#endif
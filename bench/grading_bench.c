@@ -0,0 +1,205 @@
+/**
+ * Microbenchmarks of grading: edit_distance against the levenshtein_n it
+ * replaced, and check_answer as a whole. Pairs are built from answers in
+ * the style of the question file with a few random edits each, grouped by
+ * the length of the answer, and every pair is checked to give the same
+ * distance under both before anything is timed. Inputs come from a fixed
+ * seed, so every run times the same work.
+ *
+ * Usage: ./grading_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../edit_distance.h"
+#include "../game.h"
+#include "../deps/levenshtein.h"
+
+#define NUM_PAIRS 1024
+// Guesses are as long as the client lets players type
+#define MAX_LEN MAX_ANSWER_LENGTH
+
+static const char* answers[] = {
+  "Copernicus", "Jim Thorpe", "Arizona", "McDonald's", "John Adams",
+  "the ant", "the Appian Way", "Michael Jordan", "the Kremlin",
+  "Wednesday", "Gabriel Garcia Marquez", "the Cuban Missile Crisis",
+  "Ernest Hemingway", "a spider", "Mount Kilimanjaro",
+  "The Lion, the Witch and the Wardrobe", "photosynthesis",
+  "the Declaration of Independence", "Tchaikovsky", "Led Zeppelin",
+  "Oslo", "Mars", "Iowa", "zinc", "the Treaty of Versailles",
+  "Alexander Graham Bell", "the Pythagorean theorem",
+  "(Franklin Delano) Roosevelt", "Sir Arthur Conan Doyle",
+};
+#define NUM_ANSWERS (sizeof(answers) / sizeof(answers[0]))
+
+/**
+ * Answers of similar length, which cost about the same to grade
+ */
+typedef struct length_bucket {
+  const char* name;
+  size_t min_len;
+  size_t max_len;
+} length_bucket_t;
+
+static const length_bucket_t buckets[] = {
+  {"short", 0, 8},
+  {"medium", 9, 20},
+  {"long", 21, MAX_LEN - 1},
+};
+#define NUM_BUCKETS (sizeof(buckets) / sizeof(buckets[0]))
+
+typedef struct pair {
+  char guess[MAX_LEN];
+  char answer[MAX_LEN];
+  char normalized_answer[MAX_LEN];
+  size_t guess_len;
+  size_t answer_len;
+} pair_t;
+
+/**
+ * Make a guess out of an answer by applying a few random insertions,
+ * deletions and substitutions, the way a player would misspell it
+ *
+ * \param p - the pair to fill in
+ * \param answer - the answer the guess is based on
+ */
+void make_pair(pair_t* p, const char* answer) {
+  strcpy(p->answer, answer);
+  p->answer_len = strlen(answer);
+  normalize_answer(answer, p->normalized_answer);
+  strcpy(p->guess, answer);
+  size_t len = p->answer_len;
+
+  // mostly near misses, with the odd guess that is way off
+  int edits = rand() % 4 == 0 ? len : rand() % 4;
+  for (int i = 0; i < edits; i++) {
+    size_t at = rand() % (len + 1);
+    char c = 'a' + rand() % 26;
+    switch (rand() % 3) {
+    case 0: // insert
+      if (len + 1 >= MAX_LEN) break;
+      memmove(p->guess + at + 1, p->guess + at, len - at + 1);
+      p->guess[at] = c;
+      len++;
+      break;
+    case 1: // delete
+      if (at == len) break;
+      memmove(p->guess + at, p->guess + at + 1, len - at);
+      len--;
+      break;
+    default: // substitute
+      if (at < len) p->guess[at] = c;
+    }
+  }
+  p->guess_len = len;
+}
+
+/**
+ * Fills in pairs made from the answers that fit in a bucket
+ *
+ * \param pairs - the NUM_PAIRS pairs to fill in
+ * \param bucket - the lengths of answer to use
+ */
+void make_pairs(pair_t* pairs, const length_bucket_t* bucket) {
+  const char* fitting[NUM_ANSWERS];
+  int num_fitting = 0;
+  for (int i = 0; i < NUM_ANSWERS; i++) {
+    size_t len = strlen(answers[i]);
+    if (len >= bucket->min_len && len <= bucket->max_len) fitting[num_fitting++] = answers[i];
+  }
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    make_pair(&pairs[i], fitting[i % num_fitting]);
+  }
+}
+
+/**
+ * Checks that edit_distance agrees with levenshtein_n on every pair,
+ * exiting if it doesn't
+ *
+ * \param pairs - the NUM_PAIRS pairs to check
+ */
+void check_pairs(pair_t* pairs) {
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    pair_t* p = &pairs[i];
+    size_t expected = levenshtein_n(p->guess, p->guess_len, p->answer, p->answer_len);
+    size_t got = edit_distance(p->guess, p->guess_len, p->answer, p->answer_len);
+    size_t cutoff = p->answer_len / 2;
+    size_t bounded = edit_distance_bounded(p->guess, p->guess_len,
+                                           p->answer, p->answer_len, cutoff);
+    if (got != expected || (bounded <= cutoff) != (expected <= cutoff) ||
+        (bounded <= cutoff && bounded != expected)) {
+      fprintf(stderr, "mismatch for \"%s\" / \"%s\": levenshtein_n %zu, "
+              "edit_distance %zu, bounded %zu\n",
+              p->guess, p->answer, expected, got, bounded);
+      exit(2);
+    }
+  }
+}
+
+void run_levenshtein(void* arg) {
+  pair_t* pairs = arg;
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    pair_t* p = &pairs[i];
+    bench_sink += levenshtein_n(p->guess, p->guess_len, p->answer, p->answer_len);
+  }
+}
+
+void run_edit_distance(void* arg) {
+  pair_t* pairs = arg;
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    pair_t* p = &pairs[i];
+    bench_sink += edit_distance(p->guess, p->guess_len, p->answer, p->answer_len);
+  }
+}
+
+void run_edit_distance_bounded(void* arg) {
+  pair_t* pairs = arg;
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    pair_t* p = &pairs[i];
+    bench_sink += edit_distance_bounded(p->guess, p->guess_len, p->answer, p->answer_len,
+                                        p->answer_len / 2);
+  }
+}
+
+void run_check_answer(void* arg) {
+  pair_t* pairs = arg;
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    pair_t* p = &pairs[i];
+    bench_sink += check_answer(p->guess, p->normalized_answer);
+  }
+}
+
+void run_normalize_answer(void* arg) {
+  pair_t* pairs = arg;
+  char normalized[MAX_LEN];
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    normalize_answer(pairs[i].guess, normalized);
+    bench_sink += normalized[0];
+  }
+}
+
+int main() {
+  static pair_t pairs[NUM_PAIRS];
+  bench_init();
+  srand(1);
+
+  for (int b = 0; b < NUM_BUCKETS; b++) {
+    make_pairs(pairs, &buckets[b]);
+    check_pairs(pairs);
+
+    char name[64];
+    snprintf(name, sizeof(name), "levenshtein_n/%s", buckets[b].name);
+    bench_run(name, run_levenshtein, pairs, NUM_PAIRS, 0);
+    snprintf(name, sizeof(name), "edit_distance/%s", buckets[b].name);
+    bench_run(name, run_edit_distance, pairs, NUM_PAIRS, 0);
+    snprintf(name, sizeof(name), "edit_distance_bounded/%s", buckets[b].name);
+    bench_run(name, run_edit_distance_bounded, pairs, NUM_PAIRS, 0);
+    snprintf(name, sizeof(name), "normalize_answer/%s", buckets[b].name);
+    bench_run(name, run_normalize_answer, pairs, NUM_PAIRS, 0);
+    snprintf(name, sizeof(name), "check_answer/%s", buckets[b].name);
+    bench_run(name, run_check_answer, pairs, NUM_PAIRS, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Starts a server and runs a crowd of bots against it, then prints what
+# the bots measured along with the server's CPU and memory use. Arguments
+# before -- are passed to the server and the rest to the bots, e.g.
+#
+#   bench/load_test.sh -e -- -n 2000 -g 3 -d exp -m 300
+#
+# Run from the top of the repo after `make`.
+
+server_args=()
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+  server_args+=("$1")
+  shift
+done
+[ "$1" == "--" ] && shift
+
+# every player holds a socket on both sides
+ulimit -n "$(ulimit -Hn)"
+
+log=$(mktemp)
+stdbuf -oL ./server "${server_args[@]}" > "$log" 2>&1 &
+server_pid=$!
+# the server writes out its event log when it's told to stop; wait for it
+trap 'kill $server_pid 2> /dev/null && wait $server_pid; rm -f "$log"' EXIT
+
+# wait for the server to load its questions and pick a port
+port=""
+for i in $(seq 600); do
+  port=$(sed -n 's/^Server listening on port \([0-9]*\)$/\1/p' "$log")
+  [ -n "$port" ] && break
+  if ! kill -0 $server_pid 2> /dev/null; then
+    cat "$log" >&2
+    exit 2
+  fi
+  sleep 0.1
+done
+if [ -z "$port" ]; then
+  echo "The server didn't start" >&2
+  exit 2
+fi
+
+questions=questions.json
+for ((i = 0; i < ${#server_args[@]}; i++)); do
+  [ "${server_args[$i]}" == "-q" ] && questions=${server_args[$((i+1))]}
+done
+./bot -q "$questions" -s $server_pid "$@" localhost $port
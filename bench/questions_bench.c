@@ -0,0 +1,237 @@
+/**
+ * Microbenchmarks of loading questions, making boards and sending them:
+ * parse_json and add_square_from_json on a question file, create_game from
+ * both the parsed JSON and a question pack, and encoding and decoding the
+ * board and the per-round delta. Boards are picked with a fixed seed, so
+ * every run times the same work.
+ *
+ * Usage: ./questions_bench [questions_file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../game.h"
+#include "../protocol.h"
+
+/**
+ * A question file read into memory, so reading the disk isn't timed
+ */
+typedef struct json_file {
+  char* data;
+  size_t len;
+  char** objects; // copies of each top level object, for add_square_from_json
+  int num_objects;
+} json_file_t;
+
+/**
+ * A board and the frames it is sent in
+ */
+typedef struct board_frames {
+  game_t game;
+  game_delta_t delta;
+  wire_buf_t buf;
+  frame_t board;
+  frame_t delta_frame;
+} board_frames_t;
+
+/**
+ * Reads a whole file into memory, exiting if it can't be read
+ *
+ * \param path - the file to read
+ * \param file - filled in with the contents of the file
+ */
+void read_json_file(const char* path, json_file_t* file) {
+  FILE* input = fopen(path, "r");
+  if (input == NULL) {
+    perror("Could not open the questions file");
+    exit(2);
+  }
+  fseek(input, 0, SEEK_END);
+  file->len = ftell(input);
+  rewind(input);
+  file->data = malloc(file->len + 1);
+  if (file->data == NULL || fread(file->data, 1, file->len, input) != file->len) {
+    perror("Could not read the questions file");
+    exit(2);
+  }
+  file->data[file->len] = '\0';
+  fclose(input);
+}
+
+/**
+ * Splits a question file into its top level objects, the way parse_json
+ * does, so add_square_from_json can be timed on its own
+ *
+ * \param file - the file to split; its objects are filled in
+ */
+void split_objects(json_file_t* file) {
+  file->objects = NULL;
+  file->num_objects = 0;
+  int cap = 0;
+  int depth = 0;
+  int in_string = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < file->len; i++) {
+    char c = file->data[i];
+    if (in_string) {
+      if (c == '\\') i++;
+      else if (c == '"') in_string = 0;
+    } else if (c == '"') {
+      in_string = 1;
+    } else if (c == '{') {
+      if (depth++ == 0) start = i;
+    } else if (c == '}' && depth > 0 && --depth == 0) {
+      if (file->num_objects == cap) {
+        cap = cap * 2 + 64;
+        file->objects = realloc(file->objects, cap * sizeof(char*));
+        if (file->objects == NULL) {
+          perror("realloc failed");
+          exit(2);
+        }
+      }
+      file->objects[file->num_objects++] = strndup(file->data + start, i - start + 1);
+    }
+  }
+}
+
+void run_parse_json(void* arg) {
+  json_file_t* file = arg;
+  FILE* input = fmemopen(file->data, file->len, "r");
+  if (input == NULL || parse_json(input)) {
+    perror("Could not parse the questions");
+    exit(2);
+  }
+  fclose(input);
+  bench_sink += HASH_COUNT(category_hashmap);
+  clean_up_game();
+}
+
+// cJSON uses its own allocator here; parse_json swaps in an arena, which
+// shows up in the parse_json benchmark
+void run_add_square_from_json(void* arg) {
+  json_file_t* file = arg;
+  for (int i = 0; i < file->num_objects; i++) {
+    bench_sink += add_square_from_json(file->objects[i]);
+  }
+  clean_up_game();
+}
+
+void run_create_game(void* arg) {
+  room_config_t* config = arg;
+  game_t game = create_game(config, rand());
+  bench_sink += game.categories[0].questions[0].value;
+  free_game(&game);
+}
+
+void run_encode_board(void* arg) {
+  board_frames_t* frames = arg;
+  frames->buf.len = 0;
+  encode_board(&frames->buf, &frames->game, 0);
+  bench_sink += frames->buf.len;
+}
+
+void run_decode_board(void* arg) {
+  board_frames_t* frames = arg;
+  game_t game;
+  int version;
+  bench_sink += decode_board(&frames->board, &game, &version);
+  free(game.categories);
+  free(game.players);
+}
+
+void run_encode_delta(void* arg) {
+  board_frames_t* frames = arg;
+  frames->buf.len = 0;
+  encode_delta(&frames->buf, &frames->delta, frames->game.num_players);
+  bench_sink += frames->buf.len;
+}
+
+void run_decode_delta(void* arg) {
+  board_frames_t* frames = arg;
+  game_delta_t delta;
+  bench_sink += decode_delta(&frames->delta_frame, &delta);
+}
+
+/**
+ * Makes a full board of the default size, with every seat taken, and the
+ * frames it is sent in
+ *
+ * \param frames - filled in with the board and its frames
+ * \param config - the settings of the room the board is for
+ */
+void make_board_frames(board_frames_t* frames, room_config_t* config) {
+  frames->game = create_game(config, rand());
+  frames->game.num_players = config->num_players;
+  for (int player = 0; player < config->num_players; player++) {
+    snprintf(frames->game.players[player].name, MAX_ANSWER_LENGTH, "player%d", player);
+    frames->game.players[player].id = player;
+    frames->game.players[player].score = player * 400;
+  }
+
+  memset(&frames->delta, 0, sizeof(game_delta_t));
+  frames->delta.version = 7;
+  frames->delta.col = 2;
+  frames->delta.row = 3;
+  for (int player = 0; player < config->num_players; player++) {
+    frames->delta.scores[player] = player * 400;
+  }
+
+  // one buffer for each frame, since the frames point into them
+  static wire_buf_t board_buf, delta_buf;
+  wire_buf_init(&board_buf);
+  wire_buf_init(&delta_buf);
+  encode_board(&board_buf, &frames->game, 0);
+  encode_delta(&delta_buf, &frames->delta, config->num_players);
+  if (frame_parse(board_buf.data, board_buf.len, board_buf.len, &frames->board) <= 0 ||
+      frame_parse(delta_buf.data, delta_buf.len, delta_buf.len, &frames->delta_frame) <= 0) {
+    fprintf(stderr, "Unable to encode the board\n");
+    exit(2);
+  }
+  wire_buf_init(&frames->buf);
+}
+
+int main(int argc, char** argv) {
+  char* questions_path = argc > 1 ? argv[1] : "questions.json";
+  bench_init();
+  srand(1);
+
+  // Parsing
+  json_file_t file;
+  read_json_file(questions_path, &file);
+  split_objects(&file);
+  bench_run("parse_json", run_parse_json, &file, 1, file.len);
+  bench_run("add_square_from_json", run_add_square_from_json, &file,
+            file.num_objects, (double)file.len / file.num_objects);
+
+  // Making boards, from the parsed JSON and then from a pack of it
+  if (!load_questions(questions_path)) exit(2);
+  room_config_t config = {0, 0, 0, 0};
+  normalize_room_config(&config);
+  bench_run("create_game/json", run_create_game, &config, 1, 0);
+
+  char pack_path[] = "/tmp/questions_bench_XXXXXX";
+  int fd = mkstemp(pack_path);
+  if (fd == -1 || !write_question_pack(pack_path)) {
+    perror("Unable to write a question pack");
+    exit(2);
+  }
+  close(fd);
+  clean_up_game();
+  if (!load_questions(pack_path)) exit(2);
+  unlink(pack_path);
+  bench_run("create_game/pack", run_create_game, &config, 1, 0);
+
+  // Sending boards
+  board_frames_t frames;
+  make_board_frames(&frames, &config);
+  bench_run("encode_board", run_encode_board, &frames, 1, frames.board.length);
+  bench_run("decode_board", run_decode_board, &frames, 1, frames.board.length);
+  bench_run("encode_delta", run_encode_delta, &frames, 1, frames.delta_frame.length);
+  bench_run("decode_delta", run_decode_delta, &frames, 1, frames.delta_frame.length);
+
+  clean_up_game();
+  return 0;
+}
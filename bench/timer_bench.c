@@ -0,0 +1,182 @@
+/**
+ * Microbenchmarks of the event loop's timer wheel with a million or more
+ * deadlines set at once, about what tens of thousands of rooms and their
+ * connections keep between them: moving a deadline (a cancel and a set),
+ * finding how long the loop can wait, and turning the wheel while every
+ * deadline that passes is set again a phase later. Time is simulated, so
+ * the wheel turns as fast as it goes. Before anything is timed the wheel
+ * is checked to expire deadlines spread over every level at the right
+ * time. Inputs come from a fixed seed, so every run times the same work.
+ *
+ * Usage: ./timer_bench [deadlines]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../deadline.h"
+#include "../protocol.h"
+
+#define DEFAULT_DEADLINES (1 << 20)
+// Deadlines are set again this far from when they pass, like a player
+// picking a question
+#define PHASE_NS (SELECT_TIMEOUT_MS * 1000000LL)
+// Deadlines moved per call of run_move
+#define MOVES_PER_RUN 1024
+// Deadlines checked, and the furthest away one of them is, in ticks
+#define CHECK_DEADLINES 100000
+#define CHECK_SPAN (1 << 26)
+
+/**
+ * The deadlines being benchmarked
+ */
+typedef struct timers {
+  deadline_t* deadlines;
+  long num;
+} timers_t;
+
+// The simulated monotonic_ns(); only ever goes forward
+static int64_t now;
+// When the wheel was last turned before now, during the check
+static int64_t last_run;
+// Deadlines expired during the check, and how many at the wrong time
+static long expired, bad;
+static uint64_t random_state = 1;
+
+/**
+ * Gives a random number from a fixed seed
+ *
+ * \return - the next random number
+ */
+static uint64_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+/**
+ * Expire function of the check: the wheel has to run a deadline once it has
+ * passed and at most a tick after
+ *
+ * \param data - the deadline
+ */
+static void check_expired(void* data) {
+  deadline_t* deadline = data;
+  expired++;
+  if (deadline->when > now || deadline->when <= last_run - DEADLINE_TICK_NS) bad++;
+}
+
+/**
+ * Sets deadlines from a tick to a few hours away, turns the wheel in uneven
+ * steps until they've all passed and exits if any of them expired early,
+ * late or not at all
+ *
+ * \param timers - the deadlines to use
+ */
+static void check_wheel(timers_t* timers) {
+  long num = timers->num < CHECK_DEADLINES ? timers->num : CHECK_DEADLINES;
+  for (long i = 0; i < num; i++) {
+    // as many at each level of the wheel
+    int bits = next_random() % 27;
+    int64_t ahead = next_random() % ((int64_t)1 << bits) * DEADLINE_TICK_NS + next_random() % DEADLINE_TICK_NS;
+    deadline_set(&timers->deadlines[i], now + ahead, check_expired, &timers->deadlines[i]);
+  }
+  // cancelled ones never expire
+  for (long i = 0; i < num; i += 10) deadline_cancel(&timers->deadlines[i]);
+  long expected = num - (num + 9) / 10;
+
+  int64_t end = now + (int64_t)CHECK_SPAN * DEADLINE_TICK_NS;
+  while (now <= end) {
+    // like the event loop, wake up no later than the wheel asks to
+    int64_t step = next_random() % (3 * DEADLINE_SLOTS) * DEADLINE_TICK_NS + next_random() % DEADLINE_TICK_NS;
+    int wait = deadline_wait_ms(now);
+    if (wait != -1 && wait * DEADLINE_TICK_NS < step) step = wait * DEADLINE_TICK_NS;
+    last_run = now;
+    now += step;
+    deadline_run(now);
+  }
+  if (bad != 0 || expired != expected || deadlines_set != 0) {
+    fprintf(stderr, "The timer wheel expired %ld of %ld deadlines, %ld at the wrong time\n",
+            expired, expected, bad);
+    exit(2);
+  }
+}
+
+/**
+ * Expire function of the benchmarks: starts the next phase
+ *
+ * \param data - the deadline
+ */
+static void next_phase(void* data) {
+  deadline_t* deadline = data;
+  deadline_set(deadline, now + PHASE_NS, next_phase, deadline);
+  bench_sink++;
+}
+
+/**
+ * Moves deadlines to random times within a phase
+ *
+ * \param arg - the timers_t
+ */
+static void run_move(void* arg) {
+  timers_t* timers = arg;
+  for (int i = 0; i < MOVES_PER_RUN; i++) {
+    deadline_t* deadline = &timers->deadlines[next_random() % timers->num];
+    deadline_set(deadline, now + 1 + next_random() % PHASE_NS, next_phase, deadline);
+  }
+}
+
+/**
+ * Finds how long the event loop could wait
+ *
+ * \param arg - unused
+ */
+static void run_wait(void* arg) {
+  bench_sink += deadline_wait_ms(now);
+}
+
+/**
+ * Turns the wheel a tick; a phase's worth of deadlines pass, and are set
+ * again, every PHASE_NS
+ *
+ * \param arg - unused
+ */
+static void run_turn(void* arg) {
+  now += DEADLINE_TICK_NS;
+  deadline_run(now);
+}
+
+int main(int argc, char** argv) {
+  timers_t timers;
+  timers.num = argc > 1 ? atol(argv[1]) : DEFAULT_DEADLINES;
+  if (argc > 2 || timers.num < 1) {
+    fprintf(stderr, "Usage: %s [deadlines]\n", argv[0]);
+    exit(1);
+  }
+  timers.deadlines = calloc(timers.num, sizeof(deadline_t));
+  if (timers.deadlines == NULL) {
+    perror("Unable to allocate deadlines");
+    exit(2);
+  }
+  bench_init();
+  now = monotonic_ns();
+  check_wheel(&timers);
+
+  // the deadlines pass evenly over a phase, as they would once rooms have
+  // been playing a while
+  for (long i = 0; i < timers.num; i++) {
+    deadline_set(&timers.deadlines[i], now + 1 + i * PHASE_NS / timers.num, next_phase, &timers.deadlines[i]);
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "deadline_move/%ld", timers.num);
+  bench_run(name, run_move, &timers, MOVES_PER_RUN, 0);
+  snprintf(name, sizeof(name), "deadline_wait_ms/%ld", timers.num);
+  bench_run(name, run_wait, NULL, 1, 0);
+  // per deadline that passes
+  snprintf(name, sizeof(name), "deadline_run/%ld", timers.num);
+  bench_run(name, run_turn, NULL, (double)timers.num * DEADLINE_TICK_NS / PHASE_NS, 0);
+  return 0;
+}
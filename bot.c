@@ -0,0 +1,647 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "deps/socket.h"
+#include "deps/uthash.h"
+#include "game.h"
+#include "game_structs.h"
+#include "protocol.h"
+
+// Stack of each bot's thread; bots use little of it, so thousands fit
+#define BOT_STACK_SIZE (256 * 1024)
+// What a bot answers when it gets a question wrong
+#define WRONG_ANSWER "no idea"
+
+// How long bots take to buzz in after seeing a question
+enum buzz_distribution {
+  BUZZ_FIXED = 0,       // always the mean
+  BUZZ_UNIFORM = 1,     // anywhere from 0 to twice the mean
+  BUZZ_EXPONENTIAL = 2  // mostly quick, with a long tail of slow buzzes
+};
+
+/**
+ * The answer to a question, found by the question's text
+ */
+typedef struct answer_key {
+  char* question;
+  char* answer;
+  UT_hash_handle hh;
+} answer_key_t;
+
+/**
+ * A single bot and what it measured while playing
+ */
+typedef struct bot {
+  int index;
+  unsigned int seed; // for rand_r
+  pthread_t thread;
+
+  // Connection to the server, for the game being played
+  int socket_fd;
+  frame_stream_t stream;
+  int id;
+  room_config_t config;
+
+  // Results
+  int games_played;
+  int games_failed;
+  int rounds;          // rounds played in the games the bot was seat 0 of
+  int64_t* latencies;  // buzz to result, in nanoseconds
+  size_t num_latencies;
+  size_t latencies_cap;
+} bot_t;
+
+// Settings shared by every bot
+char* server_name;
+unsigned short port;
+room_config_t wanted_config = {0, 0, 0, 0};
+int buzz_distribution = BUZZ_UNIFORM;
+double mean_buzz_ms = 500;
+double accuracy = 0.75;
+int games_per_bot = 1;
+answer_key_t* answer_key = NULL;
+// gethostbyname isn't thread safe, so bots connect one at a time
+pthread_mutex_t connect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Adds a question to the answer key, unless it is already in it
+ *
+ * \param question - the question as it appears on the board
+ * \param answer - the answer to it
+ */
+void add_to_answer_key(const char* question, const char* answer) {
+  answer_key_t* key;
+  HASH_FIND_STR(answer_key, question, key);
+  if (key != NULL) return;
+
+  key = malloc(sizeof(answer_key_t));
+  if (key == NULL || (key->question = strdup(question)) == NULL ||
+      (key->answer = strdup(answer)) == NULL) {
+    perror("Unable to allocate answer key");
+    exit(2);
+  }
+  HASH_ADD_KEYPTR(hh, answer_key, key->question, strlen(key->question), key);
+}
+
+/**
+ * Builds the answer key from the same questions the server uses, so bots
+ * can answer correctly when they mean to
+ *
+ * \param path - the question pack or JSON file the server was started with
+ */
+void load_answer_key(const char* path) {
+  if (!load_questions(path)) exit(2);
+  category_t category;
+  for (int cat = 0; cat < count_categories(); cat++) {
+    read_category(cat, &category);
+    for (int q = 0; q < category.num_questions; q++) {
+      add_to_answer_key(category.questions[q].question, category.questions[q].answer);
+    }
+  }
+  clean_up_game();
+}
+
+/**
+ * Picks how long a bot waits before buzzing in
+ *
+ * \param bot - the bot buzzing in
+ * \return - the wait in milliseconds
+ */
+double buzz_delay_ms(bot_t* bot) {
+  // uniform in (0, 1]
+  double u = (rand_r(&bot->seed) + 1.0) / ((double)RAND_MAX + 1.0);
+  switch (buzz_distribution) {
+  case BUZZ_UNIFORM:
+    return 2 * mean_buzz_ms * u;
+  case BUZZ_EXPONENTIAL:
+    return -mean_buzz_ms * log(u);
+  default:
+    return mean_buzz_ms;
+  }
+}
+
+/**
+ * Sleeps for a number of milliseconds
+ *
+ * \param ms - how long to sleep
+ */
+void sleep_ms(double ms) {
+  if (ms <= 0) return;
+  struct timespec wait;
+  wait.tv_sec = (time_t)(ms / 1000);
+  wait.tv_nsec = (long)((ms - wait.tv_sec * 1000.0) * 1e6);
+  while (nanosleep(&wait, &wait) == -1 && errno == EINTR);
+}
+
+/**
+ * Sends the messages encoded in buf to the server, and empties buf
+ *
+ * \param bot - the bot sending
+ * \param buf - the encoded messages
+ * \return - boolean, True if they were sent
+ */
+int bot_send(bot_t* bot, wire_buf_t* buf) {
+  int sent = send_buf(bot->socket_fd, buf);
+  if (!sent) fprintf(stderr, "Bot %d couldn't send to the server: %s\n", bot->index, strerror(errno));
+  buf->len = 0;
+  return sent;
+}
+
+/**
+ * Reads the next message of the given type from the server, answering
+ * any pings that arrive first
+ *
+ * \param bot - the bot reading
+ * \param type - the message_type to read
+ * \param frame - where to save the read message
+ * \return - boolean, True if the message was read
+ */
+int bot_recv(bot_t* bot, int type, frame_t* frame) {
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  int result;
+  while ((result = recv_message(&bot->stream, MSG_BIT(type) | MSG_BIT(MSG_PING), frame)) == 1 &&
+         frame->type == MSG_PING) {
+    int64_t sent;
+    if (decode_ping(frame, &sent)) {
+      encode_pong(&buf, sent, bot->stream.last_read_time, monotonic_ns());
+      if (!bot_send(bot, &buf)) result = -1;
+    }
+    if (result != 1) break;
+  }
+  wire_buf_free(&buf);
+
+  if (result == 1) return 1;
+  if (result == 0) {
+    fprintf(stderr, "Bot %d lost its connection to the server\n", bot->index);
+  } else if (frame->type == MSG_ERROR) {
+    char message[MAX_QUESTION_LENGTH];
+    decode_error(frame, message, MAX_QUESTION_LENGTH);
+    fprintf(stderr, "The server ended bot %d's game: %s\n", bot->index, message);
+  } else {
+    fprintf(stderr, "Bot %d couldn't read from the server: %s\n", bot->index, strerror(errno));
+  }
+  return 0;
+}
+
+/**
+ * Saves how long a buzz took to be answered with the round's result
+ *
+ * \param bot - the bot that buzzed
+ * \param latency - the time from the buzz to the result, in nanoseconds
+ */
+void record_latency(bot_t* bot, int64_t latency) {
+  if (bot->num_latencies == bot->latencies_cap) {
+    bot->latencies_cap = bot->latencies_cap * 2 + 64;
+    bot->latencies = realloc(bot->latencies, bot->latencies_cap * sizeof(int64_t));
+    if (bot->latencies == NULL) {
+      perror("realloc failed");
+      exit(2);
+    }
+  }
+  bot->latencies[bot->num_latencies++] = latency;
+}
+
+/**
+ * Picks a random question that is still on the board
+ *
+ * \param bot - the bot picking
+ * \param game - the board to pick from
+ * \param col - set to the column of the question
+ * \param row - set to the row of the question
+ */
+void pick_question(bot_t* bot, game_t* game, int* col, int* row) {
+  int left = 0;
+  for (int cat = 0; cat < game->num_categories; cat++) {
+    for (int q = 0; q < game->num_rows; q++) {
+      if (!game->categories[cat].questions[q].is_answered) left++;
+    }
+  }
+  // the server always has a question left when it asks for a pick
+  int pick = left > 0 ? rand_r(&bot->seed) % left : 0;
+  *col = 0;
+  *row = 0;
+  for (int cat = 0; cat < game->num_categories; cat++) {
+    for (int q = 0; q < game->num_rows; q++) {
+      if (!game->categories[cat].questions[q].is_answered && pick-- == 0) {
+        *col = cat;
+        *row = q;
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Plays the rounds of a game through to the end, once the bot has been
+ * seated
+ *
+ * \param bot - the bot playing
+ * \param game - the board, filled in from the server
+ * \return - boolean, True if the game was played to the end
+ */
+int play_rounds(bot_t* bot, game_t* game) {
+  frame_t frame;
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  int version;
+  int success = 0;
+
+  if (!bot_recv(bot, MSG_BOARD, &frame) || !decode_board(&frame, game, &version)) goto done;
+
+  while (!game->is_over) {
+    // pick the question if it's this bot's turn
+    if (game->id_of_player_turn == bot->id) {
+      int col, row;
+      pick_question(bot, game, &col, &row);
+      encode_coords(&buf, MSG_SELECT, col, row, version + 1);
+      if (!bot_send(bot, &buf)) goto done;
+    }
+
+    int col, row;
+    if (!bot_recv(bot, MSG_QUESTION, &frame) || !decode_coords(&frame, &col, &row) ||
+        col >= game->num_categories || row >= game->num_rows) goto done;
+    square_t* square = &game->categories[col].questions[row];
+
+    // wait to buzz in; bots slower than the buzz timeout don't
+    double delay = buzz_delay_ms(bot);
+    answer_t ans;
+    memset(&ans, 0, sizeof(answer_t));
+    ans.did_answer = delay < bot->config.buzz_timeout_ms;
+    sleep_ms(ans.did_answer ? delay : bot->config.buzz_timeout_ms);
+    int64_t buzz_time = monotonic_ns();
+    if (ans.did_answer) {
+      answer_key_t* key;
+      HASH_FIND_STR(answer_key, square->question, key);
+      int correct = key != NULL && rand_r(&bot->seed) < accuracy * ((double)RAND_MAX + 1.0);
+      snprintf(ans.answer, MAX_ANSWER_LENGTH, "%s", correct ? key->answer : WRONG_ANSWER);
+      encode_buzz(&buf, version + 1);
+    }
+    encode_answer(&buf, &ans, version + 1);
+    if (!bot_send(bot, &buf)) goto done;
+
+    if (!bot_recv(bot, MSG_RESULT, &frame)) goto done;
+    if (ans.did_answer) record_latency(bot, bot->stream.last_read_time - buzz_time);
+    if (bot->id == 0) bot->rounds++;
+
+    game_delta_t delta;
+    if (!bot_recv(bot, MSG_DELTA, &frame) || !decode_delta(&frame, &delta) ||
+        delta.col >= game->num_categories || delta.row >= game->num_rows) goto done;
+    game->categories[delta.col].questions[delta.row].is_answered = 1;
+    for (int player = 0; player < game->num_players; player++) {
+      game->players[player].score = delta.scores[player];
+    }
+    game->id_of_player_turn = delta.id_of_player_turn;
+    game->is_over = delta.is_over;
+    version = delta.version;
+  }
+  success = 1;
+
+ done:
+  wire_buf_free(&buf);
+  return success;
+}
+
+/**
+ * Connects to the server, joins a room and plays a single game
+ *
+ * \param bot - the bot playing
+ * \return - boolean, True if the game was played to the end
+ */
+int play_game(bot_t* bot) {
+  pthread_mutex_lock(&connect_lock);
+  bot->socket_fd = socket_connect(server_name, port);
+  pthread_mutex_unlock(&connect_lock);
+  if (bot->socket_fd == -1) {
+    fprintf(stderr, "Bot %d couldn't connect to the server: %s\n", bot->index, strerror(errno));
+    return 0;
+  }
+  set_nodelay(bot->socket_fd);
+  frame_stream_init(&bot->stream, bot->socket_fd, FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD);
+
+  char name[MAX_ANSWER_LENGTH];
+  snprintf(name, MAX_ANSWER_LENGTH, "bot%d", bot->index);
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  encode_hello(&buf, name, &wanted_config);
+  int success = bot_send(bot, &buf);
+  wire_buf_free(&buf);
+
+  frame_t frame;
+  int version;
+  uint64_t token; // bots don't come back after losing their connection
+  game_t game;
+  memset(&game, 0, sizeof(game_t));
+  if (success && bot_recv(bot, MSG_WELCOME, &frame) &&
+      decode_welcome(&frame, &version, &bot->id, &bot->config, &token)) {
+    success = play_rounds(bot, &game);
+  } else {
+    success = 0;
+  }
+
+  free(game.categories);
+  free(game.players);
+  frame_stream_free(&bot->stream);
+  close(bot->socket_fd);
+  return success;
+}
+
+/**
+ * Thread function of a single bot; plays its games one after another
+ *
+ * \param arg - the bot_t of the bot
+ * \return - NULL
+ */
+void* run_bot(void* arg) {
+  bot_t* bot = arg;
+  for (int game = 0; game < games_per_bot; game++) {
+    if (play_game(bot)) {
+      bot->games_played++;
+    } else {
+      bot->games_failed++;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Reads the CPU time and memory use of a process from /proc
+ *
+ * \param pid - the process to read
+ * \param cpu_seconds - set to the user and system CPU time used so far
+ * \param rss_kb - set to the memory resident right now, in KB
+ * \param peak_rss_kb - set to the most memory ever resident, in KB
+ * \return - boolean, True if the process could be read
+ */
+int read_process_usage(int pid, double* cpu_seconds, long* rss_kb, long* peak_rss_kb) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE* stat = fopen(path, "r");
+  if (stat == NULL) return 0;
+  // the command name can hold spaces, so skip to the end of it
+  char line[1024];
+  char* fields = NULL;
+  unsigned long utime, stime;
+  if (fgets(line, sizeof(line), stat) != NULL) fields = strrchr(line, ')');
+  fclose(stat);
+  if (fields == NULL ||
+      sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+    return 0;
+  }
+  *cpu_seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE* status = fopen(path, "r");
+  if (status == NULL) return 0;
+  *rss_kb = *peak_rss_kb = 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    sscanf(line, "VmRSS: %ld", rss_kb);
+    sscanf(line, "VmHWM: %ld", peak_rss_kb);
+  }
+  fclose(status);
+  return 1;
+}
+
+/**
+ * Orders nanosecond times for qsort
+ */
+int compare_latencies(const void* a, const void* b) {
+  int64_t x = *(const int64_t*)a;
+  int64_t y = *(const int64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Finds a percentile of sorted times
+ *
+ * \param sorted - the times, in order
+ * \param count - the number of times; must be more than 0
+ * \param percent - the percentile to find
+ * \return - the time, in milliseconds
+ */
+double percentile_ms(const int64_t* sorted, size_t count, double percent) {
+  size_t index = (size_t)(percent / 100 * (count - 1) + 0.5);
+  return sorted[index] / 1e6;
+}
+
+/**
+ * Prints what the bots measured, and how much the server and the bots used
+ *
+ * \param bots - every bot, done playing
+ * \param num_bots - the number of bots
+ * \param seconds - how long the bots took to play all their games
+ * \param server_pid - the server's process id, or 0 if not known
+ * \param server_cpu - the server's CPU time before the bots started
+ */
+void print_report(bot_t* bots, int num_bots, double seconds, int server_pid, double server_cpu) {
+  int games = 0, failed = 0, rounds = 0;
+  size_t num_latencies = 0;
+  for (int i = 0; i < num_bots; i++) {
+    games += bots[i].games_played;
+    failed += bots[i].games_failed;
+    rounds += bots[i].rounds;
+    num_latencies += bots[i].num_latencies;
+  }
+  int players = wanted_config.num_players ? wanted_config.num_players : DEFAULT_NUM_PLAYERS;
+  printf("Bots: %d in rooms of %d, %d games played, %d failed\n", num_bots, players, games, failed);
+  printf("Rounds: %d in %.2f s (%.1f rounds/s)\n", rounds, seconds, rounds / seconds);
+
+  if (num_latencies > 0) {
+    int64_t* latencies = malloc(num_latencies * sizeof(int64_t));
+    if (latencies == NULL) {
+      perror("malloc failed");
+      exit(2);
+    }
+    size_t count = 0;
+    for (int i = 0; i < num_bots; i++) {
+      memcpy(latencies + count, bots[i].latencies, bots[i].num_latencies * sizeof(int64_t));
+      count += bots[i].num_latencies;
+    }
+    qsort(latencies, count, sizeof(int64_t), compare_latencies);
+    printf("Buzz to result: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms (%zu buzzes)\n",
+           percentile_ms(latencies, count, 50), percentile_ms(latencies, count, 90),
+           percentile_ms(latencies, count, 99), latencies[count-1] / 1e6, count);
+    free(latencies);
+  }
+
+  double cpu_seconds;
+  long rss_kb, peak_rss_kb;
+  if (server_pid != 0 && read_process_usage(server_pid, &cpu_seconds, &rss_kb, &peak_rss_kb)) {
+    cpu_seconds -= server_cpu;
+    printf("Server: %.2f s CPU (%.1f%% of a core), %.1f MB resident, %.1f MB peak\n",
+           cpu_seconds, 100 * cpu_seconds / seconds, rss_kb / 1024.0, peak_rss_kb / 1024.0);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double bot_cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                   (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  printf("Bots: %.2f s CPU (%.1f%% of a core)\n", bot_cpu, 100 * bot_cpu / seconds);
+}
+
+/**
+ * Reads a number given on the command line, exiting with the usage
+ * message if it is out of range.
+ *
+ * \param arg - the number as typed
+ * \param min - smallest value allowed
+ * \param max - largest value allowed
+ * \param what - the name of the setting, for the error message
+ * \return - the number
+ */
+double parse_number(char* arg, double min, double max, char* what) {
+  char* end;
+  double value = strtod(arg, &end);
+  if (*arg == '\0' || *end != '\0' || value < min || value > max) {
+    fprintf(stderr, "The %s must be from %g to %g\n", what, min, max);
+    exit(1);
+  }
+  return value;
+}
+
+/**
+ * Runs any number of bots against a server, so the server can be load
+ * tested without anyone at a keyboard. Every bot plays its games with the
+ * same room settings, so bots only ever share rooms with each other (and
+ * any players asking for the same settings).
+ *
+ * \param argc - the number of command line inputs
+ * \param argv - command line input strings; see the usage message
+ * \return - the program exit status
+ */
+int main(int argc, char** argv) {
+  int num_bots = 0;
+  int server_pid = 0;
+  char* questions_path = "questions.json";
+  int opt;
+  while ((opt = getopt(argc, argv, "n:g:p:c:r:t:d:m:a:q:s:")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_bots = parse_number(optarg, 1, 1000000, "number of bots");
+      break;
+    case 'g':
+      games_per_bot = parse_number(optarg, 1, 1000000, "number of games");
+      break;
+    case 'p':
+      wanted_config.num_players = parse_number(optarg, 1, MAX_NUM_PLAYERS, "number of players");
+      break;
+    case 'c':
+      wanted_config.num_categories = parse_number(optarg, 1, MAX_CATEGORIES, "number of categories");
+      break;
+    case 'r':
+      wanted_config.num_rows = parse_number(optarg, 1, NUM_QUESTIONS_PER_CATEGORY, "number of rows");
+      break;
+    case 't':
+      wanted_config.buzz_timeout_ms = 1000 * parse_number(optarg, MIN_BUZZ_TIMEOUT_MS / 1000,
+                                                          MAX_BUZZ_TIMEOUT_MS / 1000, "buzz seconds");
+      break;
+    case 'd':
+      if (strcmp(optarg, "fixed") == 0) {
+        buzz_distribution = BUZZ_FIXED;
+      } else if (strcmp(optarg, "uniform") == 0) {
+        buzz_distribution = BUZZ_UNIFORM;
+      } else if (strcmp(optarg, "exp") == 0) {
+        buzz_distribution = BUZZ_EXPONENTIAL;
+      } else {
+        fprintf(stderr, "The buzz distribution must be fixed, uniform or exp\n");
+        exit(1);
+      }
+      break;
+    case 'm':
+      mean_buzz_ms = parse_number(optarg, 0, MAX_BUZZ_TIMEOUT_MS, "mean buzz time");
+      break;
+    case 'a':
+      accuracy = parse_number(optarg, 0, 1, "accuracy");
+      break;
+    case 'q':
+      questions_path = optarg;
+      break;
+    case 's':
+      server_pid = parse_number(optarg, 1, 1 << 30, "server pid");
+      break;
+    default:
+      argc = 0; // print the usage message
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "Usage: %s [-n bots] [-g games_per_bot] [-p players] [-c categories] [-r rows]\n"
+            "       [-t buzz_seconds] [-d fixed|uniform|exp] [-m mean_buzz_ms] [-a accuracy]\n"
+            "       [-q questions_file] [-s server_pid] <server name> <port>\n", argv[0]);
+    exit(1);
+  }
+  server_name = argv[optind];
+  port = atoi(argv[optind+1]);
+
+  // a room only starts once it is full, so every room must fill
+  int players = wanted_config.num_players ? wanted_config.num_players : DEFAULT_NUM_PLAYERS;
+  if (num_bots == 0) num_bots = players;
+  if (num_bots % players != 0) {
+    fprintf(stderr, "The number of bots must fill rooms of %d players\n", players);
+    exit(1);
+  }
+
+  load_answer_key(questions_path);
+
+  // every bot holds a socket
+  struct rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+
+  bot_t* bots = calloc(num_bots, sizeof(bot_t));
+  if (bots == NULL) {
+    perror("calloc failed");
+    exit(2);
+  }
+  double server_cpu = 0;
+  long rss_kb, peak_rss_kb;
+  if (server_pid != 0 && !read_process_usage(server_pid, &server_cpu, &rss_kb, &peak_rss_kb)) {
+    fprintf(stderr, "Unable to read the usage of process %d\n", server_pid);
+    server_pid = 0;
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, BOT_STACK_SIZE);
+  int64_t start = monotonic_ns();
+  for (int started = 0; started < num_bots; started++) {
+    bots[started].index = started;
+    bots[started].seed = time(NULL) ^ (started * 2654435761u);
+    // a bot missing from a room would leave the rest of it waiting forever
+    if (pthread_create(&bots[started].thread, &attr, run_bot, &bots[started])) {
+      perror("PTHREAD CREATE FAILED:");
+      exit(2);
+    }
+  }
+  pthread_attr_destroy(&attr);
+  for (int i = 0; i < num_bots; i++) {
+    pthread_join(bots[i].thread, NULL);
+  }
+  double seconds = (monotonic_ns() - start) / 1e9;
+
+  print_report(bots, num_bots, seconds, server_pid, server_cpu);
+
+  // clean up
+  int failed = 0;
+  for (int i = 0; i < num_bots; i++) {
+    if (bots[i].games_failed > 0) failed = 1;
+    free(bots[i].latencies);
+  }
+  free(bots);
+  answer_key_t* key;
+  answer_key_t* temp;
+  HASH_ITER(hh, answer_key, key, temp) {
+    HASH_DEL(answer_key, key);
+    free(key->question);
+    free(key->answer);
+    free(key);
+  }
+  return failed ? 2 : 0;
+}
@@ -1,12 +1,15 @@
 #include <ctype.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "clock.h"
 #include "deps/socket.h"
 #include "game_structs.h"
+#include "protocol.h"
 
 /*
 chmod a+rx /home/niehusst/os213/project/
@@ -18,13 +21,40 @@ enum game_status game_state = GAME_ONGOING;
 
 int my_id;
 char* my_username;
+room_config_t room_config; // settings of the room the server seated us in
+int game_version = 0; // number of game updates received
+// Serializes the messages the UI and main threads send to the server
+pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Getting back into the game after losing the connection to the server
+char* server_name;
+unsigned short server_port;
+uint64_t session_token = 0; // from the server's welcome, 0 if it has none
+// Bumped (under send_lock) each time the connection is made again; what the
+// UI sends is dropped until it has caught up with the game on the new one
+int server_epoch = 0;
+int ui_epoch = 0;
+
+// Where a round picks up after the server sent the whole game again
+enum round_phase {
+  ROUND_PICK,   // the question hasn't been picked yet
+  ROUND_BUZZ,   // the question is up and we haven't answered it
+  ROUND_RESULT  // waiting on the results of the round
+};
+int resumed_phase = ROUND_PICK;
+
+// How long the results of a round are shown before the next one
+#define RESULTS_SHOWN_MS 3000
+// How much sooner than the server the client gives up on a phase of the
+// round, so that what it sends still makes it in time
+#define DEADLINE_MARGIN_MS 2000
 
 /**
  * Print a reassuring message to stdin to tell them they have connected 
  * before the game starts.
  */
 void wait_message() {
-  printf("You've joined the game!\nWaiting for all %d people to join the game...\n", MAX_NUM_PLAYERS);
+  printf("You've joined the game!\nWaiting for all %d people to join the game...\n", room_config.num_players);
 }
 
 
@@ -37,7 +67,7 @@ void wait_message() {
 void game_over(game_t* game) { 
   // determine who was the winner (max score)
   int max = 0; //index of player with max score
-  for(int score = 1; score < MAX_NUM_PLAYERS; score++) {
+  for(int score = 1; score < game->num_players; score++) {
     if(game->players[max].score < game->players[score].score) {
       max = score;
     }
@@ -47,7 +77,7 @@ void game_over(game_t* game) {
   // Show appropriate UI for end of game
   printf("\n%s has won the game!\n", winner);
   //print all scores and usernames
-  for(int player = 0; player < MAX_NUM_PLAYERS; player++) {
+  for(int player = 0; player < game->num_players; player++) {
     printf("Player %s scored: %d\n", game->players[player].name, game->players[player].score);
   }
 
@@ -57,8 +87,8 @@ void game_over(game_t* game) {
 }
 
 /**
- * Set the game_state global to end the game, and cause the main thread
- * to begin its exit procedures. Also send game-over notification and 
+ * Set the game_state global to end the game, and let the UI thread finish
+ * so the main thread can begin its exit procedures. Also send game-over notification and 
  * final scores to the UI so user knows game results.
  *
  * \param game - all information about the final state of the game
@@ -76,46 +106,23 @@ void end_game(game_t* game) {
  * The category title can be up to 26 characters across 2 rows of the UI.
  * 
  * \param game_data - data about the entire game, including question values
- * \return cats - string array of category titles
+ * \return cats - string array of category titles; the first row of every
+ *                title followed by the second row of every title
  */
 char** get_categories(game_t* game_data) {
-  /*
-    TODO: make this do line wrap for 2 rows WITHOUT CRASHING
-
-for some reason the first title of first row is pooP?? but then it fixes itself?? 
-   */
+  int num_categories = game_data->num_categories;
   // double size of num_categories for twice the row space
   // for cat names
-  char** cats = (char**) malloc(sizeof(char*)*2*NUM_CATEGORIES);
+  char** cats = (char**) malloc(sizeof(char*)*2*num_categories);
   // limit to size of portion of title that can fit in 1 row
-  int max_title_len = 14; 
+  int max_title_len = 13;
   
-  for(int cat = 0; cat < NUM_CATEGORIES; cat++) {
-    // check if this title needs to be split across 2 rows
-    if(strlen(game_data->categories[cat].title) >= max_title_len) {
-      // the title is too long to fit on one line, so split
-      // in multiple rows
-
-      // get the first part of the title
-      char* title = (char*) malloc(sizeof(char)*max_title_len);
-      int limit = cat==NUM_CATEGORIES-1 ? max_title_len-2 : max_title_len-1;
-      title = strndup(game_data->categories[cat].title,sizeof(char)*limit);
-
-      // write null terminator to cut in half title
-      //title[strlen(title)+1] = '\0';
-
-      // save first part of title on first row
-      cats[cat] = title;
-      // save second part of title on the second row
-      cats[cat+NUM_CATEGORIES] = strndup(game_data->categories[cat].title+limit,sizeof(char)*limit);
-
-    } else {
-      // the title can fit in one line! 
-      // save the title on the first line
-      cats[cat] = strdup(game_data->categories[cat].title);
-      // write empty string to second line
-      cats[cat+NUM_CATEGORIES] = "";
-    }  
+  for(int cat = 0; cat < num_categories; cat++) {
+    // the first row gets as much of the title as fits, and the second row
+    // gets the rest (if any)
+    char* title = game_data->categories[cat].title;
+    cats[cat] = strndup(title, max_title_len);
+    cats[cat+num_categories] = strndup(title+strlen(cats[cat]), max_title_len);
   }
   
   return cats;
@@ -127,39 +134,33 @@ for some reason the first title of first row is pooP?? but then it fixes itself?
  *
  * \param game_data - data about the entire game, including question values
  * \return question_point_values - string array of point values and crossed
- *                                 out completed questions
+ *                                 out completed questions, column by column
  */
 char** get_board_vals(game_t* game_data) {
   char* question_done = "XXXX";
 
-  int num_questions = NUM_QUESTIONS_PER_CATEGORY;
-  int num_categories = NUM_CATEGORIES;
+  int num_questions = game_data->num_rows;
+  int num_categories = game_data->num_categories;
   char** question_point_values = malloc(sizeof(char*)*(num_categories*num_questions));
 
-  //points string can hold up to 4 digits and null terminator
-  int num_size = 5;
+  //points string can hold up to 5 digits and null terminator
+  int num_size = 6;
 
   // loop through all questions, parsing values into a string array
   for(int cat = 0; cat < num_categories; cat++) {
     for(int q = 0; q < num_questions; q++) {
       // string to hold the point value of the question 
       char* points = (char*) malloc(sizeof(char)*num_size);
+      square_t* square = &game_data->categories[cat].questions[q];
       
-      //get question point value as a string
-      int written = snprintf(points, num_size, "%d", game_data->categories[cat].questions[q].value);
-      //if snprintf fails, just put question_done as a placeholder
-      if(written < 0) {
+      //get question point value as a string, or question_done if the
+      //question has already been answered (or isn't on this board)
+      if(square->is_answered || q >= game_data->categories[cat].num_questions) {
         strncpy(points, question_done, num_size);
-      }
-
-      //assign value if question hasn't been answerd
-      int already_answered = game_data->categories[cat].questions[q].is_answered;
-
-      if(already_answered) {
-        question_point_values[cat*num_categories + q] = question_done;
       } else {
-        question_point_values[cat*num_categories + q] = points;
+        snprintf(points, num_size, "%d", square->value);
       }
+      question_point_values[cat*num_questions + q] = points;
     }
   }
   
@@ -168,79 +169,72 @@ char** get_board_vals(game_t* game_data) {
 
 /**
  * Display the game board to the user with only valid, availble questions 
- * appearing on it.
+ * appearing on it. Columns are picked with letters from A and rows with
+ * numbers from 1.
  *
  * \param game_data - a struct that contains information about the game 
  *                    necessary for displaying the UI
- * \param categories - array of names of each category of questions
  */
 void display_board(game_t* game_data) {
   int buffer_space = 13;
+  int num_categories = game_data->num_categories;
+  int num_rows = game_data->num_rows;
   //get category names of truncated length
   char** categories = get_categories(game_data);
   char** point_vals = get_board_vals(game_data);
-  
-  printf("+------------------------------------------------------------------------------+\n| %*s | %*s | %*s | %*s | %*s |\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n| %*s | %*s | %*s | %*s | %*s |\n+---------------+---------------+---------------+---------------+--------------+\n",
-         // print the category titles
-         buffer_space, categories[0],
-         buffer_space, categories[1],
-         buffer_space, categories[2],
-         buffer_space, categories[3],
-         buffer_space-1, categories[4],
-         buffer_space, categories[5],
-         buffer_space, categories[6],
-         buffer_space, categories[7],
-         buffer_space, categories[8],
-         buffer_space-1, categories[9],
-         // print the values
-         buffer_space, point_vals[0],
-         buffer_space, point_vals[5],
-         buffer_space, point_vals[10],
-         buffer_space, point_vals[15],
-         buffer_space-1, point_vals[20],
-         buffer_space, point_vals[1],
-         buffer_space, point_vals[6],
-         buffer_space, point_vals[11],
-         buffer_space, point_vals[16],
-         buffer_space-1, point_vals[21],
-         buffer_space, point_vals[2],
-         buffer_space, point_vals[7],
-         buffer_space, point_vals[12],
-         buffer_space, point_vals[17],
-         buffer_space-1, point_vals[22],
-         buffer_space, point_vals[3],
-         buffer_space, point_vals[8],
-         buffer_space, point_vals[13],
-         buffer_space, point_vals[18],
-         buffer_space-1, point_vals[23],
-         buffer_space, point_vals[4],
-         buffer_space, point_vals[9],
-         buffer_space, point_vals[14],
-         buffer_space, point_vals[19],
-         buffer_space-1, point_vals[24]);
+
+  // line drawn between the rows of the board
+  char divider[MAX_CATEGORIES*(buffer_space+3) + 2];
+  int len = 0;
+  for(int cat = 0; cat < num_categories; cat++) {
+    divider[len++] = '+';
+    memset(divider + len, '-', buffer_space+2);
+    len += buffer_space+2;
+  }
+  strcpy(divider + len, "+");
+
+  // print the category titles over two lines
+  printf("%s\n", divider);
+  for(int line = 0; line < 2; line++) {
+    for(int cat = 0; cat < num_categories; cat++) {
+      printf("| %*s ", buffer_space, categories[line*num_categories + cat]);
+    }
+    printf("|\n");
+  }
+  printf("%s\n", divider);
+
+  // print the values
+  for(int q = 0; q < num_rows; q++) {
+    for(int cat = 0; cat < num_categories; cat++) {
+      printf("| %*s ", buffer_space, point_vals[cat*num_rows + q]);
+    }
+    printf("|\n%s\n", divider);
+  }
 
   // clean up
-  //free(categories); // TODO: this causes fuckery
+  for(int i = 0; i < 2*num_categories; i++) free(categories[i]);
+  for(int i = 0; i < num_categories*num_rows; i++) free(point_vals[i]);
+  free(categories);
   free(point_vals);
 }
 
 
 /**
- * Detects if any data was entered to STDIN within the time_out
- * seconds of the function being called. Input must be entered
+ * Detects if any data was entered to STDIN within the time_out_ms
+ * milliseconds of the function being called. Input must be entered
  * to be detected (not simply typed on command line).
  *
- * \param time_out - the number of seconds to wait for input
+ * \param time_out_ms - the number of milliseconds to wait for input
  * \return - boolean, True if STDIN read info, else False
  */
-int timed_getchar(int time_out) {
+int timed_getchar(int time_out_ms) {
   // timeout structure passed into select
   struct timeval tv;
   // fd_set passed into select
   fd_set fds;
-  // Set up the timeout. wait up to time-out seconds
-  tv.tv_sec = time_out;
-  tv.tv_usec = 0;
+  // Set up the timeout. wait up to time_out_ms milliseconds
+  tv.tv_sec = time_out_ms / 1000;
+  tv.tv_usec = (time_out_ms % 1000) * 1000;
 
   // Zero out the fd_set - make sure it's pristine
   FD_ZERO(&fds);
@@ -254,66 +248,181 @@ int timed_getchar(int time_out) {
 }
 
 
+/**
+ * Read the next message from the server, exiting if the server hung up or
+ * sent something other than what was expected. The server may send the
+ * whole game over again instead, after the connection to it was made
+ * again; that is read too.
+ *
+ * \param server - communication info for the game server
+ * \param type - the message_type to read
+ * \param frame - where to save the read message
+ * \param what - description of the message, for error messages
+ * \return - boolean, True if the message was read, False if a MSG_BOARD or
+ *           MSG_RESUMED with the whole game was read instead
+ */
+int read_message(input_t* server, int type, frame_t* frame, char* what) {
+  unsigned types = MSG_BIT(type) | MSG_BIT(MSG_BOARD) | MSG_BIT(MSG_RESUMED);
+  int result = recv_message(server->stream, types, frame);
+  if(result == 1) return frame->type == type;
+
+  if(result == 0) {
+    fprintf(stderr, "Lost connection to the server while reading %s\n", what);
+  } else if(frame->type == MSG_ERROR) {
+    char message[MAX_QUESTION_LENGTH];
+    decode_error(frame, message, MAX_QUESTION_LENGTH);
+    fprintf(stderr, "The server ended the game: %s\n", message);
+  } else {
+    fprintf(stderr, "Reading in %s failed: ", what);
+    perror("");
+  }
+  exit(2);
+}
+
+/**
+ * Send the messages encoded in buf to the server, and empty buf. Nothing is
+ * sent while the UI is behind the game on a new connection, since the
+ * messages are about the game as it was. If the connection is lost, the
+ * main thread finds out and gets it back.
+ *
+ * \param server - communication info for the game server
+ * \param buf - the encoded messages
+ * \param what - description of the messages, for error messages
+ */
+void send_message(input_t* server, wire_buf_t* buf, char* what) {
+  pthread_mutex_lock(&send_lock);
+  if(ui_epoch == server_epoch && !send_buf(server->socket_fd, buf)) {
+    fprintf(stderr, "Sending %s to the server failed: ", what);
+    perror("");
+  }
+  pthread_mutex_unlock(&send_lock);
+  buf->len = 0;
+}
+
 /**
  * The "buzz-in" portion of the game; let the user provide input, and as soon as
- * they do, send the current system time to the server as a mark of
- * when the client buzzed in. This function inherently trusts the client
- * has a correctly set system time.
+ * they do, tell the server. The server times the buzz when it arrives, so
+ * it is sent on its own, before the user types their answer.
  *
  * \param server - communication info for the game server
- * \return buzz_time - the system time when user buzzed in, or
- *                     -1 if the client did not buzz in
+ * \return - boolean, True if the user buzzed in, else False
  */
-time_t buzz_in() {
-  time_t buzz_time;
-  int time_out = 4; //seconds to wait before timed_getchar exits
+int buzz_in(input_t* server) {
+  //milliseconds to wait before timed_getchar exits; set by the room
+  int time_out_ms = room_config.buzz_timeout_ms;
   
   printf("Buzz in if you know the answer! (Hit enter)\n");
   // blocking IO call (with timeout) to hold back client until
   // response or time-out
-  if(timed_getchar(time_out)) {
-    //get system time of buzz in
-    buzz_time = time(NULL);
-  } else {
-    //client didn't buzz in, set buzz_time to specific value
-    buzz_time = -1;
-  }
- 
-  return buzz_time;
+  if(!timed_getchar(time_out_ms)) return 0;
+
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  encode_buzz(&buf, game_version + 1);
+  send_message(server, &buf, "buzz");
+  wire_buf_free(&buf);
+  return 1;
 }
 
 
 
 /**
- * Read all the data about the current state of the game from the server. The
- * struct can be rather large, so it is read in multiple packets from the 
- * server.
+ * Show the question that the client should answer to the UI.
+ *
+ * \param q - string question that needs to be displayed on UI
+ */
+void display_question(char* q) {
+  printf("The question is:\n%s\n",q);
+}
+
+/**
+ * Replace the game with the whole game sent by the server, at the start of
+ * the game or after getting our seat back on a new connection.
+ *
+ * \param frame - a MSG_BOARD or MSG_RESUMED frame
+ * \param game - the game to replace
+ * \return - the round_phase the round is in for this client
+ */
+int sync_game(frame_t* frame, game_t* game) {
+  resume_state_t state;
+  free(game->categories);
+  free(game->players);
+  int ok = frame->type == MSG_RESUMED ? decode_resumed(frame, &state, game, &game_version)
+                                      : decode_board(frame, game, &game_version);
+  if(!ok) {
+    fprintf(stderr, "Server sent a malformed game board\n");
+    exit(2);
+  }
+  // the UI is up to date with the game on the latest connection
+  pthread_mutex_lock(&send_lock);
+  ui_epoch = server_epoch;
+  pthread_mutex_unlock(&send_lock);
+  if(frame->type != MSG_RESUMED) return ROUND_PICK;
+
+  printf("\nYou're back in the game!\n");
+  my_id = state.id;
+  if(state.col == -1) return ROUND_PICK;
+  if(state.answered) return ROUND_RESULT;
+  display_question(game->categories[state.col].questions[state.row].question);
+  return ROUND_BUZZ;
+}
+
+/**
+ * Read all the data about the current state of the game from the server.
  *
  * \param server - communication info for the game server
  * \param game - the struct to write the read game into
- * \return game - the struct containing game data sent from the server  
+ * \return - the round_phase the game starts in
  */
-game_t* get_game(input_t* server, game_t* game) {
-  // read game_t from server and save into parameter game
-  int bytes_read = 0;
-  
-  // read in game struct packet by packet
-  do {
-    // do some nasty casting to start saving new data where last
-    // read left off
-    int temp = read(server->socket_fd, (game_t*)(((intptr_t)game)+bytes_read), sizeof(game_t)-bytes_read);
-    
-    // error code check
-    if(temp == -1) {
-      perror("Reading in game_t failed");
-      exit(2);
-    }
+int get_game(input_t* server, game_t* game) {
+  frame_t frame;
+  read_message(server, MSG_BOARD, &frame, "game board");
+  return sync_game(&frame, game);
+}
 
-    // increment the total number of bytes read, and check against size of game_t
-    bytes_read += temp;
-  } while (bytes_read != sizeof(game_t));
-    
-  return game;
+/**
+ * Read the changes made to the game in the last round from the server, and
+ * apply them to the game state the client already has.
+ *
+ * \param server - communication info for the game server
+ * \param game - the game to update
+ * \return - boolean, True if the game was updated, False if the whole game
+ *           was sent again instead (resumed_phase is set)
+ */
+int get_game_update(input_t* server, game_t* game) {
+  frame_t frame;
+  game_delta_t delta;
+  if(!read_message(server, MSG_DELTA, &frame, "game update")) {
+    resumed_phase = sync_game(&frame, game);
+    return 0;
+  }
+  if(!decode_delta(&frame, &delta)) {
+    fprintf(stderr, "Server sent a malformed game update\n");
+    exit(2);
+  }
+
+  // every round produces exactly one update
+  if(delta.version != ++game_version) {
+    fprintf(stderr, "Missed a game update from the server (got %d, expected %d)\n",
+            delta.version, game_version);
+    exit(2);
+  }
+
+  // mark the question as done so it can't be picked again
+  if(delta.col >= game->num_categories || delta.row >= game->num_rows) {
+    fprintf(stderr, "Server sent an update for a question not on the board\n");
+    exit(2);
+  }
+  square_t* square = &game->categories[delta.col].questions[delta.row];
+  square->is_answered = 1;
+  square->value = -1;
+
+  for(int player = 0; player < game->num_players; player++) {
+    game->players[player].score = delta.scores[player];
+  }
+  game->id_of_player_turn = delta.id_of_player_turn;
+  game->is_over = delta.is_over;
+  return 1;
 }
 
 /**
@@ -323,17 +432,18 @@ game_t* get_game(input_t* server, game_t* game) {
  * 
  * \param coords - string of 2 characters; a letter and number representing 
  *                 coordinates of a question on the game board
+ * \param board - the game, whose board size sets the range of coords
  * \return validity - boolean, whether or not the coords were valid 
  *                    (True if they are valid, else False) 
  */
 int choice_valid(char* coords, game_t* board) {
   int validity = 0;
-  // extract numeric coords within range of 0-4 
-  int col = coords[0] - 'A';      //range A-E
-  int row = coords[1] - '0' - 1;  //range 1-5
+  // extract numeric coords, counting from 0
+  int col = coords[0] - 'A';      //range A up to the last column
+  int row = coords[1] - '0' - 1;  //range 1 up to the last row
   
   // check coords are within range
-  if(row > 4 || row < 0 || col > 4 || col < 0) return validity;
+  if(row >= board->num_rows || row < 0 || col >= board->num_categories || col < 0) return validity;
   
   // check question hasn't already been answered
   if(!board->categories[col].questions[row].is_answered) {
@@ -345,31 +455,54 @@ int choice_valid(char* coords, game_t* board) {
 }
 
 
+/**
+ * Get the number of milliseconds left until a deadline.
+ *
+ * \param deadline - monotonic_ns() of the deadline
+ * \return - milliseconds left, 0 if the deadline has passed
+ */
+int ms_until(int64_t deadline) {
+  int64_t left = deadline - monotonic_ns();
+  return left > 0 ? left / 1000000 : 0;
+}
+
 /**
  * Get user input, allowing the user to select the question they 
  * want to answer. Send to the server so that other clients can receive
- * the same information.
+ * the same information. If the user takes too long, the server picks the
+ * question instead.
  *
  * \param server - communication info for the game server
  * \param game - all data about the current state of the game
+ * \param give_up - monotonic_ns() when to stop waiting on the user
  */
-void select_question(input_t* server, game_t* game) {
+void select_question(input_t* server, game_t* game, int64_t give_up) {
   //read client question choice; input must take coordinate form
-  //    letter row, number column (A1 through E5)
+  //    letter row, number column (A1 through the bottom right corner)
   int coord_size = 3;
   char coords[coord_size+1];
   
   printf("It's your turn to pick the question. What question do you choose?\n");
-  printf("(Choice must be in coordinate form: letter column, number row (e.g. E5))\n");
-  while(fgets(coords, coord_size, stdin) == NULL || !choice_valid(coords, game)) {
+  printf("(Choice must be in coordinate form: letter column, number row (e.g. %c%d))\n",
+         'A' + game->num_categories - 1, game->num_rows);
+  while(1) {
+    if(!timed_getchar(ms_until(give_up))) {
+      printf("Out of time! A question will be picked for you.\n");
+      return;
+    }
+    if(fgets(coords, coord_size, stdin) != NULL && choice_valid(coords, game)) break;
     //read failed
     printf("Unfortunately, that is not a valid choice.\nPlease pick a different question.\n");
     //consume whitespace from invalid coord choice
     while(getchar() != '\n');
   }
 
-  // send coords to server (until success)
-  while(write(server->socket_fd, coords, sizeof(char)*coord_size+1) == -1) {}
+  // send coords to server
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  encode_coords(&buf, MSG_SELECT, coords[0] - 'A', coords[1] - '0' - 1, game_version + 1);
+  send_message(server, &buf, "question selection");
+  wire_buf_free(&buf);
   getchar();//consume any leftover commandline input from the coord selection stage
 }
 
@@ -377,15 +510,23 @@ void select_question(input_t* server, game_t* game) {
  * Get user input that is the answer to a displayed question. Return the
  * answer obtained from stdin.
  *
- * \return answer - string, the user input answer to the displayed question
+ * \param give_up - monotonic_ns() when to stop waiting on the user
+ * \return answer - string, the user input answer to the displayed question,
+ *                  or NULL if the user took too long to give one
  */
-char* answer_question() {
+char* answer_question(int64_t give_up) {
   char* answer = malloc(sizeof(char)*MAX_ANSWER_LENGTH);
 
   printf("Thanks for buzzing in, %s.\nWhat is your answer?\n", my_username);
 
   // consume whitespace leftover in stdin
   while((getchar()) != '\n');
+
+  if(!timed_getchar(ms_until(give_up))) {
+    printf("Out of time to answer!\n");
+    free(answer);
+    return NULL;
+  }
   
   // get client's answer from standard input
   while(fgets(answer, MAX_ANSWER_LENGTH, stdin) == NULL) {
@@ -407,8 +548,8 @@ void display_answers(game_t* game, answer_t* ans) {
   // if anybody answered correctly, show their username
   if(ans->did_answer) {
     // search through players in game struct for the username of answerer id
-    char* answerer;
-    for(int player = 0; player < MAX_NUM_PLAYERS; player++) {
+    char* answerer = "Somebody";
+    for(int player = 0; player < game->num_players; player++) {
       if(game->players[player].id == ans->id) {
         answerer = game->players[player].name;
       }
@@ -432,28 +573,29 @@ void display_answers(game_t* game, answer_t* ans) {
  * answerer's username from the server.
  *
  * \param server - communication info for the game server
+ * \return - boolean, True if the results were read, False if the whole game
+ *           was sent again instead (resumed_phase is set)
  */
-void get_answers(input_t* server, game_t* game) {
+int get_answers(input_t* server, game_t* game) {
   answer_t* correct_ans = malloc(sizeof(answer_t));
+  frame_t frame;
   
   //read question answer info from server
-  if(read(server->socket_fd, correct_ans, sizeof(answer_t)) < sizeof(answer_t)) {
-    perror("reading correct answers failed");
+  if(!read_message(server, MSG_RESULT, &frame, "correct answer")) {
+    free(correct_ans);
+    resumed_phase = sync_game(&frame, game);
+    return 0;
+  }
+  if(!decode_result(&frame, correct_ans)) {
+    fprintf(stderr, "Server sent a malformed result\n");
+    exit(2);
   }
   
   //display correct answer and attempted answer w/ correctness to UI
   display_answers(game, correct_ans);
 
   free(correct_ans);
-}
-
-/**
- * Show the question that the client should answer to the UI.
- *
- * \param q - string question that needs to be displayed on UI
- */
-void display_question(char* q) {
-  printf("The question is:\n%s\n",q);
+  return 1;
 }
 
 /**
@@ -462,27 +604,30 @@ void display_question(char* q) {
  *
  * \param server - communication info for the game server
  * \param game - all information about the current state of the game  
+ * \return - boolean, True if the question was read, False if the whole game
+ *           was sent again instead (resumed_phase is set)
  */
-void get_question(input_t* server, game_t* game) {
+int get_question(input_t* server, game_t* game) {
   // read question coordinates
-  int coord_size = 3; //2 coord chars, null char
-  char* q_coords = malloc(sizeof(char)*coord_size);
-
-  if(read(server->socket_fd, q_coords, sizeof(char)*coord_size) <
-     sizeof(char)*coord_size) {
-    // read failed, try again looping
-    perror("read less than expected\n");
+  frame_t frame;
+  int col, row;
+  if(!read_message(server, MSG_QUESTION, &frame, "question coords")) {
+    resumed_phase = sync_game(&frame, game);
+    return 0;
+  }
+  if(!decode_coords(&frame, &col, &row)) {
+    fprintf(stderr, "Server sent malformed question coords\n");
+    exit(2);
+  }
+  if(col >= game->num_categories || row >= game->num_rows) {
+    fprintf(stderr, "Server picked a question not on the board\n");
+    exit(2);
   }
-
-  // parse question string from received coords
-  int col = q_coords[0] - 'A';      //range A-E
-  int row = q_coords[1] - '0' - 1;  //range 1-5
   char* question = game->categories[col].questions[row].question;
 
-  // free location allocated for now useless coords
-  free(q_coords);
   // show question on UI
   display_question(question);
+  return 1;
 }
 
 /**
@@ -503,7 +648,7 @@ int is_my_turn(game_t* game) {
 void score_update(game_t* game) {
   printf("\n| CURRENT SCORES:\n");
   //print all scores and usernames
-  for(int player = 0; player < MAX_NUM_PLAYERS; player++) {
+  for(int player = 0; player < game->num_players; player++) {
     printf("| %s: %d\n", game->players[player].name, game->players[player].score);
   }
 }
@@ -517,12 +662,17 @@ void score_update(game_t* game) {
  */
 void* ui_update(void* server_info) {
   input_t* server = (input_t*) server_info;
-  game_t* game = malloc(sizeof(game_t));
+  game_t* game = calloc(1, sizeof(game_t));
+
+  // Get the whole game from the server once; after that, the server only
+  // sends what changed each round, unless the connection was lost and
+  // the game has to be picked up again at some other phase of a round
+  int phase = get_game(server, game);
+  // when the server started the current phase, as far as the client knows
+  int64_t phase_start = monotonic_ns();
 
   // update the UI until the main thread exits
   while(1) {
-    // Get game data from the server
-    get_game(server, game);
 
     // if game is over, end the game and the UI loop
     if(game->is_over) {
@@ -530,84 +680,288 @@ void* ui_update(void* server_info) {
       break;
     }
 
-    // Show latest update of scores
-    score_update(game);
+    if(phase == ROUND_PICK) {
+      // Show latest update of scores
+      score_update(game);
     
-    // show the game board 
-    display_board(game); //TODO: make this show more of category names
+      // show the game board 
+      display_board(game); //TODO: make this show more of category names
     
-    // if it is the clients turn, have them select the question
-    if(is_my_turn(game)) {
-      select_question(server, game);
-    }
+      // if it is the clients turn, have them select the question
+      if(is_my_turn(game)) {
+        select_question(server, game, phase_start + (SELECT_TIMEOUT_MS - DEADLINE_MARGIN_MS) * 1000000LL);
+      }
     
-    // get the selected question from the server
-    get_question(server, game);
-
-    // provide some time for players to read the question
-    sleep(3);
-
-    /*
-      Everyone can buzz in and everyone can submit an answer if
-      they buzzed in (regardless of buzz order), but only the
-      client who buzzed first will get the points for answering.
-     */
-    answer_t ans; // save data from buzz/answer period
-    time_t buzz_time = buzz_in();
-    // check if client buzzed in
-    if(buzz_time != -1) {
-      // copy the result of answer_question into answer array
-      strncpy(ans.answer, answer_question(), MAX_ANSWER_LENGTH);
-    } else {
-      printf("Too late to buzz in!\n");
+      // get the selected question from the server
+      if(!get_question(server, game)) {
+        phase = resumed_phase;
+        phase_start = monotonic_ns();
+        continue;
+      }
+      phase = ROUND_BUZZ;
+      phase_start = monotonic_ns();
     }
 
-    // send buzz/answer period data to server
-    ans.did_answer = buzz_time != -1;
-    ans.time = buzz_time;
+    if(phase == ROUND_BUZZ) {
+      // provide some time for players to read the question
+      usleep(QUESTION_READ_MS * 1000);
+
+      /*
+        Everyone can buzz in and everyone can submit an answer if
+        they buzzed in (regardless of buzz order), but only the
+        client who buzzed first will get the points for answering.
+       */
+      answer_t ans; // save data from buzz/answer period
+      ans.answer[0] = '\0';
+      int buzzed = buzz_in(server);
+      // check if client buzzed in
+      if(buzzed) {
+        // copy the result of answer_question into answer array; the server
+        // stops waiting on answers a while after buzzing closes
+        int answer_ms = QUESTION_READ_MS + room_config.buzz_timeout_ms + BUZZ_GRACE_MS +
+          ANSWER_TIMEOUT_MS - DEADLINE_MARGIN_MS;
+        char* answer = answer_question(phase_start + answer_ms * 1000000LL);
+        if(answer != NULL) {
+          strncpy(ans.answer, answer, MAX_ANSWER_LENGTH);
+          free(answer);
+        } else {
+          buzzed = 0;
+        }
+      } else {
+        printf("Too late to buzz in!\n");
+      }
+
+      // send buzz/answer period data to server
+      ans.did_answer = buzzed;
     
-    if(write(server->socket_fd, &ans, sizeof(answer_t)) < sizeof(answer_t)) {
-      perror("Writing answer to server failed\n");
+      wire_buf_t buf;
+      wire_buf_init(&buf);
+      encode_answer(&buf, &ans, game_version + 1);
+      send_message(server, &buf, "answer");
+      wire_buf_free(&buf);
     }
     
     // block until server responds with results of answering period 
-    get_answers(server, game);
+    if(!get_answers(server, game)) {
+      phase = resumed_phase;
+      phase_start = monotonic_ns();
+      continue;
+    }
+    // the server starts the next round as soon as the results are out
+    phase_start = monotonic_ns();
     
     // provide a few moments for the user to read the scores
-    sleep(3);
+    usleep(RESULTS_SHOWN_MS * 1000);
+
+    // Get game data from the server
+    if(!get_game_update(server, game)) {
+      phase = resumed_phase;
+      phase_start = monotonic_ns();
+      continue;
+    }
+    phase = ROUND_PICK;
   }
   
   // clean up
+  free(game->categories);
+  free(game->players);
   free(game);
   return NULL;
 }
 
 
+/**
+ * Connect to the server again after losing the connection in the middle of
+ * the game, and ask for our seat back. Tries once a second until it's too
+ * late.
+ *
+ * \param server - communication info for the game server; its socket is
+ *                 replaced
+ * \param stream - the messages arriving from the server; set up to read
+ *                 from the new socket
+ * \param give_up - monotonic_ns() when to stop trying
+ * \return - boolean, True if the request was sent over a new connection
+ */
+int reconnect(input_t* server, frame_stream_t* stream, int64_t give_up) {
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  encode_resume(&buf, session_token);
+  int sent = 0;
+  while(!sent && monotonic_ns() < give_up) {
+    int socket_fd = socket_connect(server_name, server_port);
+    if(socket_fd == -1) {
+      sleep(1);
+      continue;
+    }
+    set_nodelay(socket_fd);
+
+    // whatever the UI sends from now on goes over the new connection
+    pthread_mutex_lock(&send_lock);
+    close(server->socket_fd);
+    server->socket_fd = socket_fd;
+    server_epoch++;
+    sent = send_buf(socket_fd, &buf);
+    pthread_mutex_unlock(&send_lock);
+  }
+  wire_buf_free(&buf);
+
+  stream->fd = server->socket_fd;
+  stream->len = 0;
+  stream->consumed = 0;
+  return sent;
+}
+
+/**
+ * Read every message sent by the server, answering pings right away so the
+ * server's latency estimates don't depend on what the UI is doing, and pass
+ * everything else on to the UI thread. If the connection is lost in the
+ * middle of the game, connects again and gets our seat back. Returns once
+ * the server closes the connection for good.
+ *
+ * \param server - communication info for the game server
+ * \param stream - the messages arriving from the server
+ * \param ui_fd - the pipe the UI thread reads the server's messages from
+ */
+void relay_messages(input_t* server, frame_stream_t* stream, int ui_fd) {
+  frame_t frame;
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  int game_over = 0;     // boolean, set once the final game update arrives
+  int64_t give_up = -1;  // when to stop trying to get back in, -1 if connected
+
+  while(1) {
+    if(recv_frame(stream, &frame) != 1) {
+      if(game_over || session_token == 0) break;
+      if(give_up == -1) {
+        fprintf(stderr, "\nLost connection to the server; trying to get back into the game...\n");
+        give_up = monotonic_ns() + RECONNECT_GRACE_MS * 1000000LL;
+      }
+      if(!reconnect(server, stream, give_up)) {
+        fprintf(stderr, "Couldn't get back into the game\n");
+        break;
+      }
+      continue;
+    }
+    give_up = -1;
+
+    if(frame.type == MSG_PING) {
+      // pongs are about the connection rather than the game, so they are
+      // never held back like the UI's messages
+      int64_t sent;
+      if(decode_ping(&frame, &sent)) {
+        encode_pong(&buf, sent, stream->last_read_time, monotonic_ns());
+        pthread_mutex_lock(&send_lock);
+        send_buf(server->socket_fd, &buf);
+        pthread_mutex_unlock(&send_lock);
+        buf.len = 0;
+      }
+      continue;
+    }
+    if(frame.type == MSG_WELCOME) {
+      // only sent again if the server restarted and seated us back in our
+      // game; the whole game follows once everyone is back
+      int version, id;
+      room_config_t config;
+      decode_welcome(&frame, &version, &id, &config, &session_token);
+      continue;
+    }
+    if(frame.type == MSG_DELTA) {
+      game_delta_t delta;
+      game_over = decode_delta(&frame, &delta) && delta.is_over;
+    }
+    // the server won't take us back after telling us why it's hanging up
+    if(frame.type == MSG_ERROR) session_token = 0;
+
+    // pass on the whole frame, header included
+    const uint8_t* data = frame.payload - FRAME_HEADER_SIZE;
+    size_t size = FRAME_HEADER_SIZE + frame.length;
+    size_t written = 0;
+    while(written < size) {
+      ssize_t temp = write(ui_fd, data + written, size - written);
+      if(temp == -1) {
+        perror("Passing message to the UI failed");
+        exit(2);
+      }
+      written += temp;
+    }
+  }
+  wire_buf_free(&buf);
+}
+
+/**
+ * Read a room setting given on the command line, exiting with the usage
+ * message if it is out of range.
+ *
+ * \param arg - the setting as typed
+ * \param min - smallest value allowed
+ * \param max - largest value allowed
+ * \param what - the name of the setting, for the error message
+ * \return - the setting
+ */
+int parse_setting(char* arg, int min, int max, char* what) {
+  char* end;
+  long value = strtol(arg, &end, 10);
+  if(*arg == '\0' || *end != '\0' || value < min || value > max) {
+    fprintf(stderr, "The number of %s must be from %d to %d\n", what, min, max);
+    exit(1);
+  }
+  return value;
+}
+
 /**
  * The launching point of the game. Sets up communication with the game server and
  * begins the necessary threads for playing the game.
  *
- * \param argc - the number of command line inputs; must be 3
- * \param argv - command line input strings; must pass server name and the port it runs on
+ * \param argc - the number of command line inputs; at least 4
+ * \param argv - command line input strings; the room settings wanted (all
+ *               optional), then the username, server name and the port it runs on
  * \return - the program exit status
  */
 int main(int argc, char** argv) {
-  if(argc != 4) {
-    fprintf(stderr, "Usage: %s <username> <server name> <port>\n", argv[0]);
+  // Read the room settings; anything not given is left to the server
+  room_config_t wanted_config = {0, 0, 0, 0};
+  int opt;
+  while((opt = getopt(argc, argv, "p:c:r:t:")) != -1) {
+    switch(opt) {
+    case 'p':
+      wanted_config.num_players = parse_setting(optarg, 1, MAX_NUM_PLAYERS, "players");
+      break;
+    case 'c':
+      wanted_config.num_categories = parse_setting(optarg, 1, MAX_CATEGORIES, "categories");
+      break;
+    case 'r':
+      wanted_config.num_rows = parse_setting(optarg, 1, NUM_QUESTIONS_PER_CATEGORY, "rows");
+      break;
+    case 't':
+      wanted_config.buzz_timeout_ms = 1000 * parse_setting(optarg, MIN_BUZZ_TIMEOUT_MS / 1000,
+                                                           MAX_BUZZ_TIMEOUT_MS / 1000, "buzz seconds");
+      break;
+    default:
+      argc = 0; // print the usage message
+    }
+  }
+  if(argc - optind != 3) {
+    fprintf(stderr, "Usage: %s [-p players] [-c categories] [-r rows] [-t buzz_seconds] "
+            "<username> <server name> <port>\n", argv[0]);
     exit(1);
   }
 	
   // Read command line arguments
-  my_username = argv[1]; 
-  char* server_name = argv[2];
-  unsigned short port = atoi(argv[3]);
+  my_username = argv[optind]; 
+  server_name = argv[optind+1];
+  server_port = atoi(argv[optind+2]);
+  // writing to a lost connection fails with EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
 	
   // Connect to the server
-  int socket_fd = socket_connect(server_name, port);
+  int socket_fd = socket_connect(server_name, server_port);
   if(socket_fd == -1) {
     fprintf(stderr, "Failed to connect to game server\n");
     exit(2);
   }
+  if(set_nodelay(socket_fd) == -1) {
+    perror("Unable to disable Nagle's algorithm");
+  }
 
   // Set up file streams
   FILE* to_server = fdopen(dup(socket_fd), "wb");
@@ -628,40 +982,64 @@ int main(int argc, char** argv) {
   server->from = from_server;
   server->socket_fd = socket_fd;
 
-  // Send username size to the server
-  int len = MAX_ANSWER_LENGTH < (strlen(my_username) + 1) ? MAX_ANSWER_LENGTH : (strlen(my_username) + 1);
-  while(write(socket_fd, &len, sizeof(int)) == -1) {
-    //try again while failing
-  }
-
-  // Send the username to the server
-  while(write(socket_fd, my_username, sizeof(char) * len) == -1) {
-    //try again while failing
-  }
-
-  // Get your user number back from server
-  while(read(socket_fd, &my_id, sizeof(int)) == -1) {
-    //try again while failing
+  // Set up reading the messages sent by the server
+  frame_stream_t stream;
+  frame_stream_init(&stream, socket_fd, FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD);
+  server->stream = &stream;
+
+  // Send the protocol version and username to the server
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  encode_hello(&buf, my_username, &wanted_config);
+  send_message(server, &buf, "username");
+  wire_buf_free(&buf);
+
+  // Get your user number back from server, and make sure the server
+  // speaks a protocol this client understands
+  frame_t frame;
+  int version = 0;
+  if(!read_message(server, MSG_WELCOME, &frame, "player id") ||
+     !decode_welcome(&frame, &version, &my_id, &room_config, &session_token) ||
+     negotiate_version(version) == -1) {
+    fprintf(stderr, "Server uses protocol version %d, but this client needs version %d to %d\n",
+            version, MIN_PROTOCOL_VERSION, PROTOCOL_VERSION);
+    exit(2);
   }
   
   // Notify user that game has been joined
   wait_message();
   
+  // The UI thread reads the server's messages from a pipe fed by this one
+  int ui_pipe[2];
+  if(pipe(ui_pipe) == -1) {
+    perror("Failed to create pipe to the UI");
+    exit(2);
+  }
+  frame_stream_t ui_stream;
+  frame_stream_init(&ui_stream, ui_pipe[0], FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD);
+  server->stream = &ui_stream;
+
   // Launch UI thread
   pthread_t ui_update_thread;
   pthread_create(&ui_update_thread, NULL, ui_update, server);
 
-  // Block main thread while game is ongoing
-  while(game_state) {}
+  // Handle messages from the server until it hangs up at the end of the
+  // game, then wait for the player to be done with the UI
+  relay_messages(server, &stream, ui_pipe[1]);
+  close(ui_pipe[1]);
+  pthread_join(ui_update_thread, NULL);
 
   // Close file streams
   fclose(to_server);
   fclose(from_server);
   
-  // Close socket
-  close(socket_fd);
+  // Close socket; it may not be the one first connected
+  close(server->socket_fd);
 
   // Free malloced memory
+  frame_stream_free(&stream);
+  frame_stream_free(&ui_stream);
+  close(ui_pipe[0]);
   free(server);
 	
   return 0;
@@ -0,0 +1,19 @@
+#ifndef __CLOCK__
+#define __CLOCK__
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Reads the monotonic clock. It never jumps when the system time is
+ * changed and is shared by every thread, so its readings can be used to
+ * order events and measure intervals.
+ *
+ * \return - nanoseconds since an arbitrary fixed point in the past
+ */
+static inline int64_t monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include <stddef.h>
+
+#include "clock.h"
+#include "deadline.h"
+
+/*
+  Deadlines set by the event loop, kept in a hierarchical timer wheel so
+  every room and connection can have one without the loop slowing down as
+  they add up. Time goes by in ticks of DEADLINE_TICK_NS. Each level of
+  the wheel is a ring of slots, and each slot a list of deadlines:
+
+    level 0: a slot per tick, for deadlines less than 256 ticks away
+    level 1: a slot per 256 ticks, for deadlines less than 256^2 away
+    level 2: a slot per 256^2 ticks, for deadlines less than 256^3 away
+    level 3: a slot per 256^3 ticks, for the rest (up to about 49 days)
+
+  Setting or cancelling a deadline is a constant time link or unlink. As
+  the wheel turns, the level 0 slot of each tick expires, and each time a
+  level's slot starts over the slot of the level above is cascaded: its
+  deadlines are set again, which puts them a level or more lower. Each
+  deadline is moved at most once per level. A bitmap of the slots in use
+  lets the wheel skip straight past the ones that are empty.
+*/
+
+typedef struct timer_wheel {
+  deadline_t* slots[DEADLINE_LEVELS][DEADLINE_SLOTS];
+  uint64_t in_use[DEADLINE_LEVELS][DEADLINE_SLOTS / 64]; // bit per non-empty slot
+  uint64_t tick;  // the next tick to expire; every earlier one has
+  int started;    // boolean, set once tick has been read from the clock
+} timer_wheel_t;
+
+timer_wheel_t wheel;
+long deadlines_set = 0;
+// The deadlines of the tick being expired
+deadline_t* expiring = NULL;
+
+/**
+ * Gives the distance to the next slot of a level that is in use, going
+ * around the ring
+ *
+ * \param level - the level of the wheel
+ * \param from - the slot to start looking at
+ * \return - slots from from to the next one in use, 0 if from is; -1 if
+ *           every slot of the level is empty
+ */
+int next_slot_in_use(int level, int from) {
+  int step = 0;
+  while (step < DEADLINE_SLOTS) {
+    int slot = (from + step) & (DEADLINE_SLOTS - 1);
+    uint64_t bits = wheel.in_use[level][slot / 64] >> (slot % 64);
+    if (bits != 0) {
+      step += __builtin_ctzll(bits);
+      // past the end of the ring means back where we started
+      return step < DEADLINE_SLOTS ? step : -1;
+    }
+    step += 64 - slot % 64;
+  }
+  return -1;
+}
+
+/**
+ * Puts a deadline in the slot of the wheel for its time
+ *
+ * \param deadline - the deadline, which isn't in any list
+ */
+void wheel_insert(deadline_t* deadline) {
+  // rounded up, so a deadline never expires before it has passed
+  uint64_t tick = deadline->when <= 0 ? 0 : (deadline->when + DEADLINE_TICK_NS - 1) / DEADLINE_TICK_NS;
+  if (tick < wheel.tick) tick = wheel.tick;
+  uint64_t ahead = tick - wheel.tick;
+  int level = 0;
+  while (level < DEADLINE_LEVELS - 1 && ahead >> (DEADLINE_SLOT_BITS * (level + 1)) != 0) level++;
+  // anything further away than the wheel reaches waits at its far end
+  if (ahead >> (DEADLINE_SLOT_BITS * DEADLINE_LEVELS) != 0) {
+    tick = wheel.tick + ((uint64_t)1 << (DEADLINE_SLOT_BITS * DEADLINE_LEVELS)) - 1;
+  }
+  int slot = (tick >> (DEADLINE_SLOT_BITS * level)) & (DEADLINE_SLOTS - 1);
+
+  deadline_t** head = &wheel.slots[level][slot];
+  deadline->slot = level * DEADLINE_SLOTS + slot;
+  deadline->next = *head;
+  if (*head != NULL) (*head)->link = &deadline->next;
+  deadline->link = head;
+  *head = deadline;
+  wheel.in_use[level][slot / 64] |= (uint64_t)1 << (slot % 64);
+}
+
+/**
+ * Takes every deadline out of a slot
+ *
+ * \param level - the level of the slot
+ * \param slot - the slot
+ * \return - the list of deadlines that were in it; its first deadline's
+ *           link still points at the slot
+ */
+deadline_t* wheel_take(int level, int slot) {
+  deadline_t* taken = wheel.slots[level][slot];
+  wheel.slots[level][slot] = NULL;
+  wheel.in_use[level][slot / 64] &= ~((uint64_t)1 << (slot % 64));
+  return taken;
+}
+
+/**
+ * Cascades the slots that start over at the current tick, moving their
+ * deadlines to the levels below. Must be called when the current tick is
+ * the first of a level 0 ring.
+ */
+void wheel_cascade() {
+  for (int level = 1; level < DEADLINE_LEVELS; level++) {
+    int slot = (wheel.tick >> (DEADLINE_SLOT_BITS * level)) & (DEADLINE_SLOTS - 1);
+    deadline_t* deadline = wheel_take(level, slot);
+    while (deadline != NULL) {
+      deadline_t* next = deadline->next;
+      wheel_insert(deadline);
+      deadline = next;
+    }
+    // the level above only starts over when this one does
+    if (slot != 0) return;
+  }
+}
+
+/**
+ * Sets a deadline, moving it if it was already set
+ *
+ * \param deadline - the deadline to set
+ * \param when - monotonic_ns() at which it passes
+ * \param expire - called with data once it has passed
+ * \param data - passed to expire
+ */
+void deadline_set(deadline_t* deadline, int64_t when, void (*expire)(void*), void* data) {
+  deadline_cancel(deadline);
+  if (!wheel.started) {
+    wheel.tick = monotonic_ns() / DEADLINE_TICK_NS;
+    wheel.started = 1;
+  }
+  deadline->when = when;
+  deadline->expire = expire;
+  deadline->data = data;
+  wheel_insert(deadline);
+  deadlines_set++;
+}
+
+/**
+ * Cancels a deadline. Does nothing if it isn't set.
+ *
+ * \param deadline - the deadline to cancel
+ */
+void deadline_cancel(deadline_t* deadline) {
+  if (deadline->link == NULL) return;
+  *deadline->link = deadline->next;
+  if (deadline->next != NULL) deadline->next->link = deadline->link;
+  int level = deadline->slot / DEADLINE_SLOTS;
+  int slot = deadline->slot % DEADLINE_SLOTS;
+  if (wheel.slots[level][slot] == NULL) {
+    wheel.in_use[level][slot / 64] &= ~((uint64_t)1 << (slot % 64));
+  }
+  deadline->link = NULL;
+  deadline->next = NULL;
+  deadlines_set--;
+}
+
+/**
+ * Gives how long the event loop can wait before the wheel next has to
+ * turn: when the next deadline passes, or when deadlines further away
+ * have to be cascaded, whichever comes first
+ *
+ * \param now - monotonic_ns()
+ * \return - milliseconds to wait, rounded up, or -1 if no deadline is set
+ */
+int deadline_wait_ms(int64_t now) {
+  if (deadlines_set == 0) return -1;
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < DEADLINE_LEVELS; level++) {
+    int shift = DEADLINE_SLOT_BITS * level;
+    uint64_t span = (uint64_t)1 << shift;
+    // the slot for the span the wheel is in has been cascaded already,
+    // unless the wheel is at its very first tick
+    uint64_t first = (wheel.tick >> shift) + (level > 0 && (wheel.tick & (span - 1)) != 0);
+    int ahead = next_slot_in_use(level, first & (DEADLINE_SLOTS - 1));
+    if (ahead != -1 && ((first + ahead) << shift) < next) next = (first + ahead) << shift;
+  }
+  int64_t at = next * DEADLINE_TICK_NS;
+  if (at <= now) return 0;
+  int64_t wait = (at - now + DEADLINE_TICK_NS - 1) / DEADLINE_TICK_NS;
+  return wait > INT32_MAX ? INT32_MAX : wait;
+}
+
+/**
+ * Turns the wheel up to now, cancelling every deadline that has passed and
+ * calling its expire function. Expire functions are free to set and cancel
+ * deadlines, including their own.
+ *
+ * \param now - monotonic_ns()
+ */
+void deadline_run(int64_t now) {
+  uint64_t last = now / DEADLINE_TICK_NS;
+  while (wheel.tick <= last) {
+    if (deadlines_set == 0) {
+      wheel.tick = last + 1;
+      return;
+    }
+    int slot = wheel.tick & (DEADLINE_SLOTS - 1);
+    if (slot == 0) wheel_cascade();
+
+    // skip the empty ticks, up to the end of the ring
+    int ahead = next_slot_in_use(0, slot);
+    if (ahead == -1 || slot + ahead >= DEADLINE_SLOTS) {
+      uint64_t ring_end = wheel.tick - slot + DEADLINE_SLOTS;
+      wheel.tick = ring_end < last + 1 ? ring_end : last + 1;
+      continue;
+    }
+    if (wheel.tick + ahead > last) {
+      wheel.tick = last + 1;
+      return;
+    }
+
+    // deadlines set while expiring these go in a later tick
+    wheel.tick += ahead + 1;
+    expiring = wheel_take(0, slot + ahead);
+    if (expiring != NULL) expiring->link = &expiring;
+    deadline_t* deadline;
+    while ((deadline = expiring) != NULL) {
+      deadline_cancel(deadline);
+      deadline->expire(deadline->data);
+    }
+  }
+}
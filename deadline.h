@@ -0,0 +1,37 @@
+#ifndef __DEADLINE__
+#define __DEADLINE__
+#include <stdint.h>
+
+// Deadlines are kept to the millisecond, the resolution of epoll_wait
+#define DEADLINE_TICK_NS 1000000LL
+// The timer wheel has DEADLINE_LEVELS levels of DEADLINE_SLOTS slots; a
+// slot of each level spans DEADLINE_SLOTS slots of the level below it
+#define DEADLINE_SLOT_BITS 8
+#define DEADLINE_SLOTS (1 << DEADLINE_SLOT_BITS)
+#define DEADLINE_LEVELS 4
+
+/**
+ * Something the event loop has to do at a set time, like giving up on a
+ * player who hasn't picked a question. Embedded in whatever it's about;
+ * the owner sets it and cancels it, and mustn't free it while it's set.
+ */
+typedef struct deadline {
+  int64_t when;                // monotonic_ns() at which it passes
+  void (*expire)(void* data);  // called once it has passed
+  void* data;                  // passed to expire
+  int slot;                    // level * DEADLINE_SLOTS + slot of the timer
+                               // wheel it is in
+  struct deadline* next;
+  struct deadline** link;      // the pointer to it in its slot's list, NULL
+                               // while it isn't set
+} deadline_t;
+
+// Number of deadlines set
+extern long deadlines_set;
+
+void deadline_set(deadline_t* deadline, int64_t when, void (*expire)(void*), void* data);
+void deadline_cancel(deadline_t* deadline);
+int deadline_wait_ms(int64_t now);
+void deadline_run(int64_t now);
+
+#endif
@@ -70,6 +70,14 @@ static int server_socket_open(unsigned short* port) {
     return -1;
   }
 
+  // Allow binding a port that connections of a server that just stopped
+  // are still lingering on
+  int reuse = 1;
+  if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse))) {
+    close(fd);
+    return -1;
+  }
+
   // Set up the server socket to listen
   struct sockaddr_in addr = {
     .sin_family = AF_INET,          // This is an internet socket
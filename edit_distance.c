@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "edit_distance.h"
+#include "deps/levenshtein.h"
+
+// Longest pattern the bit-parallel algorithm handles; one bit per character
+#define WORD_BITS 64
+
+// Bit masks of where each character occurs in the pattern. Entries are
+// only ever set for the pattern being matched and cleared again after, so
+// the table doesn't need clearing before each call.
+static __thread uint64_t pattern_masks[256];
+
+/**
+ * Levenshtein distance between two strings with Myers' bit-vector
+ * algorithm (in Hyyro's form for edit distance). The columns of the
+ * dynamic programming table are kept as bit vectors of the +1/-1 steps
+ * between neighbouring cells, so each character of b takes a handful of
+ * word operations instead of a pass over a. Nothing is allocated as long
+ * as the shorter string fits in a machine word.
+ *
+ * \param a - the first string
+ * \param a_len - the length of a
+ * \param b - the second string
+ * \param b_len - the length of b
+ * \param max - give up once the distance is certain to be above this
+ * \return - the distance, or some value above max if it is above max
+ */
+size_t edit_distance_bounded(const char* a, size_t a_len, const char* b, size_t b_len,
+                             size_t max) {
+  // the shorter string is the pattern, so it fits in a word more often
+  if (a_len > b_len) {
+    const char* s = a; a = b; b = s;
+    size_t len = a_len; a_len = b_len; b_len = len;
+  }
+  if (b_len - a_len > max) return max + 1;
+  if (a_len == 0) return b_len;
+  if (a_len > WORD_BITS) return levenshtein_n(a, a_len, b, b_len);
+
+  for (size_t i = 0; i < a_len; i++) {
+    pattern_masks[(unsigned char)a[i]] |= (uint64_t)1 << i;
+  }
+
+  uint64_t last = (uint64_t)1 << (a_len - 1);
+  uint64_t pv = ~(uint64_t)0; // vertical steps of +1
+  uint64_t mv = 0;            // vertical steps of -1
+  size_t score = a_len;       // the bottom cell of the current column
+  for (size_t j = 0; j < b_len; j++) {
+    uint64_t eq = pattern_masks[(unsigned char)b[j]];
+    uint64_t xv = eq | mv;
+    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);  // horizontal steps of +1
+    uint64_t mh = pv & xh;          // horizontal steps of -1
+    if (ph & last) score++;
+    if (mh & last) score--;
+
+    // each remaining column can lower the score by at most 1
+    if (score > max + (b_len - j - 1)) {
+      score = max + 1;
+      break;
+    }
+
+    // the top row counts up from 0, so a +1 step shifts in at the top
+    ph = (ph << 1) | 1;
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  }
+
+  for (size_t i = 0; i < a_len; i++) {
+    pattern_masks[(unsigned char)a[i]] = 0;
+  }
+  return score;
+}
+
+/**
+ * Levenshtein distance between two strings; see edit_distance_bounded
+ *
+ * \param a - the first string
+ * \param a_len - the length of a
+ * \param b - the second string
+ * \param b_len - the length of b
+ * \return - the number of insertions, deletions and substitutions needed
+ *           to turn a into b
+ */
+size_t edit_distance(const char* a, size_t a_len, const char* b, size_t b_len) {
+  // the distance can never be more than the longer length
+  return edit_distance_bounded(a, a_len, b, b_len, a_len > b_len ? a_len : b_len);
+}
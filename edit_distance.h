@@ -0,0 +1,9 @@
+#ifndef __EDIT_DISTANCE__
+#define __EDIT_DISTANCE__
+#include <stddef.h>
+
+size_t edit_distance(const char* a, size_t a_len, const char* b, size_t b_len);
+size_t edit_distance_bounded(const char* a, size_t a_len, const char* b, size_t b_len,
+                             size_t max);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clock.h"
+#include "event_log.h"
+
+event_log_t* event_log = NULL;
+
+// How event types are named when a log is printed
+static const char* event_names[NUM_EVENT_TYPES] = {
+  [EVENT_GAME_STARTED] = "game_started",
+  [EVENT_QUESTION_SELECTED] = "question_selected",
+  [EVENT_BUZZ] = "buzz",
+  [EVENT_ANSWER_GRADED] = "answer_graded",
+  [EVENT_SCORE_CHANGED] = "score_changed",
+  [EVENT_GAME_OVER] = "game_over",
+  [EVENT_ANSWER_SUBMITTED] = "answer_submitted",
+};
+
+/**
+ * Gives the name of an event type
+ *
+ * \param type - the type of an event
+ * \return - the name of the type, or "unknown"
+ */
+const char* event_type_name(int type) {
+  if (type <= 0 || type >= NUM_EVENT_TYPES) return "unknown";
+  return event_names[type];
+}
+
+/**
+ * Adds an event to the log without ever waiting: if the ring is full the
+ * event is dropped. Safe to call from any thread, and does nothing if
+ * events aren't being logged.
+ *
+ * \param event - the event to log
+ */
+void log_event(const event_t* event) {
+  event_log_t* log = event_log;
+  if (log == NULL) return;
+
+  // claim the next free position; a slot still holding an event from a
+  // lap ago means the writer has fallen a whole ring behind
+  uint64_t position = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+  event_slot_t* slot;
+  while (1) {
+    slot = &log->slots[position & (EVENT_RING_SIZE - 1)];
+    uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    int64_t lag = (int64_t)(sequence - position);
+    if (lag == 0) {
+      if (__atomic_compare_exchange_n(&log->head, &position, position + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (lag < 0) {
+      __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      position = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  // fill the slot, then hand it to the writer
+  slot->event = *event;
+  __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Logs an event about a player, timed now
+ *
+ * \param type - an event_type
+ * \param room - the id of the room it happened in
+ * \param player - the id of the player, or -1
+ * \param arg0 - the first argument of the event
+ * \param arg1 - the second argument of the event
+ */
+void log_player_event(int type, int room, int player, int32_t arg0, int32_t arg1) {
+  if (event_log == NULL) return;
+  event_t event;
+  memset(&event, 0, sizeof(event_t));
+  event.time = monotonic_ns();
+  event.room = room;
+  event.type = type;
+  event.player = player;
+  event.args[0] = arg0;
+  event.args[1] = arg1;
+  log_event(&event);
+}
+
+/**
+ * Thread function that writes logged events to the log file, in batches,
+ * until the log is closed. It flushes the file whenever it catches up, so
+ * the file is never more than EVENT_LOG_IDLE_MS behind.
+ *
+ * \param input - the event log
+ * \return - NULL
+ */
+void* write_events(void* input) {
+  event_log_t* log = (event_log_t*) input;
+  static event_t batch[1024];
+  struct timespec idle = {0, EVENT_LOG_IDLE_MS * 1000000L};
+  while (1) {
+    // read first, so every event logged before the log was closed is
+    // written before the writer stops
+    int closing = __atomic_load_n(&log->closing, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+    while (count < sizeof(batch) / sizeof(batch[0])) {
+      event_slot_t* slot = &log->slots[log->tail & (EVENT_RING_SIZE - 1)];
+      if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log->tail + 1) break;
+      batch[count++] = slot->event;
+      // free the slot for the game thread that gets this position next lap
+      __atomic_store_n(&slot->sequence, log->tail + EVENT_RING_SIZE, __ATOMIC_RELEASE);
+      log->tail++;
+    }
+
+    if (count > 0 && fwrite(batch, sizeof(event_t), count, log->file) != count) {
+      perror("Unable to write the event log");
+    }
+    __atomic_fetch_add(&log->written, count, __ATOMIC_RELAXED);
+    if (count < sizeof(batch) / sizeof(batch[0])) {
+      fflush(log->file);
+      if (closing) break;
+      nanosleep(&idle, NULL);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Writes out every event logged so far and closes the log file, e.g.
+ * because the server is shutting down. Events logged after it's called
+ * may be lost.
+ */
+void event_log_close() {
+  event_log_t* log = event_log;
+  if (log == NULL) return;
+  __atomic_store_n(&log->closing, 1, __ATOMIC_RELEASE);
+  pthread_join(log->writer, NULL);
+  fclose(log->file);
+}
+
+/**
+ * Starts logging events to a file, replacing anything already in it. The
+ * events are written by a thread of their own.
+ *
+ * \param path - the file to log to
+ * \return - boolean, True if events are being logged
+ */
+int event_log_open(const char* path) {
+  event_log_t* log = calloc(1, sizeof(event_log_t));
+  if (log == NULL || (log->slots = calloc(EVENT_RING_SIZE, sizeof(event_slot_t))) == NULL) {
+    perror("Unable to allocate the event log");
+    exit(2);
+  }
+  for (uint64_t position = 0; position < EVENT_RING_SIZE; position++) {
+    log->slots[position].sequence = position;
+  }
+
+  log->file = fopen(path, "wb");
+  if (log->file == NULL) {
+    perror("Unable to open the event log");
+    free(log->slots);
+    free(log);
+    return 0;
+  }
+  event_log_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+  header.version = EVENT_LOG_VERSION;
+  header.event_size = sizeof(event_t);
+  fwrite(&header, sizeof(header), 1, log->file);
+
+  if (pthread_create(&log->writer, NULL, write_events, log)) {
+    perror("PTHREAD CREATE FAILED:");
+    exit(2);
+  }
+  event_log = log;
+  return 1;
+}
+
+/**
+ * Reads the header of an event log, checking that its events can be read
+ * as event_t
+ *
+ * \param input - the log file, at its start; left at the first event
+ * \return - boolean, True if the events can be read
+ */
+int read_event_log_header(FILE* input) {
+  event_log_header_t header;
+  if (fread(&header, sizeof(header), 1, input) != 1 ||
+      memcmp(header.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC)) != 0) {
+    fprintf(stderr, "Not an event log\n");
+    return 0;
+  }
+  if (header.version != EVENT_LOG_VERSION || header.event_size != sizeof(event_t)) {
+    fprintf(stderr, "Event log version %u isn't supported\n", header.version);
+    return 0;
+  }
+  return 1;
+}
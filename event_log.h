@@ -0,0 +1,95 @@
+#ifndef __EVENT_LOG__
+#define __EVENT_LOG__
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game_structs.h"
+
+// First bytes of every event log file
+#define EVENT_LOG_MAGIC "TJEVLOG"
+#define EVENT_LOG_VERSION 3
+// Events the ring holds before new ones are dropped; a power of two
+#define EVENT_RING_SIZE (1 << 16)
+// How long the writer sleeps when it has caught up with the game threads
+#define EVENT_LOG_IDLE_MS 10
+
+// What happened, and what the fields of the event mean for it. Together
+// the events hold every input of a game, so it can be replayed.
+enum event_type {
+  EVENT_GAME_STARTED = 1,    // every seat is taken; args: players, categories,
+                             // rows, buzz ms, board seed, buzz arbitration,
+                             // categories the board was picked from,
+                             // checksum of the questions
+  EVENT_QUESTION_SELECTED = 2, // player picked a question; args: col, row, value
+  EVENT_BUZZ = 3,            // player buzzed in; time is when it arrived
+  EVENT_ANSWER_GRADED = 4,   // player's answer was graded; args: correctness,
+                             // us from question to buzz (-1 if none); text
+  EVENT_SCORE_CHANGED = 5,   // player won the round; args: new score, points won
+  EVENT_GAME_OVER = 6,       // the last question was answered
+  EVENT_ANSWER_SUBMITTED = 7, // player's answer is in; args: did answer,
+                             // latency compensation ns; text
+  NUM_EVENT_TYPES
+};
+
+/**
+ * A single event of a game, written to the log as is
+ */
+typedef struct event {
+  int64_t time;    // monotonic_ns() when it happened
+  int32_t room;    // id of the room it happened in
+  uint8_t type;    // an event_type
+  int8_t player;   // id of the player it's about, -1 if none
+  uint16_t unused;
+  int32_t args[8]; // meaning depends on the type
+  char text[MAX_ANSWER_LENGTH]; // the answer, for answer events
+} event_t;
+
+/**
+ * Start of an event log file. Events follow it back to back, in the byte
+ * order of the server that wrote them.
+ */
+typedef struct event_log_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t event_size;
+} event_log_header_t;
+
+/**
+ * A slot of the ring. Its sequence number says whose turn it is: a game
+ * thread may fill the slot for position p once it reads p, and the writer
+ * may take it once it reads p + 1.
+ */
+typedef struct event_slot {
+  event_t event;
+  uint64_t sequence;
+} event_slot_t;
+
+/**
+ * Events waiting to be written, in a ring that any number of game threads
+ * add to without locking and a single writer thread drains to a file. Game
+ * threads never wait on the writer: when the ring is full, the event is
+ * dropped and counted instead.
+ */
+typedef struct event_log {
+  event_slot_t* slots;
+  uint64_t head;    // next position to fill, claimed by game threads
+  uint64_t tail;    // next position to write, only moved by the writer
+  uint64_t dropped; // events lost to a full ring
+  uint64_t written;
+  int closing;      // boolean, set to have the writer catch up and stop
+  FILE* file;
+  pthread_t writer;
+} event_log_t;
+
+// The server's event log, NULL if events aren't being logged
+extern event_log_t* event_log;
+
+int event_log_open(const char* path);
+void event_log_close();
+void log_event(const event_t* event);
+void log_player_event(int type, int room, int player, int32_t arg0, int32_t arg1);
+int read_event_log_header(FILE* input);
+const char* event_type_name(int type);
+
+#endif
@@ -0,0 +1,829 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "clock.h"
+#include "deadline.h"
+#include "event_loop.h"
+#include "game.h"
+#include "metrics.h"
+#include "room.h"
+#include "protocol.h"
+#include "deps/socket.h"
+
+#define MAX_EVENTS 64
+
+/**
+ * Which message the server is waiting on from a connection. Every
+ * connection walks through these in order, looping back to CONN_WAITING
+ * at the end of each round.
+ */
+enum conn_state {
+  CONN_HELLO,     // protocol version and username
+  CONN_WAITING,   // nothing; waiting on other players
+  CONN_COORDS,    // question selection from the player whose turn it is
+  CONN_ANSWER     // buzz-time and answer for the current question
+};
+
+// The message expected from a connection in each state, 0 for none
+const int expected_message[] = {
+  [CONN_HELLO] = MSG_HELLO,
+  [CONN_WAITING] = 0,
+  [CONN_COORDS] = MSG_SELECT,
+  [CONN_ANSWER] = MSG_ANSWER
+};
+
+/**
+ * A single client connection driven by the event loop, along with the
+ * buffers for the partially read and not yet written data on its socket
+ */
+typedef struct conn {
+  int fd;
+  int id;           // seat in the room, -1 until the player has joined one
+  room_t* room;
+  enum conn_state state;
+  uint8_t in[MAX_CLIENT_FRAME_SIZE];
+  size_t in_len;
+  int64_t last_read_time; // monotonic_ns() when data last arrived
+  int64_t buzz_time;  // when the player buzzed in this round, -1 if not yet
+  int version;      // protocol version spoken over the connection
+  int pings_left;   // pings of the join burst still to be sent
+  wire_buf_t out;   // frames queued to be sent
+  size_t out_sent;  // bytes of out already written to the socket
+  int want_write;   // boolean, whether EPOLLOUT is registered
+  int hangup;       // boolean, close the connection once out is sent
+  int closed;       // boolean, set once the socket has been closed
+  deadline_t hello_deadline; // for the hello, while in CONN_HELLO
+  struct conn* next_closed;
+} conn_t;
+
+/**
+ * A seat held for a player who lost their connection in the middle of a
+ * game, until they come back or RECONNECT_GRACE_MS passes. The seat keeps
+ * the reference to the room that its connection had.
+ */
+typedef struct held_seat {
+  room_t* room;
+  int seat;
+  deadline_t deadline; // when the game is given up on
+  int64_t buzz_time; // the player's buzz time when they left
+  int version;       // rounds finished in the room when they left
+  struct held_seat* next;
+} held_seat_t;
+
+// Event loop variables
+int epoll_fd;
+int listen_fd;
+// connections closed during the current batch of events, freed after it
+conn_t* closed_conns = NULL;
+// messages sent to a whole room are encoded here once
+wire_buf_t broadcast_buf;
+// seats waiting for their players to come back, in no particular order
+held_seat_t* held_seats = NULL;
+
+/**
+ * Puts a file descriptor into non-blocking mode
+ *
+ * \param fd - the file descriptor to change
+ * \return - 0 on success, -1 on failure
+ */
+int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1) return -1;
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * Changes the set of events epoll reports for a connection
+ *
+ * \param c - the connection to update
+ * \param want_write - boolean, whether to wait for the socket to be writable
+ */
+void update_interest(conn_t* c, int want_write) {
+  if (c->want_write == want_write) return;
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+  ev.data.ptr = c;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) == -1) {
+    perror("Unable to update epoll interest");
+  }
+  c->want_write = want_write;
+}
+
+/**
+ * Unlinks the held seat of a player from the list of held seats
+ *
+ * \param room - the room of the seat
+ * \param seat - the id of the player
+ * \return - the held seat, to be freed by the caller, or NULL if the seat
+ *           isn't held
+ */
+held_seat_t* take_held_seat(room_t* room, int seat) {
+  for (held_seat_t** link = &held_seats; *link != NULL; link = &(*link)->next) {
+    held_seat_t* held = *link;
+    if (held->room == room && held->seat == seat) {
+      *link = held->next;
+      deadline_cancel(&held->deadline);
+      return held;
+    }
+  }
+  return NULL;
+}
+
+void close_conn(conn_t* c);
+void seat_overdue(void* data);
+
+/**
+ * Ends the game in a room for everyone in it, e.g. because one of its
+ * players left for good
+ *
+ * \param room - the room to abandon
+ */
+void abandon_room(room_t* room) {
+  room->aborted = 1;
+  deadline_cancel(&room->phase_deadline);
+  lobby_close(room);
+  // hold a reference so the room outlives closing its other players
+  room->refs++;
+  for (int player = 0; player < room->config.num_players; player++) {
+    if (room->conns[player] != NULL) close_conn(room->conns[player]);
+    held_seat_t* held = take_held_seat(room, player);
+    if (held != NULL) {
+      room_release(room);
+      free(held);
+    }
+  }
+  room_release(room);
+}
+
+/**
+ * Closes a connection and forgets about it. The memory is only released
+ * by free_closed_conns, since later events in the same batch may still
+ * point at the connection. A player leaving in the middle of a game ends
+ * that game for everyone else in the room, unless their client can come
+ * back, in which case their seat is held for them for a while.
+ *
+ * \param c - the connection to close
+ */
+void close_conn(conn_t* c) {
+  if (c->closed) return;
+  deadline_cancel(&c->hello_deadline);
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->closed = 1;
+  metric_add(&metrics.players_connected, -1);
+  c->next_closed = closed_conns;
+  closed_conns = c;
+
+  room_t* room = c->room;
+  if (room == NULL) return;
+  room->conns[c->id] = NULL;
+  if (c->version >= RESUME_PROTOCOL_VERSION && room->board_sent &&
+      !room->sent_final_state && !room->aborted) {
+    held_seat_t* held = malloc(sizeof(held_seat_t));
+    if (held == NULL) {
+      perror("Unable to allocate held seat");
+      exit(2);
+    }
+    held->room = room;
+    held->seat = c->id;
+    memset(&held->deadline, 0, sizeof(deadline_t));
+    deadline_set(&held->deadline, monotonic_ns() + RECONNECT_GRACE_MS * 1000000LL, seat_overdue, held);
+    held->buzz_time = c->buzz_time;
+    held->version = room->delta.version;
+    held->next = held_seats;
+    held_seats = held;
+    fprintf(stderr, "Lost connection to client %d in room %d; holding the seat for %d s\n",
+            c->id, room->id, RECONNECT_GRACE_MS / 1000);
+    return;
+  }
+  if (!room->sent_final_state && !room->aborted) {
+    fprintf(stderr, "Client %d left room %d, aborting its game\n", c->id, room->id);
+    abandon_room(room);
+  }
+  room_release(room);
+}
+
+/**
+ * Gives up on the game of a player who hasn't come back to their held seat
+ * in time
+ *
+ * \param data - the held seat
+ */
+void seat_overdue(void* data) {
+  held_seat_t* held = data;
+  room_t* room = held->room;
+  take_held_seat(room, held->seat);
+  if (!room->aborted && !room->sent_final_state) {
+    fprintf(stderr, "Client %d didn't come back to room %d, aborting its game\n", held->seat, room->id);
+    abandon_room(room);
+  }
+  room_release(room);
+  free(held);
+}
+
+/**
+ * Gives up on the games restored from the state directory whose players
+ * haven't all come back in time
+ *
+ * \param data - unused
+ */
+void restored_overdue(void* data) {
+  (void)data;
+  lobby_give_up_restored(abandon_room);
+}
+
+/**
+ * Hangs up on a client that didn't say hello in time
+ *
+ * \param data - the connection of the client
+ */
+void hello_overdue(void* data) {
+  fprintf(stderr, "Client didn't say hello in time\n");
+  close_conn(data);
+}
+
+/**
+ * Frees every connection closed since the last call
+ */
+void free_closed_conns() {
+  while (closed_conns != NULL) {
+    conn_t* c = closed_conns;
+    closed_conns = c->next_closed;
+    wire_buf_free(&c->out);
+    free(c);
+  }
+}
+
+/**
+ * Drops the first n bytes of a connection's input buffer
+ *
+ * \param c - the connection whose input was handled
+ * \param n - the number of bytes handled
+ */
+void consume_input(conn_t* c, size_t n) {
+  c->in_len -= n;
+  memmove(c->in, c->in + n, c->in_len);
+}
+
+/**
+ * Writes as much of the queued output of a connection as the socket will
+ * take without blocking, asking epoll to report when it can take more
+ *
+ * \param c - the connection to flush
+ * \return - 0 on success, -1 if the connection broke (and was closed)
+ */
+int flush_conn(conn_t* c) {
+  while (c->out_sent < c->out.len) {
+    ssize_t n = write(c->fd, c->out.data + c->out_sent, c->out.len - c->out_sent);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      perror("Writing to client failed");
+      close_conn(c);
+      return -1;
+    }
+    c->out_sent += n;
+    __atomic_fetch_add(&wire_bytes_sent, n, __ATOMIC_RELAXED);
+  }
+
+  if (c->out_sent == c->out.len) {
+    c->out_sent = 0;
+    c->out.len = 0;
+    // once the final game state has been delivered the client is done
+    if (c->hangup || (c->room != NULL && c->room->sent_final_state)) {
+      close_conn(c);
+      return 0;
+    }
+  }
+  update_interest(c, c->out.len != 0);
+  return 0;
+}
+
+/**
+ * Queues data to be sent to a connection
+ *
+ * \param c - the connection to send to
+ * \param data - the bytes to send
+ * \param len - the number of bytes to send
+ */
+void queue_write(conn_t* c, const void* data, size_t len) {
+  wire_buf_reserve(&c->out, len);
+  memcpy(c->out.data + c->out.len, data, len);
+  c->out.len += len;
+}
+
+/**
+ * Queues the same frames to every player in a room and tries to send them
+ *
+ * \param room - the room to send to
+ * \param frames - the encoded frames to send
+ */
+void broadcast(room_t* room, const wire_buf_t* frames) {
+  for (int player = 0; player < room->config.num_players; player++) {
+    if (room->conns[player] != NULL) queue_write(room->conns[player], frames->data, frames->len);
+  }
+  // flushing can close connections (and with them the room), so hold on to it
+  room->refs++;
+  for (int player = 0; player < room->config.num_players; player++) {
+    if (room->conns[player] != NULL) flush_conn(room->conns[player]);
+  }
+  room_release(room);
+}
+
+void select_overdue(void* data);
+
+/**
+ * Sends the latest game state to every player in a room and sets up each
+ * connection to wait for the messages of the new round. The whole game is
+ * sent for the first round, and only the changes since then afterwards.
+ *
+ * \param room - the room to start the next round in
+ */
+void start_round(room_t* room) {
+  // sending can close connections (and with them the room), so hold on to it
+  room->refs++;
+  for (int player = 0; player < room->config.num_players; player++) {
+    conn_t* c = room->conns[player];
+    if (c == NULL) continue;
+    c->state = room->game.id_of_player_turn == c->id ? CONN_COORDS : CONN_ANSWER;
+    c->buzz_time = -1;
+    // measure the player's latency once a round
+    if (c->version >= PING_PROTOCOL_VERSION && !room->game.is_over) {
+      encode_ping(&c->out, monotonic_ns());
+    }
+  }
+  room->answers_received = 0;
+  room->sent_final_state = room->game.is_over;
+  broadcast_buf.len = 0;
+  if (!room->board_sent) {
+    encode_board(&broadcast_buf, &room->game, room->delta.version);
+    room->board_sent = 1;
+  } else {
+    encode_delta(&broadcast_buf, &room->delta, room->game.num_players);
+  }
+  broadcast(room, &broadcast_buf);
+  room->round_start = monotonic_ns();
+  if (!room->game.is_over && !room->aborted) {
+    deadline_set(&room->phase_deadline, room->round_start + SELECT_TIMEOUT_MS * 1000000LL,
+                 select_overdue, room);
+  }
+  room_release(room);
+}
+
+/**
+ * Grades the answers of a room's round once they are all in, sends the
+ * results to everyone and moves on to the next round
+ *
+ * \param room - the room whose round is over
+ */
+void end_round(room_t* room) {
+  deadline_cancel(&room->phase_deadline);
+  int64_t phase_start = record_phase(room, PHASE_BUZZ_WINDOW, room->question_sent);
+  answer_t result;
+  finish_round(room, &result);
+  phase_start = record_phase(room, PHASE_GRADE, phase_start);
+  room->refs++;
+  broadcast_buf.len = 0;
+  encode_result(&broadcast_buf, &result);
+  broadcast(room, &broadcast_buf);
+  record_phase(room, PHASE_BROADCAST, phase_start);
+  record_phase(room, PHASE_ROUND, room->round_start);
+  if (!room->aborted) start_round(room);
+  room_release(room);
+}
+
+/**
+ * Takes everyone in a room who hasn't answered the question yet as not
+ * buzzing in, once they are out of time, and ends the round
+ *
+ * \param data - the room
+ */
+void answers_overdue(void* data) {
+  room_t* room = data;
+  answer_t ans;
+  memset(&ans, 0, sizeof(answer_t));
+  ans.buzz_time = -1;
+  for (int player = 0; player < room->config.num_players; player++) {
+    ans.id = player;
+    if (!submit_answer(room, &ans)) continue;
+    fprintf(stderr, "Client %d in room %d ran out of time to answer\n", player, room->id);
+    metric_add(&metrics.deadlines_missed, 1);
+    if (room->conns[player] != NULL) room->conns[player]->state = CONN_WAITING;
+    room->answers_received++;
+  }
+  end_round(room);
+}
+
+/**
+ * Sends everyone in a room the question picked for the round, and gives
+ * them until the answer deadline to answer it
+ *
+ * \param room - the room the question was picked in
+ * \param col - the column (category) of the question
+ * \param row - the row of the question
+ */
+void ask_question(room_t* room, int col, int row) {
+  conn_t* turn = room->conns[room->game.id_of_player_turn];
+  if (turn != NULL) turn->state = CONN_ANSWER;
+  room->refs++;
+  broadcast_buf.len = 0;
+  encode_coords(&broadcast_buf, MSG_QUESTION, col, row, room->delta.version + 1);
+  broadcast(room, &broadcast_buf);
+  room->question_sent = monotonic_ns();
+  if (!room->aborted) {
+    deadline_set(&room->phase_deadline, room->buzz_deadline + ANSWER_TIMEOUT_MS * 1000000LL,
+                 answers_overdue, room);
+  }
+  room_release(room);
+}
+
+/**
+ * Picks the question of a room's round for the player whose turn it is,
+ * once they are out of time to pick it
+ *
+ * \param data - the room
+ */
+void select_overdue(void* data) {
+  room_t* room = data;
+  int col, row;
+  fprintf(stderr, "Client %d in room %d ran out of time to pick a question\n",
+          room->game.id_of_player_turn, room->id);
+  metric_add(&metrics.deadlines_missed, 1);
+  histogram_record(&room->phase_times[PHASE_SELECT], monotonic_ns() - room->round_start);
+  if (pick_random_square(room, &col, &row) && select_square(room, col, row)) ask_question(room, col, row);
+}
+
+/**
+ * Seats a connection in the room it was given a seat in, adding the player
+ * to the game and welcoming them. The game starts as soon as the last seat
+ * is taken.
+ *
+ * \param c - the connection of the player, with its id set to their seat
+ * \param room - the room the player joins
+ * \param username - the name of the player
+ * \param version - the protocol version spoken over the connection
+ * \return - boolean, False if the connection was closed
+ */
+int join_room(conn_t* c, room_t* room, char* username, int version) {
+  c->room = room;
+  room->conns[c->id] = c;
+  add_player(room, username, c->id, c->fd);
+  printf("Client %d connected to room %d!\n", c->id, room->id);
+  encode_welcome(&c->out, version, c->id, &room->config, room->sessions[c->id].token);
+  c->state = CONN_WAITING;
+  c->version = version;
+  // get a first estimate of the player's latency while the room fills up;
+  // each pong that comes back sends the next ping of the burst
+  if (version >= PING_PROTOCOL_VERSION) {
+    encode_ping(&c->out, monotonic_ns());
+    c->pings_left = PING_BURST - 1;
+  }
+  if (flush_conn(c) == -1) return 0;
+
+  // start the game as soon as enough players have joined
+  if (room->game.num_players == room->config.num_players) start_round(room);
+  return 1;
+}
+
+/**
+ * Gives a player coming back after losing their connection their seat
+ * back, and sends them the state of the game so they can pick it up where
+ * it is
+ *
+ * \param c - the connection the player came back on
+ * \param version - the protocol version spoken over the connection
+ * \param token - the session token the player showed
+ * \return - boolean, False if the connection was closed
+ */
+int resume_conn(conn_t* c, int version, uint64_t token) {
+  int seat, restored;
+  room_t* room = lobby_resume(token, &seat, &restored);
+  if (room != NULL && restored) {
+    // the server restarted, so the player joins their restored game again
+    char username[MAX_ANSWER_LENGTH];
+    strcpy(username, room->game.players[seat].name);
+    c->id = seat;
+    return join_room(c, room, username, version);
+  }
+
+  held_seat_t* held = NULL;
+  if (room != NULL && !room->aborted && !room->sent_final_state) {
+    // the old connection may not have been noticed to be gone yet
+    if (room->conns[seat] != NULL) close_conn(room->conns[seat]);
+    held = take_held_seat(room, seat);
+  }
+  if (room != NULL) room_release(room);
+  if (held == NULL) {
+    encode_error(&c->out, "That game is no longer being played");
+    c->hangup = 1;
+    flush_conn(c);
+    return 0;
+  }
+
+  // the held seat's reference to the room is the connection's now
+  c->room = room;
+  c->id = seat;
+  c->version = version;
+  c->buzz_time = held->version == room->delta.version ? held->buzz_time : -1;
+  free(held);
+  room->conns[seat] = c;
+  room->game.players[seat].socket_fd = c->fd;
+  if (room->buzzing_open) {
+    int answered = room->answers[seat].round == room->delta.version + 1;
+    c->state = answered ? CONN_WAITING : CONN_ANSWER;
+  } else {
+    c->state = room->game.id_of_player_turn == seat ? CONN_COORDS : CONN_ANSWER;
+  }
+  encode_room_state(&c->out, room, seat);
+  printf("Client %d is back in room %d\n", seat, room->id);
+  metric_add(&metrics.sessions_resumed, 1);
+  return flush_conn(c) != -1;
+}
+
+/**
+ * Handles the next complete message buffered for a connection, if there is
+ * one, advancing the connection (and possibly the game) to its next state.
+ *
+ * \param c - the connection to process input for
+ * \return - boolean, True if a message was handled, False if there was not
+ *           yet a full message (or the connection was closed)
+ */
+int process_input(conn_t* c) {
+  frame_t frame;
+  int size = frame_parse(c->in, c->in_len, MAX_CLIENT_FRAME_SIZE, &frame);
+  if (size == -1) {
+    fprintf(stderr, "Client %d sent an oversized message\n", c->id);
+    close_conn(c);
+    return 0;
+  }
+  if (size == 0) return 0;
+
+  // skip messages added by newer versions of the protocol
+  if (frame.type <= 0 || frame.type >= NUM_MESSAGE_TYPES) {
+    consume_input(c, size);
+    return 1;
+  }
+  // answers to pings can arrive at any time once the player has joined
+  if (frame.type == MSG_PONG && c->room != NULL) {
+    int64_t sent, received, replied;
+    if (!decode_pong(&frame, &sent, &received, &replied)) {
+      fprintf(stderr, "Client %d sent a malformed pong\n", c->id);
+      close_conn(c);
+      return 0;
+    }
+    consume_input(c, size);
+    if (latency_add_sample(&c->room->latency[c->id], sent, received, replied, c->last_read_time)) {
+      metric_latency(&c->room->latency[c->id]);
+    }
+    if (c->pings_left > 0) {
+      c->pings_left--;
+      encode_ping(&c->out, monotonic_ns());
+      if (flush_conn(c) == -1) return 0;
+    }
+    return 1;
+  }
+  // picks, buzzes and answers for a round that is over, or for a phase
+  // the server already acted on, come from players who ran out of time
+  if (c->room != NULL && (frame.type == MSG_SELECT || frame.type == MSG_BUZZ || frame.type == MSG_ANSWER)) {
+    int round = decode_round(&frame);
+    enum conn_state state = frame.type == MSG_SELECT ? CONN_COORDS : CONN_ANSWER;
+    if (c->state != state || (round != 0 && round != c->room->delta.version + 1)) {
+      consume_input(c, size);
+      return 1;
+    }
+  }
+  // buzzes are timed as soon as they arrive, before the answer follows
+  if (frame.type == MSG_BUZZ && c->state == CONN_ANSWER) {
+    record_buzz(c->room, c->id, &c->buzz_time, c->last_read_time);
+    consume_input(c, size);
+    return 1;
+  }
+  // clients never send anything unprompted, so a message while none is
+  // expected is as wrong as the wrong message
+  if (frame.type != expected_message[c->state] &&
+      !(c->state == CONN_HELLO && frame.type == MSG_RESUME)) {
+    fprintf(stderr, "Client %d sent an unexpected message\n", c->id);
+    close_conn(c);
+    return 0;
+  }
+
+  switch (c->state) {
+  case CONN_HELLO: {
+    int version;
+    char username[MAX_ANSWER_LENGTH];
+    room_config_t config;
+    uint64_t token = 0;
+    int ok = frame.type == MSG_RESUME ? decode_resume(&frame, &version, &token)
+                                      : decode_hello(&frame, &version, username, &config);
+    if (!ok) {
+      fprintf(stderr, "Client sent a malformed hello\n");
+      close_conn(c);
+      return 0;
+    }
+    consume_input(c, size);
+    deadline_cancel(&c->hello_deadline);
+    if ((version = negotiate_version(version)) == -1) {
+      fprintf(stderr, "Client speaks an unsupported protocol version\n");
+      encode_error(&c->out, "The server doesn't speak this client's protocol version");
+      c->hangup = 1;
+      flush_conn(c);
+      return 0;
+    }
+    if (frame.type == MSG_RESUME) return resume_conn(c, version, token);
+    if (username[0] == '\0') strcpy(username, "Anonymous");
+    // older clients can only play with the default settings
+    if (version < CONFIG_PROTOCOL_VERSION) memset(&config, 0, sizeof(room_config_t));
+    normalize_room_config(&config);
+
+    // add player to the board of the room they are seated in
+    room_t* room = lobby_join(&config, &c->id);
+    return join_room(c, room, username, version);
+  }
+
+  case CONN_COORDS: {
+    int col, row;
+    if (!decode_coords(&frame, &col, &row) || !select_square(c->room, col, row)) {
+      fprintf(stderr, "Client %d selected an invalid question\n", c->id);
+      close_conn(c);
+      return 0;
+    }
+    histogram_record(&c->room->phase_times[PHASE_SELECT], c->last_read_time - c->room->round_start);
+    consume_input(c, size);
+    ask_question(c->room, col, row);
+    return 1;
+  }
+
+  case CONN_ANSWER: {
+    // put the read information in this player's answer slot for the round
+    answer_t ans;
+    if (!decode_answer(&frame, &ans)) {
+      fprintf(stderr, "Client %d sent a malformed answer\n", c->id);
+      close_conn(c);
+      return 0;
+    }
+    consume_input(c, size);
+    ans.buzz_time = c->buzz_time;
+    ans.id = c->id;
+    submit_answer(c->room, &ans);
+    record_phase(c->room, PHASE_READ_ANSWER, c->last_read_time);
+    c->state = CONN_WAITING;
+
+    // once all the answers are in, grade them and move on to the next round
+    if (++c->room->answers_received == c->room->config.num_players) end_round(c->room);
+    return 1;
+  }
+
+  case CONN_WAITING:
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Reads everything available on a connection's socket and handles each
+ * complete message received
+ *
+ * \param c - the connection that is readable
+ */
+void handle_readable(conn_t* c) {
+  while (1) {
+    ssize_t n = read(c->fd, c->in + c->in_len, MAX_CLIENT_FRAME_SIZE - c->in_len);
+    if (n == 0) {
+      fprintf(stderr, "Client %d disconnected\n", c->id);
+      close_conn(c);
+      return;
+    }
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      perror("Reading from client failed");
+      close_conn(c);
+      return;
+    }
+    c->last_read_time = monotonic_ns();
+    c->in_len += n;
+    __atomic_fetch_add(&wire_bytes_received, n, __ATOMIC_RELAXED);
+
+    // handle every complete message in the buffer
+    while (!c->closed && process_input(c)) {}
+    if (c->closed) return;
+
+    // a full buffer that can't be processed means the client broke protocol
+    if (c->in_len == MAX_CLIENT_FRAME_SIZE) {
+      fprintf(stderr, "Client %d sent unexpected data\n", c->id);
+      close_conn(c);
+      return;
+    }
+  }
+}
+
+/**
+ * Accepts every pending connection on the listening socket
+ */
+void handle_accept() {
+  while (1) {
+    int fd = server_socket_accept(listen_fd);
+    if (fd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("accept failed");
+      }
+      return;
+    }
+    if (set_nonblocking(fd) == -1) {
+      perror("Unable to make client socket non-blocking");
+      close(fd);
+      continue;
+    }
+    if (set_nodelay(fd) == -1) {
+      perror("Unable to disable Nagle's algorithm");
+    }
+
+    conn_t* c = calloc(1, sizeof(conn_t));
+    c->fd = fd;
+    c->id = -1;
+    c->state = CONN_HELLO;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      perror("Unable to watch client socket");
+      close(fd);
+      free(c);
+      continue;
+    }
+    metric_add(&metrics.connections, 1);
+    metric_add(&metrics.players_connected, 1);
+    deadline_set(&c->hello_deadline, monotonic_ns() + JOIN_TIMEOUT_MS * 1000000LL, hello_overdue, c);
+  }
+}
+
+/**
+ * Runs the games of every room on a single thread, multiplexing all client
+ * connections with epoll. Each connection is a small state machine fed by
+ * non-blocking reads, so no thread ever blocks on a slow client. Runs
+ * forever.
+ *
+ * \param server_socket_fd - the fd of the (listening) server socket
+ */
+void run_event_loop(int server_socket_fd) {
+  listen_fd = server_socket_fd;
+  if (set_nonblocking(listen_fd) == -1) {
+    perror("Unable to make server socket non-blocking");
+    exit(2);
+  }
+
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd == -1) {
+    perror("epoll_create1 failed");
+    exit(2);
+  }
+
+  // a NULL data pointer marks the listening socket
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+    perror("Unable to watch server socket");
+    exit(2);
+  }
+
+  // games restored from the state directory only wait so long for their
+  // players
+  static deadline_t restore_deadline;
+  deadline_set(&restore_deadline, monotonic_ns() + RECONNECT_GRACE_MS * 1000000LL, restored_overdue, NULL);
+
+  struct epoll_event events[MAX_EVENTS];
+  while (1) {
+    // wake up in time for the next deadline
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, deadline_wait_ms(monotonic_ns()));
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait failed");
+      exit(2);
+    }
+
+    for (int i = 0; i < n; i++) {
+      conn_t* c = events[i].data.ptr;
+      if (c == NULL) {
+        handle_accept();
+        continue;
+      }
+      // a connection may have been closed while handling an earlier event
+      if (!c->closed && (events[i].events & EPOLLOUT)) {
+        flush_conn(c);
+      }
+      if (!c->closed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        handle_readable(c);
+      }
+    }
+    deadline_run(monotonic_ns());
+    free_closed_conns();
+  }
+}
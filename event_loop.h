@@ -0,0 +1,6 @@
+#ifndef __EVENT_LOOP__
+#define __EVENT_LOOP__
+
+void run_event_loop(int server_socket_fd);
+
+#endif
@@ -0,0 +1,863 @@
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "game.h"
+#include "deps/cJSON.h"
+#include "deps/uthash.h"
+#include "clock.h"
+#include "edit_distance.h"
+#include "event_log.h"
+#include "journal.h"
+#include "metrics.h"
+#include "protocol.h"
+
+// Parsing JSON variables
+#define PARSE_CHUNK_SIZE (64 * 1024)   // bytes read from the file at a time
+#define MAX_JSON_OBJECT_SIZE (16 * 1024) // longest single question object
+// The characters that can change the state of the scan for objects
+static const char object_stops[256] = {['"'] = 1, ['{'] = 1, ['}'] = 1};
+static const char string_stops[256] = {['"'] = 1, ['\\'] = 1};
+category_t* category_hashmap = NULL;
+question_pack_t* question_pack = NULL; // used instead of the hashmap if set
+category_t** category_index = NULL;    // the full categories in the hashmap
+int num_indexed_categories = 0;
+uint32_t question_set_checksum = 0;    // 0 until questions_checksum has run
+
+// Scratch memory that cJSON allocates from while the questions are parsed.
+// Each object's tree is deleted as soon as its square is copied out, so the
+// arena is rewound after every object instead of freeing node by node.
+#define JSON_ARENA_SIZE (64 * 1024)
+char* json_arena = NULL;
+size_t json_arena_used = 0;
+
+// Game rules
+int buzz_arbitration = ARBITRATE_ARRIVAL;
+// boolean, print the details of every round
+int verbose = 0;
+
+
+/**
+ * Allocates memory for cJSON from the arena, or from the heap if the
+ * current object has used the arena up
+ *
+ * \param size - the number of bytes wanted
+ */
+void* json_arena_alloc(size_t size) {
+  size = (size + 15) & ~(size_t)15; // keep every allocation aligned
+  if (json_arena_used + size > JSON_ARENA_SIZE) return malloc(size);
+  void* ptr = json_arena + json_arena_used;
+  json_arena_used += size;
+  return ptr;
+}
+
+/**
+ * Frees memory from json_arena_alloc. Memory in the arena is only given
+ * back when the arena is rewound.
+ *
+ * \param ptr - the memory to free
+ */
+void json_arena_free(void* ptr) {
+  char* mem = ptr;
+  if (mem < json_arena || mem >= json_arena + JSON_ARENA_SIZE) free(ptr);
+}
+
+/**
+ * Convert a value amount of $NUMBER string format into an integer
+ *
+ * \param val_str - the string that should be parsed
+ */
+int parseValue(char* val_str) {
+  int val = 0;
+  if (val_str == NULL) return val;
+
+  // skip the dollar sign and any thousands separators, as in "$1,000"
+  for (char* c = val_str; *c != '\0'; c++) {
+    if (isdigit((unsigned char)*c)) val = val*10 + (*c - '0');
+  }
+  return val;
+}
+
+/**
+ * Checks whether a word of normalized text is an article, which players
+ * are free to leave off or add to their answers
+ *
+ * \param word - the start of the word
+ * \param len - the length of the word
+ */
+int is_article(const char* word, size_t len) {
+  return (len == 1 && word[0] == 'a') ||
+         (len == 2 && strncmp(word, "an", 2) == 0) ||
+         (len == 3 && strncmp(word, "the", 3) == 0);
+}
+
+/**
+ * Writes text out in the form answers are compared in: lower case words
+ * separated by single spaces. HTML tags and entities, the backslashes of
+ * escaped quotes, apostrophes and periods are removed outright (so
+ * "McDonald\'s" becomes "mcdonalds" and "U.S." becomes "us") and any other
+ * punctuation separates words.
+ *
+ * \param text - the text to normalize
+ * \param normalized - filled in with the normalized text; can be no longer
+ *                     than text
+ * \param drop_articles - boolean, leave out the words "a", "an" and "the"
+ */
+void normalize_words(const char* text, char* normalized, int drop_articles) {
+  size_t len = 0;
+  size_t word_start = 0;
+  int in_word = 0;
+  for (const char* c = text; ; c++) {
+    unsigned char ch = *c;
+    if (ch == '<') {
+      // skip a whole HTML tag, which ends the word it's in
+      const char* tag_end = strchr(c, '>');
+      c = tag_end != NULL ? tag_end : c + strlen(c) - 1;
+      ch = ' ';
+    } else if (ch == '&') {
+      // skip an HTML entity like &amp; or &#39;
+      size_t entity_len = strspn(c + 1, "#abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+      if (entity_len > 0 && c[1 + entity_len] == ';') c += 1 + entity_len;
+    }
+
+    if (ch == '\\' || ch == '\'' || ch == '.') continue;
+    if (isalnum(ch) || ch >= 0x80) {
+      if (!in_word) {
+        if (len > 0) normalized[len++] = ' ';
+        word_start = len;
+        in_word = 1;
+      }
+      normalized[len++] = tolower(ch);
+      continue;
+    }
+
+    // any other character ends the current word
+    if (in_word && drop_articles &&
+        is_article(normalized + word_start, len - word_start)) {
+      len = word_start > 0 ? word_start - 1 : 0;
+    }
+    in_word = 0;
+    if (ch == '\0') break;
+  }
+  normalized[len] = '\0';
+}
+
+/**
+ * Normalizes a guess or an answer so that differences in case, articles,
+ * punctuation and markup don't count against a guess. An answer that is
+ * nothing but an article keeps it.
+ *
+ * \param text - the guess or answer to normalize
+ * \param normalized - filled in with the normalized text; must have room for
+ *                     at least as many characters as text
+ */
+void normalize_answer(const char* text, char* normalized) {
+  normalize_words(text, normalized, 1);
+  if (normalized[0] == '\0') normalize_words(text, normalized, 0);
+}
+
+/**
+ * Uses the edit distance between a guess and the answer to determine if
+ * the guess is close enough to be considered correct. The distance is only
+ * computed as far as the cutoff, so far-off guesses are rejected early.
+ *
+ * \param guess - the user's guess
+ * \param normalized_answer - the correct answer, already normalized by
+ *                            normalize_answer
+ */
+int check_answer(char* guess, char* normalized_answer) {
+  char normalized_guess[MAX_ANSWER_LENGTH];
+  normalize_answer(guess, normalized_guess);
+
+  int cutoff_factor = 2;
+  size_t answer_len = strlen(normalized_answer);
+  size_t cutoff = answer_len/cutoff_factor;
+  size_t difference = edit_distance_bounded(normalized_guess, strlen(normalized_guess),
+                                            normalized_answer, answer_len, cutoff);
+  return difference <= cutoff;
+}
+
+/**
+ * Given a json string for a single board square (containing the question, 
+ * answer, value, and category) create a new square and add it to the hashmap
+ *
+ * \param json_str - the json string to parse as a square
+ * \return - boolean, True if the square was added, False if the json was
+ *           malformed or missing the question, answer or category
+ */
+int add_square_from_json(char* json_str) {
+    cJSON* json_category;
+    cJSON* json_question;
+    cJSON* json_value;
+    cJSON* json_answer;
+    cJSON* json = cJSON_Parse(json_str);
+    
+    if (json == NULL) {
+      return 0;
+    }
+
+    // Get JSON objects
+    json_question = cJSON_GetObjectItem(json, "question");
+    json_answer = cJSON_GetObjectItem(json, "answer");
+    json_value = cJSON_GetObjectItem(json, "value");
+    json_category = cJSON_GetObjectItem(json, "category");
+    if (!cJSON_IsString(json_question) || !cJSON_IsString(json_answer) ||
+        !cJSON_IsString(json_category)) {
+      cJSON_Delete(json);
+      return 0;
+    }
+
+    // Copy the string versions of the JSON objects into a new struct
+    square_t new_square;
+    strncpy(new_square.question, cJSON_GetStringValue(json_question), MAX_QUESTION_LENGTH-1);
+    new_square.question[MAX_QUESTION_LENGTH-1] = '\0';
+    strncpy(new_square.answer, cJSON_GetStringValue(json_answer), MAX_ANSWER_LENGTH-1);
+    new_square.answer[MAX_ANSWER_LENGTH-1] = '\0';
+    normalize_answer(new_square.answer, new_square.normalized_answer);
+    new_square.value = parseValue(cJSON_GetStringValue(json_value));
+    new_square.is_answered = 0;
+
+    char category[MAX_ANSWER_LENGTH];
+    strncpy(category, cJSON_GetStringValue(json_category), MAX_ANSWER_LENGTH-1);
+    category[MAX_ANSWER_LENGTH-1] = '\0';
+
+    /* 
+       Try to find the category of the question in the hashmap. If it's there,
+       add the square to the existing category. If the category isn't not there,
+       create a new hashmap entry and add it
+    */
+    category_t* query;
+    HASH_FIND_STR(category_hashmap, category, query);
+    if (query == NULL) {
+      query = malloc(sizeof(category_t));
+      strncpy(query->title, category, MAX_ANSWER_LENGTH-1);
+      query->title[MAX_ANSWER_LENGTH-1] = '\0';
+      query->questions[0] = new_square;
+      query->num_questions = 1;
+      HASH_ADD_STR(category_hashmap, title, query);
+    } else if (query->num_questions < NUM_QUESTIONS_PER_CATEGORY) {
+      query->questions[query->num_questions] = new_square;
+      query->num_questions++;
+    }
+    
+    cJSON_Delete(json);
+    return 1;
+}
+
+/**
+ * Read in a JSON file object by object and pass each object to the parser.
+ * The file is read a chunk at a time and scanned for top level objects, so
+ * memory use doesn't grow with the size of the file. Anything between the
+ * objects (like the brackets and commas of a JSON array) is skipped.
+ * 
+ * \param input - the JSON file to read from
+ * \return - 0 on success, 1 if the file could not be read
+ */
+int parse_json(FILE* input) {
+  char* chunk = malloc(PARSE_CHUNK_SIZE);
+  char* object = malloc(MAX_JSON_OBJECT_SIZE);
+  size_t object_len = 0;
+  int depth = 0;     // how many objects deep the scan is
+  int in_string = 0; // boolean, inside a string, where braces don't count
+  int escaped = 0;   // boolean, the last character was a backslash in a string
+  int too_long = 0;  // boolean, the current object didn't fit in the buffer
+  int num_loaded = 0;
+  int num_skipped = 0;
+
+  json_arena = malloc(JSON_ARENA_SIZE);
+  cJSON_Hooks hooks = {json_arena_alloc, json_arena_free};
+  cJSON_InitHooks(&hooks);
+
+  size_t num_read;
+  while ((num_read = fread(chunk, 1, PARSE_CHUNK_SIZE, input)) > 0) {
+    size_t i = 0;
+    while (i < num_read) {
+      if (depth == 0) {
+        // skip ahead to the start of the next object
+        char* start = memchr(chunk + i, '{', num_read - i);
+        if (start == NULL) break;
+        i = start - chunk;
+        object_len = 0;
+        too_long = 0;
+      }
+
+      // find the next character that changes the state of the scan; an
+      // escaped character in a string never does
+      size_t end = i;
+      if (escaped) {
+        end++;
+        escaped = 0;
+      }
+      const char* stops = in_string ? string_stops : object_stops;
+      while (end < num_read && !stops[(unsigned char)chunk[end]]) end++;
+      if (end < num_read) {
+        char c = chunk[end++];
+        if (in_string) {
+          if (c == '\\') escaped = 1;
+          else in_string = 0;
+        } else if (c == '"') {
+          in_string = 1;
+        } else if (c == '{') {
+          depth++;
+        } else {
+          depth--;
+        }
+      }
+
+      if (object_len + (end - i) < MAX_JSON_OBJECT_SIZE) {
+        memcpy(object + object_len, chunk + i, end - i);
+        object_len += end - i;
+      } else {
+        too_long = 1;
+      }
+      i = end;
+
+      // hand over each object as soon as it's closed
+      if (depth == 0) {
+        object[object_len] = '\0';
+        if (!too_long && add_square_from_json(object)) {
+          num_loaded++;
+        } else {
+          num_skipped++;
+        }
+        json_arena_used = 0;
+      }
+    }
+  }
+  int failed = ferror(input);
+
+  cJSON_InitHooks(NULL);
+  free(json_arena);
+  json_arena = NULL;
+  free(chunk);
+  free(object);
+  if (failed) return 1;
+  printf("Loaded %d questions into %u categories", num_loaded, HASH_COUNT(category_hashmap));
+  if (num_skipped > 0) printf(" (skipped %d malformed questions)", num_skipped);
+  printf("\n");
+  return 0;
+}
+
+/**
+ * Adds a new player to the game with the given name and id if there is room
+ *
+ * \param room - the room whose game the player is joining
+ * \param name - the name of the player
+ * \param id - the (unique) id of the player
+ * \param socket_fd - the socket that can be used to send network data to them
+ * \return - boolean, True if player was succesfully added, else False
+ */
+int add_player(room_t* room, char* name, int id, int socket_fd) {
+  game_t* game = &room->game;
+  pthread_mutex_lock(&room->add_player_lock);
+  // only add player if the room has a seat left
+  if (game->num_players == room->config.num_players) {
+    pthread_mutex_unlock(&room->add_player_lock);
+    return 0;
+  }
+
+  // fill in necessary player data
+  player_t new_player;
+  strncpy(new_player.name, name, MAX_ANSWER_LENGTH);
+  new_player.name[MAX_ANSWER_LENGTH-1] = '\0';
+  // players of a restored game keep their score; everyone else starts at 0
+  new_player.score = game->players[id].score;
+  new_player.id = id;
+  new_player.socket_fd = socket_fd;
+  // players are stored by id so they can be looked up directly
+  game->players[id] = new_player;
+  game->num_players++;
+  // players of a restored game keep their token too
+  if (room->sessions[id].token == 0) room->sessions[id].token = new_session_token();
+  uint64_t token = room->sessions[id].token;
+  pthread_mutex_unlock(&room->add_player_lock);
+
+  if (journal_fd != -1) {
+    journal_record_t record;
+    memset(&record, 0, sizeof(journal_record_t));
+    record.type = JOURNAL_PLAYER_JOINED;
+    record.room = room->id;
+    record.player = id;
+    memcpy(record.name, new_player.name, MAX_ANSWER_LENGTH);
+    record.token = token;
+    journal_append(&record);
+  }
+  return 1;
+}
+
+/**
+ * Get rid of all non-completely filled categories (gets rid of final
+ * jeopardy too as a consequence), then index the rest in an array so that
+ * any of them can be picked in constant time. Must be called once all the
+ * questions have been parsed and before any game is created.
+ */
+void filter_categories() {
+  category_t* c;
+  category_t* temp;
+
+  HASH_ITER(hh, category_hashmap, c, temp) {
+    if (c->num_questions != NUM_QUESTIONS_PER_CATEGORY) {
+      HASH_DEL(category_hashmap, c);
+      free(c);
+    }
+  }
+
+  free(category_index);
+  num_indexed_categories = HASH_COUNT(category_hashmap);
+  category_index = malloc(sizeof(category_t*) * (num_indexed_categories + 1));
+  if (category_index == NULL) {
+    perror("malloc failed");
+    exit(2);
+  }
+  int index = 0;
+  for (c = category_hashmap; c != NULL; c = c->hh.next) {
+    category_index[index++] = c;
+  }
+}
+
+/**
+ * Counts the full categories games can be made from, in the question pack
+ * if there is one or else in the category index
+ *
+ * \return - the number of categories
+ */
+int count_categories() {
+  if (question_pack != NULL) return question_pack->header->num_categories;
+  return num_indexed_categories;
+}
+
+/**
+ * Adds bytes to an FNV-1a checksum
+ *
+ * \param checksum - the checksum so far
+ * \param data - the bytes to add
+ * \param len - the number of bytes
+ * \return - the new checksum
+ */
+uint32_t checksum_bytes(uint32_t checksum, const void* data, size_t len) {
+  const unsigned char* bytes = data;
+  for (size_t i = 0; i < len; i++) {
+    checksum ^= bytes[i];
+    checksum *= 16777619u;
+  }
+  return checksum;
+}
+
+/**
+ * Gives a checksum of the categories games are made from, in the order
+ * create_game picks them by, so a board saved as a seed can be checked to
+ * come out the same when made again. Worked out the first time it's asked
+ * for.
+ *
+ * \return - the checksum of the loaded questions; never 0
+ */
+uint32_t questions_checksum() {
+  if (question_set_checksum != 0) return question_set_checksum;
+  int num_categories = count_categories();
+  uint32_t checksum = checksum_bytes(2166136261u, &num_categories, sizeof(num_categories));
+  category_t category;
+  for (int index = 0; index < num_categories; index++) {
+    read_category(index, &category);
+    checksum = checksum_bytes(checksum, category.title, strlen(category.title) + 1);
+    for (int row = 0; row < NUM_QUESTIONS_PER_CATEGORY; row++) {
+      square_t* square = &category.questions[row];
+      checksum = checksum_bytes(checksum, &square->value, sizeof(square->value));
+      checksum = checksum_bytes(checksum, square->question, strlen(square->question) + 1);
+      checksum = checksum_bytes(checksum, square->answer, strlen(square->answer) + 1);
+    }
+  }
+  question_set_checksum = checksum != 0 ? checksum : 1;
+  return question_set_checksum;
+}
+
+/**
+ * Loads the questions games are made from. A question pack is mapped into
+ * memory; any other file is parsed as JSON and its full categories indexed.
+ *
+ * \param path - the question pack or JSON file to load
+ * \return - boolean, True if the questions were loaded, else False
+ */
+int load_questions(const char* path) {
+  static question_pack_t pack;
+  question_set_checksum = 0;
+  int is_pack = open_question_pack(path, &pack);
+  if (is_pack == -1) return 0;
+  if (is_pack) {
+    question_pack = &pack;
+    return 1;
+  }
+
+  FILE* read = fopen(path, "r");
+  if (read == NULL) {
+    perror("Could not open the questions file");
+    return 0;
+  }
+  if (parse_json(read)) {
+    perror("Could not read the questions file");
+    fclose(read);
+    return 0;
+  }
+  fclose(read);
+  filter_categories();
+  return 1;
+}
+
+/**
+ * Copies out one of the full categories games are made from
+ *
+ * \param index - which category to copy; must be less than count_categories()
+ * \param category - filled in with the category
+ */
+void read_category(int index, category_t* category) {
+  if (question_pack != NULL) {
+    read_pack_category(question_pack, index, category);
+  } else {
+    *category = *category_index[index];
+  }
+}
+
+/**
+ * Creates an empty game, including filling out the Jeopardy board. The
+ * board and the players are allocated to the size asked for in config, and
+ * must be freed with free_game.
+ *
+ * \param config - the normalized settings of the room the game is for; there
+ *                 must be at least as many categories to pick from as the
+ *                 board has
+ * \param seed - seeds the random picks of categories; the same seed and
+ *               questions always make the same board
+ * \return game - a filled out game_t struct containing categories parsed 
+ *                randomly to make the game different *every time 
+ */
+game_t create_game(const room_config_t* config, unsigned int seed) {
+  game_t game;
+  game.num_players = 0;
+  game.is_over = 0;
+  game.id_of_player_turn = 0;
+  game.num_categories = config->num_categories;
+  game.num_rows = config->num_rows;
+  game.categories = calloc(game.num_categories, sizeof(category_t));
+  game.players = calloc(config->num_players, sizeof(player_t));
+  if (game.categories == NULL || game.players == NULL) {
+    perror("Unable to allocate game");
+    exit(2);
+  }
+
+  // Pick distinct categories uniformly at random; the board is small next
+  // to the number of categories, so a repeat is rare and just drawn again
+  int num_categories = count_categories();
+  int picked[MAX_CATEGORIES];
+  for (int i=0; i<game.num_categories; i++) {
+    int is_repeat;
+    do {
+      picked[i] = rand_r(&seed) % num_categories;
+      is_repeat = 0;
+      for (int j=0; j<i; j++) {
+        if (picked[j] == picked[i]) is_repeat = 1;
+      }
+    } while (is_repeat);
+
+    read_category(picked[i], &game.categories[i]);
+    // only the first rows of each category make it onto a smaller board
+    game.categories[i].num_questions = game.num_rows;
+  }
+  
+  return game;
+}
+
+/**
+ * Frees the board and players of a game made by create_game
+ *
+ * \param game - the game to free
+ */
+void free_game(game_t* game) {
+  free(game->categories);
+  free(game->players);
+  game->categories = NULL;
+  game->players = NULL;
+}
+
+/**
+ * Marks the question at the given board coordinates as answered and makes
+ * it the question for the current round
+ *
+ * \param room - the room whose board the question is on
+ * \param col - the column (category) of the question
+ * \param row - the row of the question
+ * \return - boolean, True if the coords named a question that is still on
+ *           the board, else False
+ */
+int select_square(room_t* room, int col, int row) {
+  if (col < 0 || col >= room->game.num_categories || row < 0 || row >= room->game.num_rows ||
+      room->game.categories[col].questions[row].is_answered) {
+    return 0;
+  }
+
+  // get the answer and question value
+  square_t* square = &room->game.categories[col].questions[row];
+  room->current_round.col = col;
+  room->current_round.row = row;
+  room->current_round.value = square->value;
+  room->current_round.answer = square->answer;
+  room->current_round.normalized_answer = square->normalized_answer;
+  event_t event;
+  memset(&event, 0, sizeof(event_t));
+  event.time = monotonic_ns();
+  event.room = room->id;
+  event.type = EVENT_QUESTION_SELECTED;
+  event.player = room->game.id_of_player_turn;
+  event.args[0] = col;
+  event.args[1] = row;
+  event.args[2] = square->value;
+  log_event(&event);
+
+  // mark the question as done so it cannot be done again
+  square->is_answered = 1;
+  square->value = -1;
+
+  // decrement count of remaining questions
+  room->remaining_questions--;
+
+  // players can buzz in from now on; the question is sent right after this
+  int64_t buzz_window_ms = QUESTION_READ_MS + room->config.buzz_timeout_ms + BUZZ_GRACE_MS;
+  room->buzz_deadline = monotonic_ns() + buzz_window_ms * 1000000;
+  __atomic_store_n(&room->buzzing_open, 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/**
+ * Picks one of the questions still on the board at random, for a player
+ * who ran out of time to pick one
+ *
+ * \param room - the room whose board to pick from
+ * \param col - set to the column (category) of the question
+ * \param row - set to the row of the question
+ * \return - boolean, False if there are no questions left
+ */
+int pick_random_square(room_t* room, int* col, int* row) {
+  if (room->remaining_questions <= 0) return 0;
+  unsigned int seed = monotonic_ns();
+  int pick = rand_r(&seed) % room->remaining_questions;
+  for (int c = 0; c < room->game.num_categories; c++) {
+    for (int r = 0; r < room->game.num_rows; r++) {
+      if (room->game.categories[c].questions[r].is_answered || pick-- > 0) continue;
+      *col = c;
+      *row = r;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Records when a player buzzed in. Only a player's first buzz of the round
+ * counts, and buzzes from before the question was picked or after buzzing
+ * closed are ignored.
+ *
+ * \param room - the room the player buzzed in
+ * \param player - the id of the player who buzzed
+ * \param buzz_time - the player's buzz time for the round, -1 if none yet
+ * \param received - monotonic_ns() when the buzz reached the server
+ */
+void record_buzz(room_t* room, int player, int64_t* buzz_time, int64_t received) {
+  if (*buzz_time == -1 && __atomic_load_n(&room->buzzing_open, __ATOMIC_ACQUIRE) &&
+      received <= room->buzz_deadline) {
+    *buzz_time = received;
+    if (event_log != NULL) {
+      event_t event;
+      memset(&event, 0, sizeof(event_t));
+      event.time = received;
+      event.room = room->id;
+      event.type = EVENT_BUZZ;
+      event.player = player;
+      log_event(&event);
+    }
+  }
+}
+
+/**
+ * Copies the answer ans into its player's slot to be checked later. Only
+ * the player's own thread writes to the slot, so no lock is needed; the
+ * answer is published by storing the round number last. The player's
+ * latency compensation is fixed here too, so later pings can't change how
+ * the answer is ranked.
+ *
+ * \param room - the room the answer was submitted in
+ * \param ans - the answer struct submitted by a user, with its id set
+ * \return - boolean, True if the answer was added, False if the player
+ *           already answered this round
+ */
+int submit_answer(room_t* room, const answer_t* ans) {
+  answer_slot_t* slot = &room->answers[ans->id];
+  int round = room->delta.version + 1;
+  if (__atomic_load_n(&slot->round, __ATOMIC_RELAXED) == round) return 0;
+
+  slot->answer = *ans;
+  slot->latency_compensation = buzz_arbitration == ARBITRATE_LATENCY ?
+    latency_compensation(&room->latency[ans->id]) : 0;
+  if (buzz_arbitration == ARBITRATE_LATENCY) {
+    histogram_record(&buzz_compensation, slot->latency_compensation);
+  }
+  if (event_log != NULL) {
+    event_t event;
+    memset(&event, 0, sizeof(event_t));
+    event.time = monotonic_ns();
+    event.room = room->id;
+    event.type = EVENT_ANSWER_SUBMITTED;
+    event.player = ans->id;
+    event.args[0] = ans->did_answer;
+    event.args[1] = slot->latency_compensation;
+    memcpy(event.text, ans->answer, MAX_ANSWER_LENGTH);
+    log_event(&event);
+  }
+  __atomic_store_n(&slot->round, round, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/**
+ * Returns the user id of the client who correctly answered the question the quickest.
+ * Returns -1 if no user answered correctly (or at all) in time. With
+ * ARBITRATE_LATENCY, each buzz is moved back by the round trip time to its
+ * player, so players on slow connections aren't behind.
+ * 
+ * \param room - the room whose submitted answers should be checked
+ * \param normalized_answer - the correct answer to check all users' answers
+ *                            against, as normalized by normalize_answer
+ * \return correct_answer_id - the id number of the client who answered
+ *                             the question correctly the earliest, or
+ *                             if no one answered correctly/at-all, -1
+ */
+int get_quickest_answer(room_t* room, char* normalized_answer) {
+  int correct_answer_id = -1;
+  int64_t best_time = -1;
+  
+  // get client id of fastest correct answer; buzzes are timed by the server,
+  // and the lower id wins the (unlikely) tie of two buzzes in the same
+  // nanosecond so the outcome never depends on the order of the answers
+  int round = room->delta.version + 1;
+  for (int player = 0; player < room->config.num_players; player++) {
+    answer_slot_t* slot = &room->answers[player];
+    if (__atomic_load_n(&slot->round, __ATOMIC_ACQUIRE) != round) continue;
+    answer_t* ans = &slot->answer;
+    // players who didn't buzz in have nothing to grade
+    if (!ans->did_answer) continue;
+    int is_correct = check_answer(ans->answer, normalized_answer);
+    metric_add(&metrics.answers_graded, 1);
+    if (is_correct) metric_add(&metrics.answers_correct, 1);
+    if (verbose) {
+      printf("checking answer \"%s\". Did answer:%d correctness:%d\n", ans->answer, ans->did_answer, is_correct);
+    }
+    if (event_log != NULL) {
+      event_t event;
+      memset(&event, 0, sizeof(event_t));
+      event.time = monotonic_ns();
+      event.room = room->id;
+      event.type = EVENT_ANSWER_GRADED;
+      event.player = ans->id;
+      event.args[0] = is_correct;
+      event.args[1] = ans->buzz_time == -1 ? -1 : (ans->buzz_time - room->question_sent) / 1000;
+      memcpy(event.text, ans->answer, MAX_ANSWER_LENGTH);
+      log_event(&event);
+    }
+    if (ans->buzz_time != -1 && is_correct) {
+      int64_t buzz_time = ans->buzz_time - slot->latency_compensation;
+      if (correct_answer_id == -1 || buzz_time < best_time ||
+          (buzz_time == best_time && ans->id < correct_answer_id)) {
+        correct_answer_id = ans->id;
+        best_time = buzz_time;
+      }
+    }
+  }
+
+  if (verbose) printf("Correct answer id: %d\n", correct_answer_id);
+  return correct_answer_id;
+}
+
+/**
+ * Prints the latest estimates of the network delay to each player in a room
+ *
+ * \param room - the room whose players to report on
+ */
+void print_latencies(room_t* room) {
+  for (int player = 0; player < room->config.num_players; player++) {
+    latency_t* latency = &room->latency[player];
+    if (latency->rtt < 0) continue;
+    printf("Room %d player %d: rtt %.3f ms, clock offset %.3f ms, jitter %.3f ms (%lu pongs)\n",
+           room->id, player, latency->rtt / 1e6, latency->offset / 1e6,
+           latency->jitter / 1e6, latency->pongs);
+  }
+}
+
+/**
+ * Grades all the answers submitted for the current round, awards the points
+ * and passes the turn to whoever answered correctly first. Must only be
+ * called once every player's answer is in.
+ *
+ * \param room - the room whose round is over
+ * \param result - filled in with the results of the round to send to clients
+ * \return correct_answer_id - the id of the client who won the round, or -1
+ */
+int finish_round(room_t* room, answer_t* result) {
+  game_t* game = &room->game;
+  round_t* round = &room->current_round;
+  if (room->remaining_questions == 0) game->is_over = 1;
+  __atomic_store_n(&room->buzzing_open, 0, __ATOMIC_RELEASE);
+
+  // check the answers' correctness in order
+  if (verbose) print_latencies(room);
+  int correct_answer_id = get_quickest_answer(room, round->normalized_answer);
+  if (correct_answer_id != -1) {
+    game->players[correct_answer_id].score += round->value;
+    game->id_of_player_turn = correct_answer_id;
+    log_player_event(EVENT_SCORE_CHANGED, room->id, correct_answer_id,
+                     game->players[correct_answer_id].score, round->value);
+  }
+
+  // record what changed this round so clients can update their boards
+  game_delta_t* delta = &room->delta;
+  delta->version++;
+  delta->col = round->col;
+  delta->row = round->row;
+  for (int player = 0; player < room->config.num_players; player++) {
+    delta->scores[player] = game->players[player].score;
+  }
+  delta->id_of_player_turn = game->id_of_player_turn;
+  delta->is_over = game->is_over;
+  metric_add(&metrics.rounds_completed, 1);
+  journal_round(room->id, delta->version, round->col, round->row, game);
+  if (game->is_over) log_player_event(EVENT_GAME_OVER, room->id, -1, 0, 0);
+
+  // build answer struct containing results of the answering round
+  memset(result, 0, sizeof(answer_t));
+  result->id = game->id_of_player_turn;
+  memcpy(result->answer, round->answer, MAX_ANSWER_LENGTH); //write in correct answer
+  result->did_answer = correct_answer_id != -1;
+  return correct_answer_id;
+}
+
+/**
+ * Free all the heap memory in the hashmap allocated at the beginning
+ * of the game to store the parsed JSON data.
+ */
+void clean_up_game() {
+  if (question_pack != NULL) {
+    close_question_pack(question_pack);
+    question_pack = NULL;
+  }
+
+  free(category_index);
+  category_index = NULL;
+  num_indexed_categories = 0;
+
+  // Free category hashmap
+  category_t* c = category_hashmap;
+  while (c != NULL) {
+    category_t* temp = c;
+    c = c->hh.next;
+    free(temp);
+  }
+  category_hashmap = NULL;
+}
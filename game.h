@@ -0,0 +1,44 @@
+#ifndef __GAME__
+#define __GAME__
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game_structs.h"
+#include "room.h"
+#include "question_pack.h"
+
+// How the fastest buzz of a round is picked
+enum buzz_arbitration {
+  ARBITRATE_ARRIVAL = 0,  // whichever buzz reached the server first
+  ARBITRATE_LATENCY = 1   // the first once each player's delay is taken off
+};
+
+// Parsed questions, grouped by category
+extern category_t* category_hashmap;
+extern question_pack_t* question_pack;
+extern int buzz_arbitration;
+extern int verbose;
+
+int parse_json(FILE* input);
+int add_square_from_json(char* json_str);
+void filter_categories();
+int count_categories();
+uint32_t questions_checksum();
+int load_questions(const char* path);
+void read_category(int index, category_t* category);
+game_t create_game(const room_config_t* config, unsigned int seed);
+void free_game(game_t* game);
+void clean_up_game();
+
+void normalize_answer(const char* text, char* normalized);
+int check_answer(char* guess, char* normalized_answer);
+int add_player(room_t* room, char* name, int id, int socket_fd);
+int select_square(room_t* room, int col, int row);
+int pick_random_square(room_t* room, int* col, int* row);
+void record_buzz(room_t* room, int player, int64_t* buzz_time, int64_t received);
+int submit_answer(room_t* room, const answer_t* ans);
+int get_quickest_answer(room_t* room, char* normalized_answer);
+void print_latencies(room_t* room);
+int finish_round(room_t* room, answer_t* result);
+
+#endif
@@ -1,18 +1,40 @@
 #ifndef __GAME_STRUCTS__
 #define __GAME_STRUCTS__
 #include <stdio.h>
+#include <stdint.h>
 #include <time.h>
 #include "deps/uthash.h"
 
+// Questions kept for each category; boards have at most this many rows
 #define NUM_QUESTIONS_PER_CATEGORY 5
-#define NUM_CATEGORIES 5
-#define MAX_NUM_PLAYERS 4 
+// Largest room and board a client can ask for
+#define MAX_NUM_PLAYERS 12
+#define MAX_CATEGORIES 6
+// Room settings used for anything a client doesn't ask for
+#define DEFAULT_NUM_PLAYERS 4
+#define DEFAULT_NUM_CATEGORIES 5
+#define DEFAULT_NUM_ROWS 5
+#define DEFAULT_BUZZ_TIMEOUT_MS 4000
+#define MIN_BUZZ_TIMEOUT_MS 1000
+#define MAX_BUZZ_TIMEOUT_MS 30000
 #define MAX_QUESTION_LENGTH 300
 #define MAX_ANSWER_LENGTH 40
 
 // Definitions for the run status of the game
 enum game_status{GAME_OVER = 0, GAME_ONGOING = 1};
 
+/**
+ * The settings of a room, asked for by clients when they join. Players are
+ * only ever seated with others who asked for the same settings. A setting
+ * of 0 stands for the default.
+ */
+typedef struct room_config {
+  int num_players;     // players in the room; the game starts once all join
+  int num_categories;  // columns of the board
+  int num_rows;        // questions in each category
+  int buzz_timeout_ms; // how long players have to buzz in on a question
+} room_config_t;
+
 /**
  * All data necessary for communicating with a machine over a network
  * with the C POSIX TCP API
@@ -22,6 +44,9 @@ typedef struct input{
   FILE* to;
   int socket_fd;
   int id;
+  struct room* room; // the room the client plays in (server only)
+  struct frame_stream* stream; // frames received over socket_fd
+  int version; // protocol version spoken over socket_fd
 }input_t;
 
 /**
@@ -33,6 +58,7 @@ typedef struct square{
   int is_answered;
   char question[MAX_QUESTION_LENGTH];
   char answer[MAX_ANSWER_LENGTH];
+  char normalized_answer[MAX_ANSWER_LENGTH]; // answer as compared to guesses
 } square_t;
 
 /**
@@ -56,28 +82,43 @@ typedef struct player{
 } player_t;
 
 /**
- * Contains all the info on players and questions and the status of the game
+ * Contains all the info on players and questions and the status of the game.
+ * The board and the players are allocated to the size of the room.
  */
 typedef struct game{
   int is_over;
-  category_t categories[NUM_CATEGORIES];
-  player_t players[MAX_NUM_PLAYERS];
+  category_t* categories; // num_categories of them, num_rows questions each
+  int num_categories;
+  int num_rows;
+  player_t* players;      // one for each seat of the room, indexed by id
   int num_players;
   int id_of_player_turn;
 } game_t;
 
+/**
+ * Everything about the game that changes over a single round. After the
+ * full game_t has been sent at the start of the game, the server only sends
+ * one of these per round.
+ */
+typedef struct game_delta {
+  int version;    // number of rounds played; one more than the last delta
+  int col;        // column of the question answered this round
+  int row;        // row of the question answered this round
+  int scores[MAX_NUM_PLAYERS];
+  int id_of_player_turn;
+  int is_over;
+} game_delta_t;
+
 /**
  * Contains information on buzz in time and an answer to a question (if they
- * did buzz in and they did answer). Also has linked list capability for server
- * to keep track of all the answers from clients in the question answering 
- * period.
+ * did buzz in and they did answer). The server keeps one per player in each
+ * room for the answers of the current round.
  */
 typedef struct answer {
-  time_t time;
+  int64_t buzz_time; // when the server got the buzz (monotonic_ns), -1 if none
   char answer[MAX_ANSWER_LENGTH];
   int did_answer; // boolean
   int id;
-  struct answer* next;
 } answer_t;
 
 /**
@@ -0,0 +1,90 @@
+#include "histogram.h"
+
+/**
+ * Finds the bucket a value is counted in. Values below
+ * 2^HISTOGRAM_SUB_BUCKET_BITS get a bucket each; after that, each power of
+ * two gets HISTOGRAM_HALF_SUB_BUCKETS buckets.
+ *
+ * \param value - the value, at least 0
+ * \return - the index of its bucket
+ */
+static int bucket_index(uint64_t value) {
+  if (value >> HISTOGRAM_MAX_BITS) value = ((uint64_t)1 << HISTOGRAM_MAX_BITS) - 1;
+  int msb = 63 - __builtin_clzll(value | 1);
+  int shift = msb - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+  if (shift < 0) shift = 0;
+  return shift * HISTOGRAM_HALF_SUB_BUCKETS + (int)(value >> shift);
+}
+
+/**
+ * Finds the largest value counted in a bucket, the inverse of bucket_index
+ *
+ * \param index - the index of the bucket
+ * \return - the largest value that falls in it
+ */
+static int64_t bucket_top(int index) {
+  int shift = index / HISTOGRAM_HALF_SUB_BUCKETS - 1;
+  if (shift < 0) shift = 0;
+  int64_t bottom = (int64_t)(index - shift * HISTOGRAM_HALF_SUB_BUCKETS) << shift;
+  return bottom + ((int64_t)1 << shift) - 1;
+}
+
+/**
+ * Counts a value. Safe to call from several threads on the same histogram.
+ *
+ * \param histogram - the histogram to count the value in
+ * \param value - the value; negative values are counted as 0
+ */
+void histogram_record(histogram_t* histogram, int64_t value) {
+  if (value < 0) value = 0;
+  __atomic_fetch_add(&histogram->counts[bucket_index(value)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->total, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+  int64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+  while (value > max &&
+         !__atomic_compare_exchange_n(&histogram->max, &max, value, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Adds the counts of one histogram to another
+ *
+ * \param into - the histogram to add to
+ * \param from - the histogram whose counts are added
+ */
+void histogram_merge(histogram_t* into, const histogram_t* from) {
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    into->counts[i] += __atomic_load_n(&from->counts[i], __ATOMIC_RELAXED);
+  }
+  into->total += __atomic_load_n(&from->total, __ATOMIC_RELAXED);
+  into->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+  int64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+  if (max > into->max) into->max = max;
+}
+
+/**
+ * Finds the value that a given percent of the recorded values are at or
+ * below. The answer is the top of the bucket the value is in, so it's
+ * never below the true value by more than the bucket width.
+ *
+ * \param histogram - the histogram to look in
+ * \param percent - the percentile to find, from 0 to 100
+ * \return - the value, or 0 if nothing was recorded
+ */
+int64_t histogram_percentile(const histogram_t* histogram, double percent) {
+  uint64_t total = __atomic_load_n(&histogram->total, __ATOMIC_RELAXED);
+  if (total == 0) return 0;
+  uint64_t rank = (uint64_t)(percent / 100 * total + 0.5);
+  if (rank < 1) rank = 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += __atomic_load_n(&histogram->counts[i], __ATOMIC_RELAXED);
+    if (seen >= rank) {
+      int64_t top = bucket_top(i);
+      int64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+      return top < max ? top : max;
+    }
+  }
+  return __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+}
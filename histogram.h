@@ -0,0 +1,33 @@
+#ifndef __HISTOGRAM__
+#define __HISTOGRAM__
+#include <stdint.h>
+
+// Each power of two is split into this many buckets, so a recorded value
+// is known to within 1/16 (about 6%) of itself
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_HALF_SUB_BUCKETS (1 << (HISTOGRAM_SUB_BUCKET_BITS - 1))
+// Values from 2^HISTOGRAM_MAX_BITS up are counted in the top bucket; in
+// nanoseconds that is a bit over a minute
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_BUCKETS \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_HALF_SUB_BUCKETS)
+
+/**
+ * Counts of recorded values in buckets whose width grows with the values
+ * they hold, in the style of an HDR histogram: small values are counted
+ * exactly and larger ones to within a fixed fraction of themselves, so
+ * percentiles from microseconds to minutes fit in a few KB. Values can be
+ * recorded from several threads at once. A zeroed histogram is empty.
+ */
+typedef struct histogram {
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total;  // number of values recorded
+  int64_t sum;     // of the values recorded
+  int64_t max;     // largest value recorded
+} histogram_t;
+
+void histogram_record(histogram_t* histogram, int64_t value);
+void histogram_merge(histogram_t* into, const histogram_t* from);
+int64_t histogram_percentile(const histogram_t* histogram, double percent);
+
+#endif
@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "game.h"
+#include "journal.h"
+#include "room.h"
+
+/*
+  Games are saved in a state directory as a snapshot of every room plus a
+  journal of what happened since. Game threads only ever append a record
+  to the journal, a single write on a file opened with O_APPEND, so they
+  never wait on the snapshot. A background thread folds the journal into
+  the snapshot now and then: it swaps in an empty journal, applies the old
+  one to its own copy of the rooms and replaces the snapshot file. Live
+  rooms are never read, so rounds keep going while it works.
+
+  Writes aren't synced, so the saved games survive the server crashing
+  but not the machine.
+*/
+
+int journal_fd = -1;
+// Held for reading while appending, and for writing while swapping files
+pthread_rwlock_t journal_lock = PTHREAD_RWLOCK_INITIALIZER;
+// The state directory
+char state_dir[PATH_MAX - 32];
+// Rooms as of the snapshot and every journal record applied to it; only
+// touched by the snapshot thread once the server is running
+saved_room_t* saved_rooms = NULL;
+
+/**
+ * Makes the path of a file in the state directory
+ *
+ * \param path - filled in with the path; PATH_MAX long
+ * \param name - the name of the file
+ */
+void state_path(char* path, const char* name) {
+  snprintf(path, PATH_MAX, "%s/%s", state_dir, name);
+}
+
+/**
+ * Appends a record to the journal. Safe to call from any thread, and does
+ * nothing if games aren't being saved.
+ *
+ * \param record - the record to append
+ */
+void journal_append(const journal_record_t* record) {
+  if (journal_fd == -1) return;
+  pthread_rwlock_rdlock(&journal_lock);
+  if (write(journal_fd, record, sizeof(journal_record_t)) != sizeof(journal_record_t)) {
+    perror("Unable to write to the journal");
+  }
+  pthread_rwlock_unlock(&journal_lock);
+}
+
+/**
+ * Appends the outcome of a finished round to the journal
+ *
+ * \param room - the id of the room
+ * \param version - the number of rounds finished in the room
+ * \param col - the column of the question answered
+ * \param row - the row of the question answered
+ * \param game - the game after the round
+ */
+void journal_round(int room, int version, int col, int row, const game_t* game) {
+  if (journal_fd == -1) return;
+  journal_record_t record;
+  memset(&record, 0, sizeof(journal_record_t));
+  record.type = JOURNAL_ROUND;
+  record.room = room;
+  record.version = version;
+  record.col = col;
+  record.row = row;
+  record.turn = game->id_of_player_turn;
+  record.is_over = game->is_over;
+  for (int player = 0; player < game->num_players && player < MAX_NUM_PLAYERS; player++) {
+    record.scores[player] = game->players[player].score;
+  }
+  journal_append(&record);
+}
+
+/**
+ * Applies a journal record to the saved rooms
+ *
+ * \param record - the record to apply
+ */
+void apply_record(const journal_record_t* record) {
+  saved_room_t* found;
+  HASH_FIND_INT(saved_rooms, &record->room, found);
+  room_snapshot_t* saved = found != NULL ? &found->snapshot : NULL;
+
+  switch (record->type) {
+  case JOURNAL_ROOM_OPENED:
+    if (found != NULL) return;
+    found = calloc(1, sizeof(saved_room_t));
+    if (found == NULL) {
+      perror("Unable to allocate saved room");
+      exit(2);
+    }
+    saved = &found->snapshot;
+    saved->id = record->room;
+    saved->config = record->config;
+    saved->seed = record->seed;
+    saved->questions = record->questions;
+    HASH_ADD_INT(saved_rooms, snapshot.id, found);
+    return;
+
+  case JOURNAL_PLAYER_JOINED:
+    if (saved == NULL || record->player < 0 || record->player >= saved->config.num_players) return;
+    saved->joined |= 1 << record->player;
+    memcpy(saved->names[record->player], record->name, MAX_ANSWER_LENGTH);
+    saved->tokens[record->player] = record->token;
+    return;
+
+  case JOURNAL_ROUND:
+    if (saved == NULL || record->version <= saved->version ||
+        record->col < 0 || record->col >= saved->config.num_categories ||
+        record->row < 0 || record->row >= saved->config.num_rows) {
+      return;
+    }
+    saved->version = record->version;
+    saved->turn = record->turn;
+    saved->is_over = record->is_over;
+    memcpy(saved->scores, record->scores, sizeof(saved->scores));
+    saved->answered[record->col * saved->config.num_rows + record->row] = 1;
+    return;
+
+  case JOURNAL_ROOM_CLOSED:
+    if (found == NULL) return;
+    HASH_DEL(saved_rooms, found);
+    free(found);
+    return;
+  }
+}
+
+/**
+ * Applies every record of a journal file to the saved rooms
+ *
+ * \param name - the name of the journal in the state directory
+ * \return - boolean, False if the journal exists but can't be read
+ */
+int apply_journal(const char* name) {
+  char path[PATH_MAX];
+  state_path(path, name);
+  FILE* input = fopen(path, "rb");
+  if (input == NULL) return errno == ENOENT;
+  // a record cut short by a crash is left out
+  journal_record_t record;
+  while (fread(&record, sizeof(journal_record_t), 1, input) == 1) apply_record(&record);
+  fclose(input);
+  return 1;
+}
+
+/**
+ * Reads the snapshot file into the saved rooms
+ *
+ * \return - boolean, False if the snapshot exists but can't be read
+ */
+int read_snapshot() {
+  char path[PATH_MAX];
+  state_path(path, SNAPSHOT_FILE);
+  FILE* input = fopen(path, "rb");
+  if (input == NULL) return errno == ENOENT;
+
+  snapshot_header_t header;
+  if (fread(&header, sizeof(header), 1, input) != 1 ||
+      memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+      header.version != SNAPSHOT_VERSION || header.room_size != sizeof(room_snapshot_t)) {
+    fprintf(stderr, "%s isn't a snapshot this server can read\n", path);
+    fclose(input);
+    return 0;
+  }
+  for (uint32_t i = 0; i < header.num_rooms; i++) {
+    saved_room_t* saved = malloc(sizeof(saved_room_t));
+    if (saved == NULL || fread(&saved->snapshot, sizeof(room_snapshot_t), 1, input) != 1) {
+      fprintf(stderr, "%s is cut short\n", path);
+      free(saved);
+      fclose(input);
+      return 0;
+    }
+    HASH_ADD_INT(saved_rooms, snapshot.id, saved);
+  }
+  fclose(input);
+  return 1;
+}
+
+/**
+ * Replaces the snapshot file with the saved rooms. The new snapshot is
+ * written next to the old one and renamed over it, so a crash leaves one
+ * or the other whole.
+ *
+ * \return - boolean, True if the snapshot was written
+ */
+int write_snapshot() {
+  char path[PATH_MAX], temp_path[PATH_MAX];
+  state_path(path, SNAPSHOT_FILE);
+  state_path(temp_path, SNAPSHOT_FILE ".tmp");
+  FILE* output = fopen(temp_path, "wb");
+  if (output == NULL) {
+    perror("Unable to write a snapshot");
+    return 0;
+  }
+
+  snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.version = SNAPSHOT_VERSION;
+  header.room_size = sizeof(room_snapshot_t);
+  header.num_rooms = HASH_COUNT(saved_rooms);
+  int ok = fwrite(&header, sizeof(header), 1, output) == 1;
+  saved_room_t *saved, *temp;
+  HASH_ITER(hh, saved_rooms, saved, temp) {
+    ok = ok && fwrite(&saved->snapshot, sizeof(room_snapshot_t), 1, output) == 1;
+  }
+  ok = fflush(output) == 0 && fsync(fileno(output)) == 0 && ok;
+  fclose(output);
+  if (!ok || rename(temp_path, path) == -1) {
+    perror("Unable to write a snapshot");
+    unlink(temp_path);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Opens a new, empty journal file
+ *
+ * \return - the file descriptor of the journal, or -1
+ */
+int open_journal_file() {
+  char path[PATH_MAX];
+  state_path(path, JOURNAL_FILE);
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+  if (fd == -1) perror("Unable to open the journal");
+  return fd;
+}
+
+/**
+ * Folds the journal into the snapshot if anything was appended to it
+ * since the last time
+ */
+void compact_journal() {
+  struct stat info;
+  if (fstat(journal_fd, &info) == -1 || info.st_size == 0) return;
+
+  // swap in an empty journal; appends in flight finish first
+  char path[PATH_MAX], old_path[PATH_MAX];
+  state_path(path, JOURNAL_FILE);
+  state_path(old_path, OLD_JOURNAL_FILE);
+  pthread_rwlock_wrlock(&journal_lock);
+  int ok = rename(path, old_path) == 0;
+  int fd = ok ? open_journal_file() : -1;
+  if (fd != -1) {
+    close(journal_fd);
+    journal_fd = fd;
+  } else if (ok) {
+    // keep appending to the old journal, and fold it in next time
+    rename(old_path, path);
+  }
+  pthread_rwlock_unlock(&journal_lock);
+  if (fd == -1) {
+    perror("Unable to swap in a new journal");
+    return;
+  }
+
+  // the old journal is only removed once the snapshot holds it; a crash
+  // in between applies it twice on restart, which changes nothing
+  if (apply_journal(OLD_JOURNAL_FILE) && write_snapshot()) unlink(old_path);
+}
+
+/**
+ * Thread function that folds the journal into the snapshot every
+ * SNAPSHOT_INTERVAL_S seconds, for as long as the server runs
+ *
+ * \param input - unused
+ * \return - NULL
+ */
+void* take_snapshots(void* input) {
+  (void)input;
+  while (1) {
+    sleep(SNAPSHOT_INTERVAL_S);
+    compact_journal();
+  }
+  return NULL;
+}
+
+/**
+ * Starts saving games in a state directory. Games saved there by an
+ * earlier run of the server are brought back first, in rooms that wait
+ * for their players to join again; games that hadn't started yet are
+ * dropped.
+ *
+ * \param dir - the state directory; made if it doesn't exist
+ * \return - boolean, True if games are being saved
+ */
+int journal_open(const char* dir) {
+  if (strlen(dir) >= sizeof(state_dir)) {
+    fprintf(stderr, "State directory %s is too long\n", dir);
+    return 0;
+  }
+  strcpy(state_dir, dir);
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+    perror("Unable to make the state directory");
+    return 0;
+  }
+
+  // everything saved, oldest first
+  if (!read_snapshot() || !apply_journal(OLD_JOURNAL_FILE) || !apply_journal(JOURNAL_FILE)) {
+    return 0;
+  }
+  int restored = 0;
+  saved_room_t *saved, *temp;
+  HASH_ITER(hh, saved_rooms, saved, temp) {
+    room_snapshot_t* snapshot = &saved->snapshot;
+    int all_seats = (1 << snapshot->config.num_players) - 1;
+    // a board made from other questions wouldn't be the one being played
+    int same_questions = snapshot->questions == questions_checksum();
+    if (!same_questions && !snapshot->is_over && snapshot->joined == all_seats) {
+      fprintf(stderr, "Room %d was played with a different question file; dropping it\n", snapshot->id);
+    }
+    if (snapshot->is_over || snapshot->joined != all_seats || !same_questions) {
+      HASH_DEL(saved_rooms, saved);
+      free(saved);
+    } else {
+      restore_room(snapshot);
+      restored++;
+    }
+  }
+  if (restored > 0) printf("Restored %d games from %s\n", restored, dir);
+
+  // start over from a snapshot of just the restored games
+  char path[PATH_MAX];
+  if (!write_snapshot()) return 0;
+  state_path(path, OLD_JOURNAL_FILE);
+  unlink(path);
+  journal_fd = open_journal_file();
+  if (journal_fd == -1) return 0;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, take_snapshots, NULL)) {
+    perror("PTHREAD CREATE FAILED:");
+    exit(2);
+  }
+  pthread_detach(thread);
+  return 1;
+}
+
+/**
+ * Reads the port the server was listening on when games were last saved
+ * in the state directory, so the players of restored games can find it
+ * where they left it. Must be called after journal_open.
+ *
+ * \param port - set to the saved port; left alone if none was saved
+ * \return - boolean, False if a port was saved but can't be read
+ */
+int journal_saved_port(unsigned short* port) {
+  char path[PATH_MAX];
+  state_path(path, PORT_FILE);
+  FILE* input = fopen(path, "r");
+  if (input == NULL) return errno == ENOENT;
+  unsigned saved;
+  int ok = fscanf(input, "%u", &saved) == 1 && saved > 0 && saved <= 65535;
+  fclose(input);
+  if (!ok) {
+    fprintf(stderr, "%s doesn't hold a port\n", path);
+    return 0;
+  }
+  *port = saved;
+  return 1;
+}
+
+/**
+ * Saves the port the server is listening on in the state directory. Like
+ * the snapshot, it's written next to the old one and renamed over it.
+ *
+ * \param port - the port
+ * \return - boolean, True if the port was saved
+ */
+int journal_save_port(unsigned short port) {
+  char path[PATH_MAX], temp_path[PATH_MAX];
+  state_path(path, PORT_FILE);
+  state_path(temp_path, PORT_FILE ".tmp");
+  FILE* output = fopen(temp_path, "w");
+  if (output == NULL) {
+    perror("Unable to save the port");
+    return 0;
+  }
+  int ok = fprintf(output, "%u\n", port) > 0;
+  ok = fflush(output) == 0 && fsync(fileno(output)) == 0 && ok;
+  fclose(output);
+  if (!ok || rename(temp_path, path) == -1) {
+    perror("Unable to save the port");
+    unlink(temp_path);
+    return 0;
+  }
+  return 1;
+}
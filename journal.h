@@ -0,0 +1,102 @@
+#ifndef __JOURNAL__
+#define __JOURNAL__
+#include <pthread.h>
+#include <stdint.h>
+
+#include "deps/uthash.h"
+#include "game_structs.h"
+
+// First bytes of every snapshot file
+#define SNAPSHOT_MAGIC "TJSNAP"
+#define SNAPSHOT_VERSION 3
+// How often the journal is folded into the snapshot, if it has grown
+#define SNAPSHOT_INTERVAL_S 5
+// Files kept in the state directory
+#define SNAPSHOT_FILE "snapshot"
+#define JOURNAL_FILE "journal"
+#define OLD_JOURNAL_FILE "journal.old"
+// Holds the port the server last listened on, in decimal
+#define PORT_FILE "port"
+
+// What a journal record says happened
+enum journal_type {
+  JOURNAL_ROOM_OPENED = 1,   // config, seed and questions are set
+  JOURNAL_PLAYER_JOINED = 2, // player, name and token are set
+  JOURNAL_ROUND = 3,         // a round was finished; version, col, row,
+                             // scores, turn and is_over are set
+  JOURNAL_ROOM_CLOSED = 4    // the room's game is over or was abandoned
+};
+
+/**
+ * A single record of the journal, written to the journal file as is. Each
+ * record holds the whole outcome it's about rather than a change, so
+ * applying a record twice gives the same state.
+ */
+typedef struct journal_record {
+  int32_t type;   // a journal_type
+  int32_t room;   // id of the room
+  int32_t player; // seat of the player who joined
+  int32_t version; // rounds finished in the room
+  room_config_t config;
+  uint32_t seed;
+  uint32_t questions; // questions_checksum() of the server that opened the room
+  int32_t col;
+  int32_t row;
+  int32_t turn;   // id of the player whose turn it is
+  int32_t is_over;
+  int32_t scores[MAX_NUM_PLAYERS];
+  char name[MAX_ANSWER_LENGTH];
+  uint64_t token; // session token of the player who joined
+} journal_record_t;
+
+/**
+ * Everything needed to bring back a room's game, kept in the snapshot. The
+ * board isn't kept: it's made again from the seed, and the questions
+ * already answered are marked off. That only gives the same board with
+ * the same questions, so a room is dropped if the server restarts with
+ * other ones.
+ */
+typedef struct room_snapshot {
+  int32_t id;
+  room_config_t config;
+  uint32_t seed;
+  uint32_t questions; // questions_checksum() of the server that opened it
+  int32_t version;
+  int32_t turn;
+  int32_t is_over;
+  int32_t joined;  // bit for each seat a player has joined
+  int32_t scores[MAX_NUM_PLAYERS];
+  char names[MAX_NUM_PLAYERS][MAX_ANSWER_LENGTH];
+  uint64_t tokens[MAX_NUM_PLAYERS]; // so players can resume after a restart
+  uint8_t answered[MAX_CATEGORIES * NUM_QUESTIONS_PER_CATEGORY]; // by col * rows + row
+} room_snapshot_t;
+
+/**
+ * A saved room, found by its id. Only the snapshot is written to disk.
+ */
+typedef struct saved_room {
+  room_snapshot_t snapshot;
+  UT_hash_handle hh;
+} saved_room_t;
+
+/**
+ * Start of a snapshot file. The rooms follow it back to back, in the byte
+ * order of the server that wrote them.
+ */
+typedef struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t room_size;
+  uint32_t num_rooms;
+} snapshot_header_t;
+
+// File descriptor of the journal, -1 if games aren't being saved
+extern int journal_fd;
+
+int journal_open(const char* dir);
+int journal_saved_port(unsigned short* port);
+int journal_save_port(unsigned short port);
+void journal_append(const journal_record_t* record);
+void journal_round(int room, int version, int col, int row, const game_t* game);
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "latency.h"
+
+/**
+ * Sets up an estimator with no samples yet
+ *
+ * \param latency - the estimator to initialize
+ */
+void latency_init(latency_t* latency) {
+  latency->num_samples = 0;
+  latency->next_sample = 0;
+  latency->rtt = -1;
+  latency->offset = 0;
+  latency->jitter = 0;
+  latency->pongs = 0;
+}
+
+/**
+ * Adds the timestamps of an answered ping to an estimator and updates its
+ * estimates. Time spent by the peer between receiving the ping and sending
+ * the pong doesn't count towards the round trip.
+ *
+ * \param latency - the estimator of the peer that answered
+ * \param sent - when the ping was sent, on the local clock
+ * \param peer_received - when the peer received the ping, on its clock
+ * \param peer_sent - when the peer sent the pong, on its clock
+ * \param received - when the pong was received, on the local clock
+ * \return - boolean, True if the sample was used, False if it was bogus
+ */
+int latency_add_sample(latency_t* latency, int64_t sent, int64_t peer_received,
+                       int64_t peer_sent, int64_t received) {
+  int64_t rtt = (received - sent) - (peer_sent - peer_received);
+  if (rtt < 0 || peer_sent < peer_received) return 0;
+
+  latency_sample_t* sample = &latency->samples[latency->next_sample];
+  sample->rtt = rtt;
+  sample->offset = ((peer_received - sent) + (peer_sent - received)) / 2;
+  latency->next_sample = (latency->next_sample + 1) % LATENCY_SAMPLES;
+  if (latency->num_samples < LATENCY_SAMPLES) latency->num_samples++;
+  latency->pongs++;
+
+  // the sample with the shortest round trip is the most trustworthy
+  latency_sample_t* best = &latency->samples[0];
+  for (int i = 1; i < latency->num_samples; i++) {
+    if (latency->samples[i].rtt < best->rtt) best = &latency->samples[i];
+  }
+  latency->rtt = best->rtt;
+  latency->offset = best->offset;
+
+  int64_t spread = 0;
+  for (int i = 0; i < latency->num_samples; i++) {
+    spread += llabs(latency->samples[i].offset - best->offset);
+  }
+  latency->jitter = spread / latency->num_samples;
+  return 1;
+}
+
+/**
+ * Estimates how far behind the network puts the peer when buzzing in. The
+ * question reaches them one trip after it is sent and their buzz takes
+ * another trip back, so they are behind by a whole round trip, up to
+ * MAX_LATENCY_COMPENSATION_NS.
+ *
+ * \param latency - the estimator of the peer
+ * \return - the delay in ns, 0 if nothing has been measured yet
+ */
+int64_t latency_compensation(const latency_t* latency) {
+  if (latency->rtt < 0) return 0;
+  return latency->rtt < MAX_LATENCY_COMPENSATION_NS ? latency->rtt : MAX_LATENCY_COMPENSATION_NS;
+}
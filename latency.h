@@ -0,0 +1,43 @@
+#ifndef __LATENCY__
+#define __LATENCY__
+#include <stdint.h>
+
+// Number of recent ping samples the estimates are picked from
+#define LATENCY_SAMPLES 8
+// Pings sent back to back when a player joins, so that buzzes are already
+// compensated in the first round
+#define PING_BURST 4
+// Most a buzz is moved back in time to make up for a slow connection, so a
+// client faking a slow connection can't gain more than this
+#define MAX_LATENCY_COMPENSATION_NS (250 * 1000000LL)
+
+/**
+ * Round trip time and clock offset measured by a single ping
+ */
+typedef struct latency_sample {
+  int64_t rtt;
+  int64_t offset;
+} latency_sample_t;
+
+/**
+ * Estimates of the round trip time to a player and of the offset of their
+ * clock, filtered from recent pings the way NTP does: the sample with the
+ * shortest round trip is the one least disturbed by queueing, so its
+ * values are the estimate.
+ */
+typedef struct latency {
+  latency_sample_t samples[LATENCY_SAMPLES];
+  int num_samples;
+  int next_sample;  // index of the slot the next sample replaces
+  int64_t rtt;      // estimated round trip time in ns, -1 until measured
+  int64_t offset;   // estimated player clock minus server clock in ns
+  int64_t jitter;   // mean distance of sampled offsets from the estimate
+  unsigned long pongs;  // number of pings answered
+} latency_t;
+
+void latency_init(latency_t* latency);
+int latency_add_sample(latency_t* latency, int64_t sent, int64_t peer_received,
+                       int64_t peer_sent, int64_t received);
+int64_t latency_compensation(const latency_t* latency);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+
+#include "metrics.h"
+#include "event_log.h"
+#include "histogram.h"
+#include "protocol.h"
+#include "room.h"
+
+server_metrics_t metrics;
+histogram_t player_rtt;
+histogram_t player_jitter;
+histogram_t buzz_compensation;
+
+// How phases are labeled in the metrics
+static const char* phase_labels[NUM_PHASES] = {
+  [PHASE_SELECT] = "select",
+  [PHASE_BUZZ_WINDOW] = "buzz_window",
+  [PHASE_READ_ANSWER] = "read_answer",
+  [PHASE_GRADE] = "grade",
+  [PHASE_BROADCAST] = "broadcast",
+  [PHASE_ROUND] = "round",
+};
+// The quantiles given of each summary
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+/**
+ * Counts a player's latest latency estimates. Safe to call from any thread.
+ *
+ * \param latency - the estimator of the player, just updated by a pong
+ */
+void metric_latency(const latency_t* latency) {
+  histogram_record(&player_rtt, latency->rtt);
+  histogram_record(&player_jitter, latency->jitter);
+}
+
+/**
+ * Prints a single counter or gauge with its help text
+ *
+ * \param out - where to print it
+ * \param name - the name of the metric
+ * \param type - "counter" or "gauge"
+ * \param help - what the metric counts
+ * \param value - the value of the metric
+ */
+static void print_metric(FILE* out, const char* name, const char* type,
+                         const char* help, int64_t value) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name, help, name, type, name, (long long)value);
+}
+
+/**
+ * Prints a histogram of nanoseconds as a summary in seconds
+ *
+ * \param out - where to print it
+ * \param name - the name of the metric
+ * \param help - what the metric measures
+ * \param histogram - the times measured
+ */
+static void print_summary(FILE* out, const char* name, const char* help,
+                          const histogram_t* histogram) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+  for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+    fprintf(out, "%s{quantile=\"%g\"} %.9f\n", name, quantiles[q],
+            histogram_percentile(histogram, quantiles[q] * 100) / 1e9);
+  }
+  fprintf(out, "%s_sum %.9f\n%s_count %llu\n", name, __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED) / 1e9,
+          name, (unsigned long long)__atomic_load_n(&histogram->total, __ATOMIC_RELAXED));
+}
+
+/**
+ * Prints every metric of the server in the Prometheus text format
+ *
+ * \param out - where to print the metrics
+ */
+void print_metrics(FILE* out) {
+  server_metrics_t now;
+  now.players_connected = __atomic_load_n(&metrics.players_connected, __ATOMIC_RELAXED);
+  now.connections = __atomic_load_n(&metrics.connections, __ATOMIC_RELAXED);
+  now.rooms_opened = __atomic_load_n(&metrics.rooms_opened, __ATOMIC_RELAXED);
+  now.rooms_closed = __atomic_load_n(&metrics.rooms_closed, __ATOMIC_RELAXED);
+  now.rounds_completed = __atomic_load_n(&metrics.rounds_completed, __ATOMIC_RELAXED);
+  now.answers_graded = __atomic_load_n(&metrics.answers_graded, __ATOMIC_RELAXED);
+  now.answers_correct = __atomic_load_n(&metrics.answers_correct, __ATOMIC_RELAXED);
+  now.sessions_resumed = __atomic_load_n(&metrics.sessions_resumed, __ATOMIC_RELAXED);
+  now.deadlines_missed = __atomic_load_n(&metrics.deadlines_missed, __ATOMIC_RELAXED);
+
+  print_metric(out, "tj_players_connected", "gauge",
+               "Client connections currently open.", now.players_connected);
+  print_metric(out, "tj_connections_total", "counter",
+               "Client connections accepted.", now.connections);
+  print_metric(out, "tj_rooms_active", "gauge",
+               "Rooms filling up or playing.", now.rooms_opened - now.rooms_closed);
+  print_metric(out, "tj_rooms_opened_total", "counter",
+               "Rooms opened.", now.rooms_opened);
+  print_metric(out, "tj_rounds_completed_total", "counter",
+               "Rounds played to the end.", now.rounds_completed);
+  print_metric(out, "tj_answers_graded_total", "counter",
+               "Answers checked against the correct answer.", now.answers_graded);
+  print_metric(out, "tj_answers_correct_total", "counter",
+               "Answers graded as correct.", now.answers_correct);
+  print_metric(out, "tj_sessions_resumed_total", "counter",
+               "Players who got their seat back after losing their connection.", now.sessions_resumed);
+  print_metric(out, "tj_deadlines_missed_total", "counter",
+               "Picks and answers made by the server for players who ran out of time.", now.deadlines_missed);
+  print_metric(out, "tj_received_bytes_total", "counter", "Bytes read from clients.",
+               __atomic_load_n(&wire_bytes_received, __ATOMIC_RELAXED));
+  print_metric(out, "tj_sent_bytes_total", "counter", "Bytes written to clients.",
+               __atomic_load_n(&wire_bytes_sent, __ATOMIC_RELAXED));
+  if (event_log != NULL) {
+    print_metric(out, "tj_events_written_total", "counter", "Events written to the event log.",
+                 __atomic_load_n(&event_log->written, __ATOMIC_RELAXED));
+    print_metric(out, "tj_events_dropped_total", "counter", "Events dropped because the event log fell behind.",
+                 __atomic_load_n(&event_log->dropped, __ATOMIC_RELAXED));
+  }
+
+  // phase times as a summary; the grade phase is the grading latency
+  histogram_t phase_times[NUM_PHASES];
+  collect_phase_times(phase_times);
+  fprintf(out, "# HELP tj_round_phase_seconds Time taken by each phase of a round.\n");
+  fprintf(out, "# TYPE tj_round_phase_seconds summary\n");
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+      fprintf(out, "tj_round_phase_seconds{phase=\"%s\",quantile=\"%g\"} %.9f\n", phase_labels[phase],
+              quantiles[q], histogram_percentile(&phase_times[phase], quantiles[q] * 100) / 1e9);
+    }
+    fprintf(out, "tj_round_phase_seconds_sum{phase=\"%s\"} %.9f\n", phase_labels[phase],
+            phase_times[phase].sum / 1e9);
+    fprintf(out, "tj_round_phase_seconds_count{phase=\"%s\"} %llu\n", phase_labels[phase],
+            (unsigned long long)phase_times[phase].total);
+  }
+
+  // the estimates that decide buzzes when they're arbitrated by latency;
+  // clock offsets are left out, since every client's clock starts anywhere
+  print_summary(out, "tj_player_rtt_seconds",
+                "Round trip time estimated for each player after each pong.", &player_rtt);
+  print_summary(out, "tj_player_jitter_seconds",
+                "Jitter of each player's clock offset estimated after each pong.", &player_jitter);
+  print_summary(out, "tj_buzz_compensation_seconds",
+                "How far back each answer's buzz was moved to make up for a slow connection.",
+                &buzz_compensation);
+}
@@ -0,0 +1,49 @@
+#ifndef __METRICS__
+#define __METRICS__
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+#include "latency.h"
+
+/**
+ * Counters of what the server has done since it started. Updated from any
+ * thread with metric_add, and read whole by print_metrics.
+ */
+typedef struct server_metrics {
+  int64_t players_connected;  // client connections open right now
+  int64_t connections;        // client connections ever accepted
+  int64_t rooms_opened;
+  int64_t rooms_closed;
+  int64_t rounds_completed;
+  int64_t answers_graded;     // answers checked against the correct one
+  int64_t answers_correct;
+  int64_t sessions_resumed;   // players back in their seat after losing
+                              // their connection
+  int64_t deadlines_missed;   // picks and answers the server made for
+                              // players who ran out of time
+} server_metrics_t;
+
+extern server_metrics_t metrics;
+// Every player's round trip time and jitter estimates, recorded each time
+// a pong updates them
+extern histogram_t player_rtt;
+extern histogram_t player_jitter;
+// How far back buzzes were moved to make up for slow connections
+extern histogram_t buzz_compensation;
+
+/**
+ * Adds to a counter (or subtracts, for a negative amount). Safe to call
+ * from any thread.
+ *
+ * \param counter - the counter in metrics to change
+ * \param amount - how much to add
+ */
+static inline void metric_add(int64_t* counter, int64_t amount) {
+  __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+void metric_latency(const latency_t* latency);
+void print_metrics(FILE* out);
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "game.h"
+#include "question_pack.h"
+
+/**
+ * Compiles a JSON question file into a question pack, which the server
+ * maps straight into memory instead of parsing the JSON on every start.
+ * Only full categories are kept, the same ones the server would keep.
+ *
+ * Usage: ./pack_questions questions.json questions.pack
+ */
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s questions_file pack_file\n", argv[0]);
+    exit(1);
+  }
+
+  FILE* read = fopen(argv[1], "r");
+  if (read == NULL) {
+    perror("Could not open the questions file");
+    exit(2);
+  }
+  if (parse_json(read)) {
+    perror("Could not read the questions file");
+    exit(2);
+  }
+  fclose(read);
+  filter_categories();
+
+  if (!write_question_pack(argv[2])) exit(2);
+  printf("Wrote %d full categories to %s\n", count_categories(), argv[2]);
+  clean_up_game();
+  return 0;
+}
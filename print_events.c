@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "event_log.h"
+
+/**
+ * Prints a string as a JSON string, escaping what JSON needs escaped
+ *
+ * \param text - the string to print
+ * \param max_len - the most characters the string can have, if it isn't
+ *                  null terminated before then
+ */
+void print_json_string(const char* text, int max_len) {
+  putchar('"');
+  for (int i = 0; i < max_len && text[i] != '\0'; i++) {
+    unsigned char c = text[i];
+    if (c == '"' || c == '\\') {
+      printf("\\%c", c);
+    } else if (c < 0x20) {
+      printf("\\u%04x", c);
+    } else {
+      putchar(c);
+    }
+  }
+  putchar('"');
+}
+
+/**
+ * Prints an event as a line of JSON, naming its arguments
+ *
+ * \param event - the event to print
+ */
+void print_event(const event_t* event) {
+  printf("{\"time_ns\": %lld, \"room\": %d, \"event\": \"%s\"",
+         (long long)event->time, event->room, event_type_name(event->type));
+  if (event->player != -1) printf(", \"player\": %d", event->player);
+  switch (event->type) {
+  case EVENT_GAME_STARTED:
+    printf(", \"players\": %d, \"categories\": %d, \"rows\": %d, \"buzz_ms\": %d, "
+           "\"seed\": %u, \"arbitration\": %d, \"categories_available\": %d, \"questions\": %u",
+           event->args[0], event->args[1], event->args[2], event->args[3],
+           (unsigned int)event->args[4], event->args[5], event->args[6], (unsigned int)event->args[7]);
+    break;
+  case EVENT_ANSWER_SUBMITTED:
+    printf(", \"did_answer\": %d, \"compensation_ns\": %d, \"answer\": ", event->args[0], event->args[1]);
+    print_json_string(event->text, MAX_ANSWER_LENGTH);
+    break;
+  case EVENT_QUESTION_SELECTED:
+    printf(", \"col\": %d, \"row\": %d, \"value\": %d", event->args[0], event->args[1], event->args[2]);
+    break;
+  case EVENT_ANSWER_GRADED:
+    printf(", \"correct\": %d, \"buzz_us\": %d, \"answer\": ", event->args[0], event->args[1]);
+    print_json_string(event->text, MAX_ANSWER_LENGTH);
+    break;
+  case EVENT_SCORE_CHANGED:
+    printf(", \"score\": %d, \"points\": %d", event->args[0], event->args[1]);
+    break;
+  }
+  printf("}\n");
+}
+
+/**
+ * Prints the events of an event log written by the server, one line of
+ * JSON each, so they can be picked through with the usual tools
+ *
+ * Usage: ./print_events events.log
+ */
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s event_log\n", argv[0]);
+    exit(1);
+  }
+
+  FILE* input = fopen(argv[1], "rb");
+  if (input == NULL) {
+    perror("Could not open the event log");
+    exit(2);
+  }
+  if (!read_event_log_header(input)) exit(2);
+
+  event_t event;
+  while (fread(&event, sizeof(event_t), 1, input) == 1) {
+    print_event(&event);
+  }
+  fclose(input);
+  return 0;
+}
@@ -0,0 +1,904 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "protocol.h"
+
+// Bytes moved by recv_frame and send_buf, over every connection
+uint64_t wire_bytes_received = 0;
+uint64_t wire_bytes_sent = 0;
+
+/**
+ * Reads fields out of a frame's payload. Reading past the end of the
+ * payload marks the reader as failed instead of reading out of bounds.
+ */
+typedef struct wire_reader {
+  const uint8_t* pos;
+  size_t left;
+  int ok; // boolean, cleared once a read runs past the end of the payload
+} wire_reader_t;
+
+/**
+ * Sets up an empty buffer to encode messages into
+ *
+ * \param buf - the buffer to initialize
+ */
+void wire_buf_init(wire_buf_t* buf) {
+  buf->data = NULL;
+  buf->len = 0;
+  buf->cap = 0;
+}
+
+/**
+ * Frees the memory held by a buffer
+ *
+ * \param buf - the buffer to free
+ */
+void wire_buf_free(wire_buf_t* buf) {
+  free(buf->data);
+  wire_buf_init(buf);
+}
+
+/**
+ * Makes sure a buffer has room for some more bytes
+ *
+ * \param buf - the buffer to grow
+ * \param extra - the number of bytes that will be appended to it
+ */
+void wire_buf_reserve(wire_buf_t* buf, size_t extra) {
+  if (buf->len + extra <= buf->cap) return;
+  size_t cap = buf->cap ? buf->cap : 256;
+  while (cap < buf->len + extra) cap *= 2;
+  uint8_t* data = (uint8_t*)realloc(buf->data, cap);
+  if (data == NULL) {
+    perror("Out of memory encoding message");
+    exit(2);
+  }
+  buf->data = data;
+  buf->cap = cap;
+}
+
+static void put_u8(wire_buf_t* buf, uint8_t value) {
+  wire_buf_reserve(buf, 1);
+  buf->data[buf->len++] = value;
+}
+
+static void put_u16(wire_buf_t* buf, uint16_t value) {
+  wire_buf_reserve(buf, 2);
+  buf->data[buf->len++] = value >> 8;
+  buf->data[buf->len++] = value;
+}
+
+static void put_u32(wire_buf_t* buf, uint32_t value) {
+  put_u16(buf, value >> 16);
+  put_u16(buf, value);
+}
+
+static void put_u64(wire_buf_t* buf, uint64_t value) {
+  put_u32(buf, value >> 32);
+  put_u32(buf, value);
+}
+
+/**
+ * Appends a string, cut short to at most size-1 bytes so that it is sure
+ * to fit back into a buffer of the same size on the other end
+ */
+static void put_str(wire_buf_t* buf, const char* str, size_t size) {
+  size_t len = strnlen(str, size - 1);
+  put_u16(buf, len);
+  wire_buf_reserve(buf, len);
+  memcpy(buf->data + buf->len, str, len);
+  buf->len += len;
+}
+
+/**
+ * Starts a new frame at the end of a buffer. The length is filled in by
+ * end_frame once the payload has been appended.
+ *
+ * \return - the offset of the frame in the buffer
+ */
+static size_t begin_frame(wire_buf_t* buf, int type) {
+  size_t start = buf->len;
+  put_u8(buf, type);
+  put_u8(buf, 0); // no flags are defined yet
+  put_u16(buf, 0);
+  return start;
+}
+
+static void end_frame(wire_buf_t* buf, size_t start) {
+  size_t length = buf->len - start - FRAME_HEADER_SIZE;
+  buf->data[start + 2] = length >> 8;
+  buf->data[start + 3] = length;
+}
+
+static void reader_init(wire_reader_t* reader, const frame_t* frame) {
+  reader->pos = frame->payload;
+  reader->left = frame->length;
+  reader->ok = 1;
+}
+
+static int reader_has(wire_reader_t* reader, size_t bytes) {
+  if (reader->left < bytes) {
+    reader->ok = 0;
+    reader->left = 0;
+  }
+  return reader->ok;
+}
+
+static uint8_t get_u8(wire_reader_t* reader) {
+  if (!reader_has(reader, 1)) return 0;
+  reader->left--;
+  return *reader->pos++;
+}
+
+static uint16_t get_u16(wire_reader_t* reader) {
+  if (!reader_has(reader, 2)) return 0;
+  uint16_t value = (uint16_t)reader->pos[0] << 8 | reader->pos[1];
+  reader->pos += 2;
+  reader->left -= 2;
+  return value;
+}
+
+static uint32_t get_u32(wire_reader_t* reader) {
+  uint32_t high = get_u16(reader);
+  return high << 16 | get_u16(reader);
+}
+
+static uint64_t get_u64(wire_reader_t* reader) {
+  uint64_t high = get_u32(reader);
+  return high << 32 | get_u32(reader);
+}
+
+/**
+ * Reads a string into a buffer of the given size, always NUL terminating
+ * it. Anything that doesn't fit is skipped.
+ */
+static void get_str(wire_reader_t* reader, char* str, size_t size) {
+  size_t len = get_u16(reader);
+  str[0] = '\0';
+  if (!reader_has(reader, len)) return;
+  size_t copied = len < size ? len : size - 1;
+  memcpy(str, reader->pos, copied);
+  str[copied] = '\0';
+  reader->pos += len;
+  reader->left -= len;
+}
+
+/**
+ * Writes the settings of a room
+ */
+static void put_room_config(wire_buf_t* buf, const room_config_t* config) {
+  put_u8(buf, config->num_players);
+  put_u8(buf, config->num_categories);
+  put_u8(buf, config->num_rows);
+  put_u16(buf, config->buzz_timeout_ms);
+}
+
+/**
+ * Reads the settings of a room, which older peers leave off the end of
+ * their messages; they are all 0 (the default) if so.
+ */
+static void get_room_config(wire_reader_t* reader, room_config_t* config) {
+  memset(config, 0, sizeof(room_config_t));
+  if (reader->left == 0) return;
+  config->num_players = get_u8(reader);
+  config->num_categories = get_u8(reader);
+  config->num_rows = get_u8(reader);
+  config->buzz_timeout_ms = get_u16(reader);
+}
+
+/**
+ * Writes the whole state of a game. The answers to the questions are left
+ * out; players find out the answer to a question once its round is over.
+ */
+static void put_board(wire_buf_t* buf, const game_t* game, int version) {
+  put_u32(buf, version);
+  put_u8(buf, game->is_over);
+  put_u8(buf, game->id_of_player_turn);
+
+  put_u8(buf, game->num_players);
+  for (int player = 0; player < game->num_players; player++) {
+    put_u8(buf, game->players[player].id);
+    put_str(buf, game->players[player].name, MAX_ANSWER_LENGTH);
+    put_u32(buf, game->players[player].score);
+  }
+
+  put_u8(buf, game->num_categories);
+  for (int cat = 0; cat < game->num_categories; cat++) {
+    const category_t* category = &game->categories[cat];
+    put_str(buf, category->title, MAX_ANSWER_LENGTH);
+    put_u8(buf, category->num_questions);
+    for (int q = 0; q < category->num_questions; q++) {
+      put_u32(buf, category->questions[q].value);
+      put_u8(buf, category->questions[q].is_answered);
+      put_str(buf, category->questions[q].question, MAX_QUESTION_LENGTH);
+    }
+  }
+}
+
+/**
+ * Reads the whole state of a game, allocating its board and players to the
+ * size of the game. Answers to the questions are left empty, since they
+ * aren't sent.
+ */
+static int get_board(wire_reader_t* reader, game_t* game, int* version) {
+  memset(game, 0, sizeof(game_t));
+  *version = get_u32(reader);
+  game->is_over = get_u8(reader);
+  game->id_of_player_turn = get_u8(reader);
+
+  game->num_players = get_u8(reader);
+  if (game->num_players > MAX_NUM_PLAYERS) return 0;
+  game->players = calloc(game->num_players + 1, sizeof(player_t));
+  if (game->players == NULL) return 0;
+  for (int player = 0; player < game->num_players; player++) {
+    game->players[player].id = get_u8(reader);
+    get_str(reader, game->players[player].name, MAX_ANSWER_LENGTH);
+    game->players[player].score = (int32_t)get_u32(reader);
+  }
+
+  game->num_categories = get_u8(reader);
+  if (game->num_categories > MAX_CATEGORIES) return 0;
+  game->categories = calloc(game->num_categories + 1, sizeof(category_t));
+  if (game->categories == NULL) return 0;
+  for (int cat = 0; cat < game->num_categories; cat++) {
+    category_t* category = &game->categories[cat];
+    get_str(reader, category->title, MAX_ANSWER_LENGTH);
+    category->num_questions = get_u8(reader);
+    if (category->num_questions > NUM_QUESTIONS_PER_CATEGORY) return 0;
+    // the board is as tall as its tallest category
+    if (category->num_questions > game->num_rows) game->num_rows = category->num_questions;
+    for (int q = 0; q < category->num_questions; q++) {
+      category->questions[q].value = (int32_t)get_u32(reader);
+      category->questions[q].is_answered = get_u8(reader);
+      get_str(reader, category->questions[q].question, MAX_QUESTION_LENGTH);
+    }
+  }
+  return reader->ok;
+}
+
+/**
+ * Finds the first frame at the start of some received data
+ *
+ * \param data - the received data
+ * \param len - the number of bytes received
+ * \param max_frame - the largest frame (header included) to accept
+ * \param frame - set to the frame found, if any
+ * \return - the size of the frame, 0 if more data is needed for a whole
+ *           frame, or -1 if the frame is larger than max_frame
+ */
+int frame_parse(const uint8_t* data, size_t len, size_t max_frame, frame_t* frame) {
+  if (len < FRAME_HEADER_SIZE) return 0;
+  size_t length = (size_t)data[2] << 8 | data[3];
+  if (FRAME_HEADER_SIZE + length > max_frame) return -1;
+  if (len < FRAME_HEADER_SIZE + length) return 0;
+
+  frame->type = data[0];
+  frame->payload = data + FRAME_HEADER_SIZE;
+  frame->length = length;
+  return FRAME_HEADER_SIZE + length;
+}
+
+/**
+ * Sets up a stream of frames read from a socket
+ *
+ * \param stream - the stream to initialize
+ * \param fd - the socket to read from
+ * \param max_frame - the largest frame (header included) to accept
+ */
+void frame_stream_init(frame_stream_t* stream, int fd, size_t max_frame) {
+  stream->fd = fd;
+  stream->buf = (uint8_t*)malloc(max_frame);
+  if (stream->buf == NULL) {
+    perror("Out of memory for frame stream");
+    exit(2);
+  }
+  stream->cap = max_frame;
+  stream->len = 0;
+  stream->consumed = 0;
+  stream->last_read_time = -1;
+  stream->timer_fd = -1;
+}
+
+/**
+ * Frees the buffer of a frame stream. Doesn't close the socket.
+ *
+ * \param stream - the stream to free
+ */
+void frame_stream_free(frame_stream_t* stream) {
+  free(stream->buf);
+  stream->buf = NULL;
+}
+
+/**
+ * Blocks until a whole frame has been read from a stream. The payload of
+ * the frame stays valid until the next call. If the stream has a timer,
+ * the wait ends as soon as the timer expires; the timer is left expired,
+ * so it can be shared by the streams of several threads.
+ *
+ * \param stream - the stream to read from
+ * \param frame - set to the frame read
+ * \return - 1 if a frame was read, 0 if the peer closed the connection, or
+ *           -1 on a read error or a malformed frame, or with errno set to
+ *           EAGAIN if the stream's timer expired first
+ */
+int recv_frame(frame_stream_t* stream, frame_t* frame) {
+  // drop the frame returned last time
+  if (stream->consumed > 0) {
+    memmove(stream->buf, stream->buf + stream->consumed, stream->len - stream->consumed);
+    stream->len -= stream->consumed;
+    stream->consumed = 0;
+  }
+
+  while (1) {
+    int size = frame_parse(stream->buf, stream->len, stream->cap, frame);
+    if (size > 0) {
+      stream->consumed = size;
+      return 1;
+    }
+    if (size < 0) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+    if (stream->timer_fd != -1) {
+      struct pollfd fds[2] = {{stream->fd, POLLIN, 0}, {stream->timer_fd, POLLIN, 0}};
+      if (poll(fds, 2, -1) == -1) {
+        if (errno == EINTR) continue;
+        return -1;
+      }
+      // whatever already arrived is still read
+      if (fds[0].revents == 0) {
+        errno = EAGAIN;
+        return -1;
+      }
+    }
+
+    ssize_t bytes_read = read(stream->fd, stream->buf + stream->len, stream->cap - stream->len);
+    if (bytes_read == 0) return 0;
+    if (bytes_read == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    stream->last_read_time = monotonic_ns();
+    stream->len += bytes_read;
+    __atomic_fetch_add(&wire_bytes_received, bytes_read, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Blocks until a message of one of the given types has been read from a
+ * stream. Frames of types this code doesn't know are skipped, since they
+ * come from a peer speaking a newer version of the protocol.
+ *
+ * \param stream - the stream to read from
+ * \param types - the message_types to wait for, as a set of MSG_BITs
+ * \param frame - set to the frame read; on an unexpected message, set to
+ *                that message (e.g. a MSG_ERROR explaining a hang up)
+ * \return - 1 if the message was read, 0 if the peer closed the connection,
+ *           or -1 on a read error, a malformed frame or an unexpected message
+ */
+int recv_message(frame_stream_t* stream, unsigned types, frame_t* frame) {
+  while (1) {
+    int result = recv_frame(stream, frame);
+    if (result <= 0) return result;
+    if (types & MSG_BIT(frame->type)) return 1;
+    if (frame->type > 0 && frame->type < NUM_MESSAGE_TYPES) {
+      errno = EPROTO;
+      return -1;
+    }
+  }
+}
+
+/**
+ * Writes all the frames encoded into a buffer to a socket. The buffer is
+ * left as it is, so the same frames can be sent to several sockets.
+ *
+ * \param fd - the socket to write to
+ * \param buf - the encoded frames
+ * \return - boolean, True if everything was written
+ */
+int send_buf(int fd, const wire_buf_t* buf) {
+  size_t sent = 0;
+  while (sent < buf->len) {
+    ssize_t bytes_written = write(fd, buf->data + sent, buf->len - sent);
+    if (bytes_written == -1) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+    sent += bytes_written;
+  }
+  __atomic_fetch_add(&wire_bytes_sent, sent, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/**
+ * Turns off Nagle's algorithm on a socket. Messages are already batched
+ * into as few writes as possible, and holding back a small frame until the
+ * last one is acknowledged would delay questions, buzzes and pongs.
+ *
+ * \param fd - the socket to change
+ * \return - 0 on success, -1 on failure
+ */
+int set_nodelay(int fd) {
+  int on = 1;
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+/**
+ * Picks the protocol version to use with a peer: the newest version both
+ * sides speak
+ *
+ * \param peer_version - the newest version the peer speaks
+ * \return - the version to use, or -1 if the peer is too old to talk to
+ */
+int negotiate_version(int peer_version) {
+  if (peer_version < MIN_PROTOCOL_VERSION) return -1;
+  return peer_version < PROTOCOL_VERSION ? peer_version : PROTOCOL_VERSION;
+}
+
+/**
+ * Encodes the first message a client sends after connecting
+ *
+ * \param buf - the buffer to append the frame to
+ * \param name - the player's username
+ * \param config - the room settings the player wants, 0 for the default
+ */
+void encode_hello(wire_buf_t* buf, const char* name, const room_config_t* config) {
+  size_t start = begin_frame(buf, MSG_HELLO);
+  put_u16(buf, PROTOCOL_VERSION);
+  put_str(buf, name, MAX_ANSWER_LENGTH);
+  put_room_config(buf, config);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the server's reply to a client's hello
+ *
+ * \param buf - the buffer to append the frame to
+ * \param version - the protocol version the connection will use
+ * \param id - the client's id in its game
+ * \param config - the settings of the room the client was seated in
+ * \param token - the token the client can resume its session with; only
+ *                sent to clients that can resume
+ */
+void encode_welcome(wire_buf_t* buf, int version, int id, const room_config_t* config, uint64_t token) {
+  size_t start = begin_frame(buf, MSG_WELCOME);
+  put_u16(buf, version);
+  put_u8(buf, id);
+  put_room_config(buf, config);
+  if (version >= RESUME_PROTOCOL_VERSION) put_u64(buf, token);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes a client's request to get its seat back after losing its
+ * connection to the server
+ *
+ * \param buf - the buffer to append the frame to
+ * \param token - the session token the server gave out in MSG_WELCOME
+ */
+void encode_resume(wire_buf_t* buf, uint64_t token) {
+  size_t start = begin_frame(buf, MSG_RESUME);
+  put_u16(buf, PROTOCOL_VERSION);
+  put_u64(buf, token);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes everything a client coming back to its seat needs to pick the
+ * game up where it is, in a single message
+ *
+ * \param buf - the buffer to append the frame to
+ * \param state - the player's id and where the round stands
+ * \param game - the game being played
+ * \param version - the number of rounds of the game played so far
+ */
+void encode_resumed(wire_buf_t* buf, const resume_state_t* state, const game_t* game, int version) {
+  size_t start = begin_frame(buf, MSG_RESUMED);
+  put_u8(buf, state->id);
+  put_room_config(buf, &state->config);
+  put_u64(buf, state->token);
+  // 0xff for a question not picked yet
+  put_u8(buf, state->col);
+  put_u8(buf, state->row);
+  put_u8(buf, state->answered);
+  put_board(buf, game, version);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the reason the server is about to close a connection
+ *
+ * \param buf - the buffer to append the frame to
+ * \param message - the reason, readable by the player
+ */
+void encode_error(wire_buf_t* buf, const char* message) {
+  size_t start = begin_frame(buf, MSG_ERROR);
+  put_str(buf, message, MAX_QUESTION_LENGTH);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the whole state of a game
+ *
+ * \param buf - the buffer to append the frame to
+ * \param game - the game to encode
+ * \param version - the number of rounds of the game played so far
+ */
+void encode_board(wire_buf_t* buf, const game_t* game, int version) {
+  size_t start = begin_frame(buf, MSG_BOARD);
+  put_board(buf, game, version);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the changes made to a game by its last round
+ *
+ * \param buf - the buffer to append the frame to
+ * \param delta - the changes to encode
+ * \param num_players - the number of players in the game
+ */
+void encode_delta(wire_buf_t* buf, const game_delta_t* delta, int num_players) {
+  size_t start = begin_frame(buf, MSG_DELTA);
+  put_u32(buf, delta->version);
+  put_u8(buf, delta->col);
+  put_u8(buf, delta->row);
+  put_u8(buf, delta->id_of_player_turn);
+  put_u8(buf, delta->is_over);
+  put_u8(buf, num_players);
+  for (int player = 0; player < num_players; player++) {
+    put_u32(buf, delta->scores[player]);
+  }
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the coordinates of a question on the board
+ *
+ * \param buf - the buffer to append the frame to
+ * \param type - MSG_SELECT for a player picking the question, MSG_QUESTION
+ *               for the server announcing it
+ * \param col - the column (category) of the question
+ * \param row - the row of the question
+ * \param round - the round the question is for, counting from 1
+ */
+void encode_coords(wire_buf_t* buf, int type, int col, int row, int round) {
+  size_t start = begin_frame(buf, type);
+  put_u8(buf, col);
+  put_u8(buf, row);
+  put_u32(buf, round);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes a player's answer. When the player buzzed in isn't part of it;
+ * the server times the MSG_BUZZ sent when they did.
+ *
+ * \param buf - the buffer to append the frame to
+ * \param ans - the answer to encode
+ * \param round - the round the answer is for, counting from 1
+ */
+void encode_answer(wire_buf_t* buf, const answer_t* ans, int round) {
+  size_t start = begin_frame(buf, MSG_ANSWER);
+  put_u8(buf, ans->did_answer);
+  put_str(buf, ans->answer, MAX_ANSWER_LENGTH);
+  put_u32(buf, round);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes a player buzzing in. Apart from the round, what matters about the
+ * message is when it arrives.
+ *
+ * \param buf - the buffer to append the frame to
+ * \param round - the round the buzz is for, counting from 1
+ */
+void encode_buzz(wire_buf_t* buf, int round) {
+  size_t start = begin_frame(buf, MSG_BUZZ);
+  put_u32(buf, round);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes a ping, used to measure the round trip time to a client and the
+ * offset of its clock
+ *
+ * \param buf - the buffer to append the frame to
+ * \param sent - the server's monotonic_ns() as the ping is sent
+ */
+void encode_ping(wire_buf_t* buf, int64_t sent) {
+  size_t start = begin_frame(buf, MSG_PING);
+  put_u64(buf, sent);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the answer to a ping
+ *
+ * \param buf - the buffer to append the frame to
+ * \param sent - the server time carried by the ping
+ * \param received - the client's monotonic_ns() when the ping arrived
+ * \param replied - the client's monotonic_ns() as the pong is sent
+ */
+void encode_pong(wire_buf_t* buf, int64_t sent, int64_t received, int64_t replied) {
+  size_t start = begin_frame(buf, MSG_PONG);
+  put_u64(buf, sent);
+  put_u64(buf, received);
+  put_u64(buf, replied);
+  end_frame(buf, start);
+}
+
+/**
+ * Encodes the result of a round
+ *
+ * \param buf - the buffer to append the frame to
+ * \param result - the id of the player whose turn is next, whether the
+ *                 question was answered correctly, and the correct answer
+ */
+void encode_result(wire_buf_t* buf, const answer_t* result) {
+  size_t start = begin_frame(buf, MSG_RESULT);
+  put_u8(buf, result->id);
+  put_u8(buf, result->did_answer);
+  put_str(buf, result->answer, MAX_ANSWER_LENGTH);
+  end_frame(buf, start);
+}
+
+/**
+ * Decodes a client's hello
+ *
+ * \param frame - a MSG_HELLO frame
+ * \param version - set to the protocol version the client speaks
+ * \param name - buffer of MAX_ANSWER_LENGTH bytes set to the username
+ * \param config - set to the room settings the client asked for; 0 for
+ *                 any it left to the server
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_hello(const frame_t* frame, int* version, char* name, room_config_t* config) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *version = get_u16(&reader);
+  get_str(&reader, name, MAX_ANSWER_LENGTH);
+  get_room_config(&reader, config);
+  return reader.ok;
+}
+
+/**
+ * Decodes the server's welcome
+ *
+ * \param frame - a MSG_WELCOME frame
+ * \param version - set to the protocol version the connection will use
+ * \param id - set to the client's id in its game
+ * \param config - set to the settings of the room; servers too old to send
+ *                 them only have rooms with the default settings
+ * \param token - set to the token to resume the session with, 0 if the
+ *                server doesn't resume sessions
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_welcome(const frame_t* frame, int* version, int* id, room_config_t* config, uint64_t* token) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *version = get_u16(&reader);
+  *id = get_u8(&reader);
+  get_room_config(&reader, config);
+  *token = reader.left >= 8 ? get_u64(&reader) : 0;
+  if (config->num_players == 0) {
+    config->num_players = DEFAULT_NUM_PLAYERS;
+    config->num_categories = DEFAULT_NUM_CATEGORIES;
+    config->num_rows = DEFAULT_NUM_ROWS;
+    config->buzz_timeout_ms = DEFAULT_BUZZ_TIMEOUT_MS;
+  }
+  return reader.ok && *id < config->num_players && config->num_players <= MAX_NUM_PLAYERS &&
+    config->num_categories <= MAX_CATEGORIES && config->num_rows <= NUM_QUESTIONS_PER_CATEGORY;
+}
+
+/**
+ * Decodes a client's request to get its seat back
+ *
+ * \param frame - a MSG_RESUME frame
+ * \param version - set to the protocol version the client speaks
+ * \param token - set to the session token the client was given
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_resume(const frame_t* frame, int* version, uint64_t* token) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *version = get_u16(&reader);
+  *token = get_u64(&reader);
+  return reader.ok;
+}
+
+/**
+ * Decodes the state of the game a client got its seat back in. The board
+ * and players are allocated like decode_board's, and must be freed by the
+ * caller even if the frame was malformed.
+ *
+ * \param frame - a MSG_RESUMED frame
+ * \param state - set to the player's id and where the round stands
+ * \param game - set to the decoded game
+ * \param version - set to the number of rounds played so far
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_resumed(const frame_t* frame, resume_state_t* state, game_t* game, int* version) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  state->id = get_u8(&reader);
+  get_room_config(&reader, &state->config);
+  state->token = get_u64(&reader);
+  state->col = get_u8(&reader);
+  state->row = get_u8(&reader);
+  state->answered = get_u8(&reader);
+  if (state->col == 0xff || state->row == 0xff) state->col = state->row = -1;
+  int ok = get_board(&reader, game, version);
+  return ok && state->id < game->num_players && state->col < game->num_categories &&
+    state->row < game->num_rows;
+}
+
+/**
+ * Decodes the reason the server closed the connection
+ *
+ * \param frame - a MSG_ERROR frame
+ * \param message - buffer set to the reason
+ * \param size - the size of the buffer
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_error(const frame_t* frame, char* message, size_t size) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  get_str(&reader, message, size);
+  return reader.ok;
+}
+
+/**
+ * Decodes the whole state of a game. The board and players are allocated
+ * to the size of the game, and must be freed by the caller even if the
+ * frame was malformed.
+ *
+ * \param frame - a MSG_BOARD frame
+ * \param game - set to the decoded game
+ * \param version - set to the number of rounds played so far
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_board(const frame_t* frame, game_t* game, int* version) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  return get_board(&reader, game, version);
+}
+
+/**
+ * Decodes the changes made to a game by its last round
+ *
+ * \param frame - a MSG_DELTA frame
+ * \param delta - set to the decoded changes
+ * \return - boolean, True if the frame was well formed; whether the
+ *           coordinates are on the board being played is up to the caller
+ */
+int decode_delta(const frame_t* frame, game_delta_t* delta) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  memset(delta, 0, sizeof(game_delta_t));
+  delta->version = get_u32(&reader);
+  delta->col = get_u8(&reader);
+  delta->row = get_u8(&reader);
+  delta->id_of_player_turn = get_u8(&reader);
+  delta->is_over = get_u8(&reader);
+  int num_scores = get_u8(&reader);
+  if (num_scores > MAX_NUM_PLAYERS) return 0;
+  for (int player = 0; player < num_scores; player++) {
+    delta->scores[player] = (int32_t)get_u32(&reader);
+  }
+  return reader.ok && delta->col < MAX_CATEGORIES &&
+    delta->row < NUM_QUESTIONS_PER_CATEGORY;
+}
+
+/**
+ * Decodes the coordinates of a question on the board
+ *
+ * \param frame - a MSG_SELECT or MSG_QUESTION frame
+ * \param col - set to the column (category) of the question
+ * \param row - set to the row of the question
+ * \return - boolean, True if the frame was well formed and the coordinates
+ *           fit on the largest board; whether they are on the board being
+ *           played is up to the caller
+ */
+int decode_coords(const frame_t* frame, int* col, int* row) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *col = get_u8(&reader);
+  *row = get_u8(&reader);
+  return reader.ok && *col < MAX_CATEGORIES && *row < NUM_QUESTIONS_PER_CATEGORY;
+}
+
+/**
+ * Decodes a player's answer
+ *
+ * \param frame - a MSG_ANSWER frame
+ * \param ans - set to the decoded answer; its buzz_time and id are left
+ *              alone
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_answer(const frame_t* frame, answer_t* ans) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  ans->did_answer = get_u8(&reader);
+  get_str(&reader, ans->answer, MAX_ANSWER_LENGTH);
+  return reader.ok;
+}
+
+/**
+ * Decodes the round a player's pick, buzz or answer is for, so one that
+ * arrives after its round is over can be dropped
+ *
+ * \param frame - a MSG_SELECT, MSG_BUZZ or MSG_ANSWER frame
+ * \return - the round, counting from 1, or 0 if the frame doesn't say
+ *           (clients older than DEADLINE_PROTOCOL_VERSION don't)
+ */
+int decode_round(const frame_t* frame) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  char answer[MAX_ANSWER_LENGTH];
+  if (frame->type == MSG_SELECT) {
+    get_u16(&reader);
+  } else if (frame->type == MSG_ANSWER) {
+    get_u8(&reader);
+    get_str(&reader, answer, MAX_ANSWER_LENGTH);
+  }
+  if (reader.left < 4) return 0;
+  return get_u32(&reader);
+}
+
+/**
+ * Decodes the result of a round
+ *
+ * \param frame - a MSG_RESULT frame
+ * \param result - set to the decoded result
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_result(const frame_t* frame, answer_t* result) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  memset(result, 0, sizeof(answer_t));
+  result->id = get_u8(&reader);
+  result->did_answer = get_u8(&reader);
+  get_str(&reader, result->answer, MAX_ANSWER_LENGTH);
+  return reader.ok;
+}
+
+/**
+ * Decodes a ping
+ *
+ * \param frame - a MSG_PING frame
+ * \param sent - set to the server time carried by the ping
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_ping(const frame_t* frame, int64_t* sent) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *sent = get_u64(&reader);
+  return reader.ok;
+}
+
+/**
+ * Decodes the answer to a ping
+ *
+ * \param frame - a MSG_PONG frame
+ * \param sent - set to the server time carried by the ping
+ * \param received - set to the client time the ping arrived
+ * \param replied - set to the client time the pong was sent
+ * \return - boolean, True if the frame was well formed
+ */
+int decode_pong(const frame_t* frame, int64_t* sent, int64_t* received, int64_t* replied) {
+  wire_reader_t reader;
+  reader_init(&reader, frame);
+  *sent = get_u64(&reader);
+  *received = get_u64(&reader);
+  *replied = get_u64(&reader);
+  return reader.ok;
+}
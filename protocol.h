@@ -0,0 +1,190 @@
+#ifndef __PROTOCOL__
+#define __PROTOCOL__
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game_structs.h"
+
+/*
+  Every message between client and server is sent as a frame:
+
+    +--------+--------+-----------------+-----------------+
+    |  type  | flags  |  payload length |     payload     |
+    | 1 byte | 1 byte | 2 bytes (BE)    | length bytes    |
+    +--------+--------+-----------------+-----------------+
+
+  Integers in payloads are big-endian and strings are a 2 byte length
+  followed by that many bytes (no NUL terminator). Receivers skip frames of
+  types they don't know and ignore payload bytes past the fields they know,
+  so new messages and new trailing fields can be added without breaking
+  older peers. The version each side speaks is exchanged in MSG_HELLO and
+  MSG_WELCOME.
+*/
+
+// Version of the protocol spoken by this code, and the oldest one still
+// understood by it
+#define PROTOCOL_VERSION 8
+#define MIN_PROTOCOL_VERSION 4
+// First version whose clients answer MSG_PING
+#define PING_PROTOCOL_VERSION 5
+// First version whose clients can ask for room settings in MSG_HELLO and
+// play on boards of any size; older clients are only seated in rooms with
+// the default settings
+#define CONFIG_PROTOCOL_VERSION 6
+// First version whose clients get a session token in MSG_WELCOME and can
+// get their seat back with it after losing their connection
+#define RESUME_PROTOCOL_VERSION 7
+// First version whose clients tag their picks, buzzes and answers with the
+// round they are for, and give up on a phase of the round on their own
+// before the server does
+#define DEADLINE_PROTOCOL_VERSION 8
+// How long the server holds the seat of a player who lost their connection
+// in the middle of a game before giving up on the game
+#define RECONNECT_GRACE_MS 30000
+
+// Deadlines of the phases of a round. Once one passes the server acts for
+// the players it's still waiting on: it picks a question for the player
+// whose turn it is, and takes anyone who hasn't answered as not buzzing in.
+// Anything they send for the round after that is dropped.
+#define SELECT_TIMEOUT_MS 30000  // to pick the question, from the start of the round
+#define QUESTION_READ_MS 3000    // to read the question before buzzing opens
+#define BUZZ_GRACE_MS 1000       // for a buzz made in time to reach the server
+#define ANSWER_TIMEOUT_MS 20000  // to type the answer, once buzzing closes
+// How long the server waits on each message of a client joining a room
+#define JOIN_TIMEOUT_MS 10000
+
+#define FRAME_HEADER_SIZE 4
+#define MAX_FRAME_PAYLOAD 65535
+// Largest frame a client ever needs to send the server
+#define MAX_CLIENT_FRAME_SIZE 256
+
+// Bit standing for a message type in a set of types
+#define MSG_BIT(type) (1u << (type))
+
+// Types of messages
+enum message_type {
+  MSG_HELLO = 1,     // client -> server: protocol version, username and
+                     // the room settings the player wants
+  MSG_WELCOME = 2,   // server -> client: protocol version, player id, the
+                     // settings of the room they were seated in and the
+                     // token to resume the session with
+  MSG_ERROR = 3,     // server -> client: why the server is hanging up
+  MSG_BOARD = 4,     // server -> client: the whole game state
+  MSG_DELTA = 5,     // server -> client: what changed in the last round
+  MSG_SELECT = 6,    // client -> server: the question the player picked
+                     // and the round it's for
+  MSG_QUESTION = 7,  // server -> client: the question picked for the round
+  MSG_ANSWER = 8,    // client -> server: answer to the question and the
+                     // round it's for
+  MSG_RESULT = 9,    // server -> client: the results of the round
+  MSG_BUZZ = 10,     // client -> server: the player buzzed in, sent the
+                     // moment they do so the server can time it; the
+                     // round it's for
+  MSG_PING = 11,     // server -> client: server time, to be echoed back
+  MSG_PONG = 12,     // client -> server: the echoed time, and when the
+                     // client received the ping and answered it
+  MSG_RESUME = 13,   // client -> server: sent instead of MSG_HELLO by a
+                     // client coming back after losing its connection;
+                     // protocol version and session token
+  MSG_RESUMED = 14,  // server -> client: everything the client needs to
+                     // pick the game up where it is
+  NUM_MESSAGE_TYPES  // one past the last known type
+};
+
+// Bytes read and written by recv_frame and send_buf since the program
+// started, over every connection; others reading or writing frames may add
+// to them
+extern uint64_t wire_bytes_received;
+extern uint64_t wire_bytes_sent;
+
+/**
+ * Where a player's game stands as they get their seat back, sent along
+ * with the whole board in MSG_RESUMED
+ */
+typedef struct resume_state {
+  int id;               // the player's id in their game
+  room_config_t config; // the settings of the room
+  uint64_t token;       // the token to resume the session with next time
+  int col;              // the question of the current round, -1 if the
+  int row;              // player whose turn it is hasn't picked it yet
+  int answered;         // boolean, whether the player's answer to it is in
+} resume_state_t;
+
+/**
+ * A growable buffer that messages are encoded into
+ */
+typedef struct wire_buf {
+  uint8_t* data;
+  size_t len;
+  size_t cap;
+} wire_buf_t;
+
+/**
+ * A single frame received from a peer. The payload points into the buffer
+ * it was received in.
+ */
+typedef struct frame {
+  int type;
+  const uint8_t* payload;
+  size_t length;
+} frame_t;
+
+/**
+ * Buffered reader that splits the data read from a socket into frames.
+ * Reads as much as is available at once, so several small messages sent
+ * back to back only take a single read.
+ */
+typedef struct frame_stream {
+  int fd;
+  uint8_t* buf;
+  size_t cap;
+  size_t len;       // bytes of buf holding data
+  size_t consumed;  // bytes of buf belonging to frames already returned
+  int64_t last_read_time; // monotonic_ns() when data last arrived
+  int timer_fd;     // a timerfd to stop waiting for data at once it
+                    // expires, -1 to wait as long as it takes
+} frame_stream_t;
+
+void wire_buf_init(wire_buf_t* buf);
+void wire_buf_free(wire_buf_t* buf);
+void wire_buf_reserve(wire_buf_t* buf, size_t extra);
+
+int frame_parse(const uint8_t* data, size_t len, size_t max_frame, frame_t* frame);
+
+void frame_stream_init(frame_stream_t* stream, int fd, size_t max_frame);
+void frame_stream_free(frame_stream_t* stream);
+int recv_frame(frame_stream_t* stream, frame_t* frame);
+int recv_message(frame_stream_t* stream, unsigned types, frame_t* frame);
+int send_buf(int fd, const wire_buf_t* buf);
+int negotiate_version(int peer_version);
+int set_nodelay(int fd);
+
+void encode_hello(wire_buf_t* buf, const char* name, const room_config_t* config);
+void encode_welcome(wire_buf_t* buf, int version, int id, const room_config_t* config, uint64_t token);
+void encode_resume(wire_buf_t* buf, uint64_t token);
+void encode_resumed(wire_buf_t* buf, const resume_state_t* state, const game_t* game, int version);
+void encode_error(wire_buf_t* buf, const char* message);
+void encode_board(wire_buf_t* buf, const game_t* game, int version);
+void encode_delta(wire_buf_t* buf, const game_delta_t* delta, int num_players);
+void encode_coords(wire_buf_t* buf, int type, int col, int row, int round);
+void encode_answer(wire_buf_t* buf, const answer_t* ans, int round);
+void encode_buzz(wire_buf_t* buf, int round);
+void encode_ping(wire_buf_t* buf, int64_t sent);
+void encode_pong(wire_buf_t* buf, int64_t sent, int64_t received, int64_t replied);
+void encode_result(wire_buf_t* buf, const answer_t* result);
+
+int decode_hello(const frame_t* frame, int* version, char* name, room_config_t* config);
+int decode_welcome(const frame_t* frame, int* version, int* id, room_config_t* config, uint64_t* token);
+int decode_resume(const frame_t* frame, int* version, uint64_t* token);
+int decode_resumed(const frame_t* frame, resume_state_t* state, game_t* game, int* version);
+int decode_error(const frame_t* frame, char* message, size_t size);
+int decode_board(const frame_t* frame, game_t* game, int* version);
+int decode_delta(const frame_t* frame, game_delta_t* delta);
+int decode_coords(const frame_t* frame, int* col, int* row);
+int decode_answer(const frame_t* frame, answer_t* ans);
+int decode_round(const frame_t* frame);
+int decode_result(const frame_t* frame, answer_t* result);
+int decode_ping(const frame_t* frame, int64_t* sent);
+int decode_pong(const frame_t* frame, int64_t* sent, int64_t* received, int64_t* replied);
+
+#endif
@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "question_pack.h"
+#include "game.h"
+#include "deps/uthash.h"
+
+/**
+ * The strings of a pack being written, stored back to back with their
+ * terminators
+ */
+typedef struct string_table {
+  char* data;
+  size_t len;
+  size_t cap;
+} string_table_t;
+
+/**
+ * Adds a string to the end of a string table
+ *
+ * \param table - the table to add to
+ * \param string - the string to add
+ * \return - the offset of the string in the table
+ */
+uint32_t add_pack_string(string_table_t* table, const char* string) {
+  size_t len = strlen(string) + 1;
+  if (table->len + len > table->cap) {
+    table->cap = table->cap * 2 + len;
+    table->data = realloc(table->data, table->cap);
+    if (table->data == NULL) {
+      perror("realloc failed");
+      exit(2);
+    }
+  }
+  uint32_t offset = table->len;
+  memcpy(table->data + table->len, string, len);
+  table->len += len;
+  return offset;
+}
+
+/**
+ * Writes all the categories parsed into the category hashmap out as a
+ * pack. filter_categories must have been called first, so that every
+ * category is full.
+ *
+ * \param path - the file to write the pack to
+ * \return - boolean, True if the pack was written, else False
+ */
+int write_question_pack(const char* path) {
+  uint32_t num_categories = HASH_COUNT(category_hashmap);
+  uint32_t num_clues = num_categories * NUM_QUESTIONS_PER_CATEGORY;
+  pack_category_t* categories = calloc(num_categories, sizeof(pack_category_t));
+  pack_clue_t* clues = calloc(num_clues, sizeof(pack_clue_t));
+  string_table_t strings = {NULL, 0, 0};
+  if (categories == NULL || clues == NULL) {
+    perror("calloc failed");
+    exit(2);
+  }
+
+  // keep the order of the hashmap, so a board is made of the same
+  // neighbouring categories as with the JSON file
+  uint32_t cat = 0;
+  for (category_t* c = category_hashmap; c != NULL; c = c->hh.next, cat++) {
+    categories[cat].title = add_pack_string(&strings, c->title);
+    categories[cat].first_clue = cat * NUM_QUESTIONS_PER_CATEGORY;
+    for (int q = 0; q < NUM_QUESTIONS_PER_CATEGORY; q++) {
+      pack_clue_t* clue = &clues[categories[cat].first_clue + q];
+      clue->value = c->questions[q].value;
+      clue->question = add_pack_string(&strings, c->questions[q].question);
+      clue->answer = add_pack_string(&strings, c->questions[q].answer);
+      clue->normalized_answer = add_pack_string(&strings, c->questions[q].normalized_answer);
+    }
+  }
+
+  pack_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+  header.version = PACK_VERSION;
+  header.byte_order = PACK_BYTE_ORDER;
+  header.num_categories = num_categories;
+  header.num_clues = num_clues;
+  header.categories_offset = sizeof(header);
+  header.clues_offset = header.categories_offset + num_categories * sizeof(pack_category_t);
+  header.strings_offset = header.clues_offset + num_clues * sizeof(pack_clue_t);
+  header.strings_size = strings.len;
+
+  int success = 0;
+  FILE* out = fopen(path, "wb");
+  if (out == NULL) {
+    perror("Could not create the pack");
+  } else {
+    success = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(categories, sizeof(pack_category_t), num_categories, out) == num_categories &&
+              fwrite(clues, sizeof(pack_clue_t), num_clues, out) == num_clues &&
+              fwrite(strings.data, 1, strings.len, out) == strings.len;
+    if (fclose(out) != 0) success = 0;
+    if (!success) perror("Could not write the pack");
+  }
+
+  free(categories);
+  free(clues);
+  free(strings.data);
+  return success;
+}
+
+/**
+ * Maps a pack into memory and checks that its tables fit in the file.
+ * The clues themselves are only checked as they are read, so opening a
+ * pack doesn't touch every page of it.
+ *
+ * \param path - the pack file to open
+ * \param pack - filled in with the mapped pack
+ * \return - 1 if the pack was opened, 0 if the file is not a pack at all,
+ *           -1 if it could not be read or is a broken pack
+ */
+int open_question_pack(const char* path, question_pack_t* pack) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Could not open the questions file");
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    perror("Could not read the questions file");
+    close(fd);
+    return -1;
+  }
+
+  // anything without the magic is left for the JSON parser
+  char magic[sizeof(((pack_header_t*)0)->magic)];
+  if (info.st_size < (off_t)sizeof(pack_header_t) ||
+      pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+      memcmp(magic, PACK_MAGIC, sizeof(magic)) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  void* data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("Could not map the question pack");
+    return -1;
+  }
+
+  const pack_header_t* header = data;
+  uint64_t size = info.st_size;
+  if (header->version != PACK_VERSION || header->byte_order != PACK_BYTE_ORDER) {
+    fprintf(stderr, "%s was made by a different version or kind of machine; "
+            "compile it again with pack_questions\n", path);
+    munmap(data, size);
+    return -1;
+  }
+  if (header->num_clues != (uint64_t)header->num_categories * NUM_QUESTIONS_PER_CATEGORY ||
+      header->categories_offset > size ||
+      header->num_categories > (size - header->categories_offset) / sizeof(pack_category_t) ||
+      header->clues_offset > size ||
+      header->num_clues > (size - header->clues_offset) / sizeof(pack_clue_t) ||
+      header->strings_offset > size || header->strings_size == 0 ||
+      header->strings_size > size - header->strings_offset ||
+      ((const char*)data)[header->strings_offset + header->strings_size - 1] != '\0') {
+    fprintf(stderr, "%s is not a valid question pack\n", path);
+    munmap(data, size);
+    return -1;
+  }
+
+  pack->data = data;
+  pack->size = size;
+  pack->header = header;
+  pack->categories = (const pack_category_t*)(pack->data + header->categories_offset);
+  pack->clues = (const pack_clue_t*)(pack->data + header->clues_offset);
+  pack->strings = pack->data + header->strings_offset;
+  return 1;
+}
+
+/**
+ * Copies a string out of a pack's string table, truncating it to fit
+ *
+ * \param pack - the pack the string is in
+ * \param offset - where the string starts in the string table
+ * \param dest - the buffer to copy the string into
+ * \param size - the size of dest
+ */
+void copy_pack_string(const question_pack_t* pack, uint32_t offset, char* dest, size_t size) {
+  // the table ends with a terminator, so any offset inside it is a string
+  const char* string = offset < pack->header->strings_size ? pack->strings + offset : "";
+  strncpy(dest, string, size-1);
+  dest[size-1] = '\0';
+}
+
+/**
+ * Reads a category and its clues out of a pack
+ *
+ * \param pack - the pack to read from
+ * \param index - which category to read; must be less than the number of
+ *                categories in the pack
+ * \param category - filled in with the category
+ */
+void read_pack_category(const question_pack_t* pack, int index, category_t* category) {
+  const pack_category_t* pack_category = &pack->categories[index];
+  memset(category, 0, sizeof(category_t));
+  copy_pack_string(pack, pack_category->title, category->title, MAX_ANSWER_LENGTH);
+  category->num_questions = NUM_QUESTIONS_PER_CATEGORY;
+
+  for (int q = 0; q < NUM_QUESTIONS_PER_CATEGORY; q++) {
+    // first_clue isn't trusted any more than the strings are
+    uint32_t clue_index = pack_category->first_clue + q;
+    if (clue_index >= pack->header->num_clues) clue_index = index * NUM_QUESTIONS_PER_CATEGORY + q;
+    const pack_clue_t* clue = &pack->clues[clue_index];
+    square_t* square = &category->questions[q];
+    square->value = clue->value;
+    square->is_answered = 0;
+    copy_pack_string(pack, clue->question, square->question, MAX_QUESTION_LENGTH);
+    copy_pack_string(pack, clue->answer, square->answer, MAX_ANSWER_LENGTH);
+    copy_pack_string(pack, clue->normalized_answer, square->normalized_answer, MAX_ANSWER_LENGTH);
+  }
+}
+
+/**
+ * Unmaps a pack opened with open_question_pack
+ *
+ * \param pack - the pack to close
+ */
+void close_question_pack(question_pack_t* pack) {
+  munmap((void*)pack->data, pack->size);
+  memset(pack, 0, sizeof(question_pack_t));
+}
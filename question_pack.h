@@ -0,0 +1,68 @@
+#ifndef __QUESTION_PACK__
+#define __QUESTION_PACK__
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game_structs.h"
+
+// First bytes of every pack file
+#define PACK_MAGIC "TJQPACK"
+#define PACK_VERSION 1
+// Written in the header in the byte order of the machine that compiled the
+// pack, so a pack from a machine of the other byte order is refused
+#define PACK_BYTE_ORDER 0x01020304u
+
+/**
+ * Start of a pack file. Everything else is found through the offsets here,
+ * which count bytes from the start of the file.
+ */
+typedef struct pack_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t num_categories;
+  uint32_t num_clues;
+  uint64_t categories_offset;
+  uint64_t clues_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+} pack_header_t;
+
+/**
+ * A full category; its clues are the NUM_QUESTIONS_PER_CATEGORY clues
+ * starting at first_clue. Strings are offsets into the string table.
+ */
+typedef struct pack_category {
+  uint32_t title;
+  uint32_t first_clue;
+} pack_category_t;
+
+/**
+ * A single clue, with its answer already normalized for grading
+ */
+typedef struct pack_clue {
+  int32_t value;
+  uint32_t question;
+  uint32_t answer;
+  uint32_t normalized_answer;
+} pack_clue_t;
+
+/**
+ * A pack mapped into memory read-only, so every server process using the
+ * same pack shares its pages
+ */
+typedef struct question_pack {
+  const char* data;
+  size_t size;
+  const pack_header_t* header;
+  const pack_category_t* categories;
+  const pack_clue_t* clues;
+  const char* strings;
+} question_pack_t;
+
+int write_question_pack(const char* path);
+int open_question_pack(const char* path, question_pack_t* pack);
+void read_pack_category(const question_pack_t* pack, int index, category_t* category);
+void close_question_pack(question_pack_t* pack);
+
+#endif
@@ -0,0 +1,351 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "deps/uthash.h"
+#include "event_log.h"
+#include "game.h"
+#include "room.h"
+
+/**
+ * A room being replayed, found by the id it had on the server
+ */
+typedef struct replay_room {
+  int id;
+  room_t* room;
+  int arbitration;  // how the server ranked buzzes in the room
+  int64_t buzz_times[MAX_NUM_PLAYERS]; // this round's buzzes, -1 if none
+  int answers_in;   // answers submitted this round
+  int round;        // rounds started so far
+  int round_open;   // boolean, set from grading a round until it's checked
+  int winner;       // who won the round when replayed, -1 if no one
+  int logged_winner; // who the server said won the round, -1 if no one
+  UT_hash_handle hh;
+} replay_room_t;
+
+/**
+ * What a replay found
+ */
+typedef struct replay_stats {
+  long games;      // games replayed to the end
+  long rounds;
+  long mismatches; // outcomes the replay didn't agree with
+  long skipped;    // events of games that weren't started in the log
+} replay_stats_t;
+
+replay_room_t* replay_rooms = NULL;
+replay_stats_t stats;
+int narrated_room = -1; // the room whose game is told round by round, or -1
+int report = 1;         // boolean, cleared once mismatches have been reported
+
+/**
+ * Reports an outcome that came out differently when replayed
+ *
+ * \param replay - the room it happened in
+ * \param format - printf format of what was different
+ */
+void mismatch(replay_room_t* replay, const char* format, ...) {
+  stats.mismatches++;
+  if (!report) return;
+  printf("Room %d round %d: ", replay->id, replay->round);
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+}
+
+/**
+ * Checks the winner of a room's last round against the one the server
+ * logged, once every event of the round has been seen
+ *
+ * \param replay - the room whose round is over
+ */
+void check_round(replay_room_t* replay) {
+  if (!replay->round_open) return;
+  replay->round_open = 0;
+  if (replay->winner != replay->logged_winner) {
+    mismatch(replay, "player %d won, but the server said %d", replay->winner, replay->logged_winner);
+  }
+}
+
+/**
+ * Starts replaying the game of a room
+ *
+ * \param event - the EVENT_GAME_STARTED of the room
+ */
+void start_game(const event_t* event) {
+  // a board made from other questions wouldn't be the one that was played
+  if ((uint32_t)event->args[7] != questions_checksum()) {
+    fprintf(stderr, "Room %d was played with a different question file; skipping it\n", event->room);
+    return;
+  }
+  room_config_t config = {event->args[0], event->args[1], event->args[2], event->args[3]};
+  replay_room_t* replay = calloc(1, sizeof(replay_room_t));
+  if (replay == NULL) {
+    perror("Unable to allocate room");
+    exit(2);
+  }
+  replay->id = event->room;
+  replay->room = room_create(&config, (unsigned int)event->args[4]);
+  replay->room->id = event->room;
+  replay->room->game.num_players = config.num_players;
+  replay->arbitration = event->args[5];
+  HASH_ADD_INT(replay_rooms, id, replay);
+
+  if (replay->id == narrated_room) {
+    printf("Room %d: %d players on a %dx%d board, %s buzzes win\n", replay->id, config.num_players,
+           config.num_categories, config.num_rows,
+           replay->arbitration == ARBITRATE_LATENCY ? "latency compensated" : "first arriving");
+  }
+}
+
+/**
+ * Ends the replay of a room's game
+ *
+ * \param replay - the room whose game is over
+ */
+void end_game(replay_room_t* replay) {
+  check_round(replay);
+  game_t* game = &replay->room->game;
+  if (!game->is_over) mismatch(replay, "the server ended the game early");
+  if (replay->id == narrated_room) {
+    printf("Final scores:");
+    for (int player = 0; player < game->num_players; player++) {
+      printf(" %d", game->players[player].score);
+    }
+    printf("\n");
+  }
+  stats.games++;
+  HASH_DEL(replay_rooms, replay);
+  room_destroy(replay->room);
+  free(replay);
+}
+
+/**
+ * Replays a single event, feeding inputs to the same game logic the server
+ * runs and checking its outcomes against the ones the server logged
+ *
+ * \param event - the event to replay
+ */
+void replay_event(const event_t* event) {
+  if (event->type == EVENT_GAME_STARTED) {
+    start_game(event);
+    return;
+  }
+  replay_room_t* replay;
+  int id = event->room;
+  HASH_FIND_INT(replay_rooms, &id, replay);
+  if (replay == NULL) {
+    stats.skipped++;
+    return;
+  }
+  room_t* room = replay->room;
+  game_t* game = &room->game;
+  int player = event->player;
+  int narrate = replay->id == narrated_room;
+  if (player >= room->config.num_players) {
+    mismatch(replay, "event for player %d, who has no seat", player);
+    return;
+  }
+
+  switch (event->type) {
+  case EVENT_QUESTION_SELECTED: {
+    check_round(replay);
+    replay->round++;
+    if (player != game->id_of_player_turn) {
+      mismatch(replay, "player %d picked, but it was %d's turn", player, game->id_of_player_turn);
+    }
+    int col = event->args[0];
+    int row = event->args[1];
+    int value = col >= 0 && col < game->num_categories && row >= 0 && row < game->num_rows ?
+      game->categories[col].questions[row].value : -1;
+    if (!select_square(room, col, row)) {
+      mismatch(replay, "question %d,%d can't be picked", col, row);
+      return;
+    }
+    if (value != event->args[2]) mismatch(replay, "question was worth %d, not %d", value, event->args[2]);
+    for (int seat = 0; seat < room->config.num_players; seat++) replay->buzz_times[seat] = -1;
+    replay->answers_in = 0;
+    room->question_sent = event->time;
+    // the server only logged the buzzes that made it in time
+    room->buzz_deadline = INT64_MAX;
+    if (narrate) {
+      square_t* square = &game->categories[col].questions[row];
+      printf("Round %d: player %d picked %s for $%d\n  Question: %s\n  Answer: %s\n", replay->round,
+             player, game->categories[col].title, value, square->question, square->answer);
+    }
+    break;
+  }
+
+  case EVENT_BUZZ:
+    record_buzz(room, player, &replay->buzz_times[player], event->time);
+    if (narrate) printf("  player %d buzzed at +%.3f ms\n", player, (event->time - room->question_sent) / 1e6);
+    break;
+
+  case EVENT_ANSWER_SUBMITTED: {
+    // rank buzzes the way the server did, with the compensation it used
+    buzz_arbitration = replay->arbitration;
+    room->latency[player].rtt = event->args[1] > 0 ? event->args[1] : -1;
+    answer_t ans;
+    memset(&ans, 0, sizeof(answer_t));
+    ans.buzz_time = replay->buzz_times[player];
+    ans.did_answer = event->args[0];
+    ans.id = player;
+    memcpy(ans.answer, event->text, MAX_ANSWER_LENGTH);
+    ans.answer[MAX_ANSWER_LENGTH - 1] = '\0';
+    if (!submit_answer(room, &ans)) {
+      mismatch(replay, "player %d answered twice", player);
+      return;
+    }
+    if (narrate && ans.did_answer) {
+      printf("  player %d answered \"%s\" (%.3f ms compensation)\n", player, ans.answer, event->args[1] / 1e6);
+    }
+
+    // grade once every answer is in, like the server
+    if (++replay->answers_in == room->config.num_players) {
+      answer_t result;
+      replay->winner = finish_round(room, &result);
+      replay->logged_winner = -1;
+      replay->round_open = 1;
+      stats.rounds++;
+      if (narrate) {
+        if (replay->winner == -1) printf("  No one got it\n");
+        else printf("  player %d won the round\n", replay->winner);
+      }
+    }
+    break;
+  }
+
+  case EVENT_ANSWER_GRADED: {
+    // the grade comes out the same unless grading has changed since
+    char answer[MAX_ANSWER_LENGTH];
+    memcpy(answer, event->text, MAX_ANSWER_LENGTH);
+    answer[MAX_ANSWER_LENGTH - 1] = '\0';
+    int is_correct = check_answer(answer, room->current_round.normalized_answer);
+    if (is_correct != event->args[0]) {
+      mismatch(replay, "\"%s\" graded %d, but the server graded it %d", answer, is_correct, event->args[0]);
+    }
+    break;
+  }
+
+  case EVENT_SCORE_CHANGED:
+    replay->logged_winner = player;
+    if (game->players[player].score != event->args[0]) {
+      mismatch(replay, "player %d has %d points, but the server said %d", player,
+               game->players[player].score, event->args[0]);
+    }
+    break;
+
+  case EVENT_GAME_OVER:
+    end_game(replay);
+    break;
+  }
+}
+
+/**
+ * Reads every event of a log into memory
+ *
+ * \param path - the event log
+ * \param num_events - set to the number of events read
+ * \return - the events
+ */
+event_t* read_events(const char* path, long* num_events) {
+  FILE* input = fopen(path, "rb");
+  if (input == NULL) {
+    perror("Could not open the event log");
+    exit(2);
+  }
+  if (!read_event_log_header(input)) exit(2);
+  long start = ftell(input);
+  fseek(input, 0, SEEK_END);
+  *num_events = (ftell(input) - start) / sizeof(event_t);
+  fseek(input, start, SEEK_SET);
+
+  event_t* events = malloc(*num_events * sizeof(event_t) + 1);
+  if (events == NULL) {
+    perror("Unable to allocate events");
+    exit(2);
+  }
+  *num_events = fread(events, sizeof(event_t), *num_events, input);
+  fclose(input);
+  return events;
+}
+
+/**
+ * Replays the games recorded in an event log written by the server (with
+ * -o), running them through the server's own game logic as fast as it
+ * goes. Boards are rebuilt from the seed of each room, so the replay needs
+ * the questions file the server had. Every outcome that comes out
+ * differently is reported, so a disputed round can be checked and a change
+ * to the game logic can be tried against recorded games.
+ *
+ * Usage: ./replay [-q questions_file] [-r room] [-n times] event_log
+ *   -r tells the game of one room round by round
+ *   -n replays the log that many times, to time the game logic
+ */
+int main(int argc, char** argv) {
+  char* questions_path = "questions.json";
+  int times = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "q:r:n:")) != -1) {
+    switch (opt) {
+    case 'q':
+      questions_path = optarg;
+      break;
+    case 'r':
+      narrated_room = atoi(optarg);
+      break;
+    case 'n':
+      times = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-q questions_file] [-r room] [-n times] event_log\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (optind != argc - 1 || times < 1) {
+    fprintf(stderr, "Usage: %s [-q questions_file] [-r room] [-n times] event_log\n", argv[0]);
+    exit(1);
+  }
+
+  if (!load_questions(questions_path)) exit(2);
+  long num_events;
+  event_t* events = read_events(argv[optind], &num_events);
+
+  // only the first time through reports anything
+  replay_stats_t first;
+  int64_t start = monotonic_ns();
+  for (int pass = 0; pass < times; pass++) {
+    memset(&stats, 0, sizeof(stats));
+    for (long i = 0; i < num_events; i++) replay_event(&events[i]);
+
+    // games the log ends in the middle of
+    replay_room_t *replay, *temp;
+    HASH_ITER(hh, replay_rooms, replay, temp) {
+      HASH_DEL(replay_rooms, replay);
+      room_destroy(replay->room);
+      free(replay);
+    }
+    if (pass == 0) {
+      first = stats;
+      report = 0;
+      narrated_room = -1;
+    }
+  }
+  double seconds = (monotonic_ns() - start) / 1e9;
+
+  printf("Replayed %ld games (%ld rounds) from %ld events; %ld mismatches",
+         first.games, first.rounds, num_events, first.mismatches);
+  if (first.skipped > 0) printf(", %ld events of games started before the log or played with other questions", first.skipped);
+  printf("\n");
+  printf("%.3f s for %d replays: %.0f rounds/s, %.0f rounds/min\n", seconds, times,
+         first.rounds * times / seconds, first.rounds * times / seconds * 60);
+
+  free(events);
+  clean_up_game();
+  return first.mismatches > 0;
+}
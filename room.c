@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "room.h"
+#include "game.h"
+#include "clock.h"
+#include "event_log.h"
+#include "journal.h"
+#include "metrics.h"
+#include "protocol.h"
+
+// Lobby variables
+pthread_mutex_t lobby_lock = PTHREAD_MUTEX_INITIALIZER;
+room_t* rooms_head = NULL;    // every room that still has players in it
+int next_room_id = 0;
+// phase times of every room that has closed
+histogram_t closed_phase_times[NUM_PHASES];
+
+// How phases are named when their times are printed
+static const char* phase_names[NUM_PHASES] = {
+  [PHASE_SELECT] = "select",
+  [PHASE_BUZZ_WINDOW] = "buzz window",
+  [PHASE_READ_ANSWER] = "read answer",
+  [PHASE_GRADE] = "grade",
+  [PHASE_BROADCAST] = "broadcast",
+  [PHASE_ROUND] = "round",
+};
+
+/**
+ * Clamps a single room setting to its allowed range, with 0 standing for
+ * the default
+ *
+ * \param setting - the setting to clamp
+ * \param default_value - the value used for 0
+ * \param min - the smallest allowed value
+ * \param max - the largest allowed value
+ */
+void clamp_setting(int* setting, int default_value, int min, int max) {
+  if (*setting == 0) *setting = default_value;
+  if (*setting < min) *setting = min;
+  if (*setting > max) *setting = max;
+}
+
+/**
+ * Replaces the unset settings of a room config with the defaults and
+ * brings the rest within what the server supports, so that configs asking
+ * for the same room compare equal
+ *
+ * \param config - the config to normalize
+ */
+void normalize_room_config(room_config_t* config) {
+  int max_categories = count_categories() < MAX_CATEGORIES ? count_categories() : MAX_CATEGORIES;
+  clamp_setting(&config->num_players, DEFAULT_NUM_PLAYERS, 1, MAX_NUM_PLAYERS);
+  clamp_setting(&config->num_categories, DEFAULT_NUM_CATEGORIES, 1, max_categories);
+  clamp_setting(&config->num_rows, DEFAULT_NUM_ROWS, 1, NUM_QUESTIONS_PER_CATEGORY);
+  clamp_setting(&config->buzz_timeout_ms, DEFAULT_BUZZ_TIMEOUT_MS,
+                MIN_BUZZ_TIMEOUT_MS, MAX_BUZZ_TIMEOUT_MS);
+}
+
+/**
+ * Allocates memory, exiting if there is none left
+ *
+ * \param count - the number of items to allocate
+ * \param size - the size of each item
+ * \return - the zeroed memory
+ */
+void* room_calloc(size_t count, size_t size) {
+  void* mem = calloc(count, size);
+  if (mem == NULL) {
+    perror("Unable to allocate room");
+    exit(2);
+  }
+  return mem;
+}
+
+/**
+ * Allocates a new room with a freshly generated board. The board and every
+ * per-player array are sized to the room's config.
+ *
+ * \param config - the normalized settings of the room
+ * \param seed - seeds the board of the room
+ * \return room - the new room, with no players in it yet
+ */
+room_t* room_create(const room_config_t* config, unsigned int seed) {
+  room_t* room = room_calloc(1, sizeof(room_t));
+  int num_players = config->num_players;
+  room->id = next_room_id++;
+  metric_add(&metrics.rooms_opened, 1);
+  room->config = *config;
+  room->filling = 1;
+  room->seed = seed;
+  room->game = create_game(config, seed);
+  room->remaining_questions = config->num_categories * config->num_rows;
+
+  // aligned, so that the answer slots really are on separate cache lines
+  room->answers = aligned_alloc(CACHE_LINE_SIZE, num_players * sizeof(answer_slot_t));
+  if (room->answers == NULL) {
+    perror("Unable to allocate room");
+    exit(2);
+  }
+  memset(room->answers, 0, num_players * sizeof(answer_slot_t));
+  room->latency = room_calloc(num_players, sizeof(latency_t));
+  for (int player = 0; player < num_players; player++) {
+    latency_init(&room->latency[player]);
+  }
+  room->conns = room_calloc(num_players, sizeof(struct conn*));
+  room->sessions = room_calloc(num_players, sizeof(session_t));
+  for (int player = 0; player < num_players; player++) {
+    room->sessions[player].resume_fd = -1;
+  }
+
+  room->select_timer = -1;
+  room->answer_timer = -1;
+
+  pthread_mutex_init(&room->add_player_lock, NULL);
+  // time outs are measured on the monotonic clock, like the barrier's
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&room->session_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  barrier_init(&room->barrier, num_players);
+  return room;
+}
+
+/**
+ * Frees a room
+ *
+ * \param room - the room to free
+ */
+void room_destroy(room_t* room) {
+  pthread_mutex_destroy(&room->add_player_lock);
+  pthread_cond_destroy(&room->session_cond);
+  barrier_destroy(&room->barrier);
+  if (room->select_timer != -1) close(room->select_timer);
+  if (room->answer_timer != -1) close(room->answer_timer);
+  free_game(&room->game);
+  free(room->answers);
+  free(room->latency);
+  free(room->conns);
+  free(room->sessions);
+  free(room);
+}
+
+/**
+ * Finds a seat for a new player in a room that is still filling up with
+ * the same settings they asked for, opening a new room if there is none.
+ * Seats of games restored from the state directory are only given back
+ * by lobby_resume, to players showing their session token.
+ *
+ * \param config - the normalized settings the player asked for
+ * \param seat - set to the id the player has in the room
+ * \return room - the room the player was seated in
+ */
+room_t* lobby_join(const room_config_t* config, int* seat) {
+  pthread_mutex_lock(&lobby_lock);
+  room_t* room = rooms_head;
+  while (room != NULL &&
+         !(room->filling && room->restored_seats == 0 &&
+           memcmp(&room->config, config, sizeof(room_config_t)) == 0)) {
+    room = room->next;
+  }
+  int is_new = room == NULL;
+  if (is_new) {
+    room = room_create(config, rand());
+    room->next = rooms_head;
+    rooms_head = room;
+    printf("Room %d opened for %d players with a %dx%d board\n", room->id,
+           config->num_players, config->num_categories, config->num_rows);
+  }
+
+  *seat = room->seats_taken++;
+  room->refs++;
+  // once every seat is taken the room starts playing on its own
+  int is_full = room->seats_taken == config->num_players;
+  if (is_full) room->filling = 0;
+  pthread_mutex_unlock(&lobby_lock);
+
+  if (is_new && journal_fd != -1) {
+    journal_record_t record;
+    memset(&record, 0, sizeof(journal_record_t));
+    record.type = JOURNAL_ROOM_OPENED;
+    record.room = room->id;
+    record.config = *config;
+    record.seed = room->seed;
+    record.questions = questions_checksum();
+    journal_append(&record);
+  }
+
+  if (is_full && event_log != NULL) {
+    event_t event;
+    memset(&event, 0, sizeof(event_t));
+    event.time = monotonic_ns();
+    event.room = room->id;
+    event.type = EVENT_GAME_STARTED;
+    event.player = -1;
+    event.args[0] = config->num_players;
+    event.args[1] = config->num_categories;
+    event.args[2] = config->num_rows;
+    event.args[3] = config->buzz_timeout_ms;
+    event.args[4] = room->seed;
+    event.args[5] = buzz_arbitration;
+    event.args[6] = count_categories();
+    event.args[7] = questions_checksum();
+    log_event(&event);
+  }
+
+  return room;
+}
+
+/**
+ * Finds the seat a player coming back after losing their connection had.
+ * A seat in a game restored from the state directory is taken like a seat
+ * being joined; the player still has to be added to the game.
+ *
+ * \param token - the session token the player was given
+ * \param seat - set to the id the player has in the room
+ * \param restored - set to True if the seat is in a restored game that the
+ *                   player has to join again, else False
+ * \return room - the room the player had a seat in, with a reference held
+ *                for the caller, or NULL if there is none
+ */
+room_t* lobby_resume(uint64_t token, int* seat, int* restored) {
+  if (token == 0) return NULL;
+  pthread_mutex_lock(&lobby_lock);
+  for (room_t* room = rooms_head; room != NULL; room = room->next) {
+    for (int player = 0; player < room->config.num_players; player++) {
+      if (room->sessions[player].token != token) continue;
+      *seat = player;
+      *restored = (room->restored_seats & (1 << player)) != 0;
+      if (*restored) {
+        room->restored_seats &= ~(1 << player);
+        room->seats_taken++;
+        if (room->restored_seats == 0) room->filling = 0;
+      }
+      room->refs++;
+      pthread_mutex_unlock(&lobby_lock);
+      return room;
+    }
+  }
+  pthread_mutex_unlock(&lobby_lock);
+  return NULL;
+}
+
+/**
+ * Encodes everything a player getting their seat back needs to pick up the
+ * game where it is. Must be called with the room's add_player_lock held,
+ * so the question can't be picked while it's encoded.
+ *
+ * \param buf - the buffer to append the MSG_RESUMED frame to
+ * \param room - the room the player is back in
+ * \param seat - the id of the player
+ */
+void encode_room_state(wire_buf_t* buf, room_t* room, int seat) {
+  resume_state_t state;
+  state.id = seat;
+  state.config = room->config;
+  state.token = room->sessions[seat].token;
+  state.col = -1;
+  state.row = -1;
+  if (__atomic_load_n(&room->buzzing_open, __ATOMIC_ACQUIRE)) {
+    state.col = room->current_round.col;
+    state.row = room->current_round.row;
+  }
+  state.answered = __atomic_load_n(&room->answers[seat].round, __ATOMIC_ACQUIRE) ==
+    room->delta.version + 1;
+  encode_resumed(buf, &state, &room->game, room->delta.version);
+}
+
+/**
+ * Makes a session token that can't be guessed, so no one can take another
+ * player's seat
+ *
+ * \return - the new token; never 0
+ */
+uint64_t new_session_token() {
+  uint64_t token = 0;
+  while (token == 0) {
+    if (getrandom(&token, sizeof(token), 0) != sizeof(token)) {
+      token = (uint64_t)rand() << 32 ^ (uint64_t)rand() << 16 ^ rand() ^ monotonic_ns();
+    }
+  }
+  return token;
+}
+
+/**
+ * Brings back a game saved in the state directory, in a room that only
+ * seats its own players again, and only until lobby_give_up_restored is
+ * called. Must be called before any player joins.
+ *
+ * \param saved - the saved game; its players have all joined
+ */
+void restore_room(const room_snapshot_t* saved) {
+  room_t* room = room_create(&saved->config, saved->seed);
+  game_t* game = &room->game;
+  room->id = saved->id;
+  if (next_room_id <= room->id) next_room_id = room->id + 1;
+
+  // mark off the questions already answered
+  for (int col = 0; col < game->num_categories; col++) {
+    for (int row = 0; row < game->num_rows; row++) {
+      if (!saved->answered[col * game->num_rows + row]) continue;
+      game->categories[col].questions[row].is_answered = 1;
+      game->categories[col].questions[row].value = -1;
+      room->remaining_questions--;
+    }
+  }
+
+  // the players get their names and scores back once they join
+  for (int player = 0; player < room->config.num_players; player++) {
+    memcpy(game->players[player].name, saved->names[player], MAX_ANSWER_LENGTH);
+    game->players[player].name[MAX_ANSWER_LENGTH - 1] = '\0';
+    game->players[player].id = player;
+    game->players[player].score = saved->scores[player];
+    room->delta.scores[player] = saved->scores[player];
+    room->sessions[player].token = saved->tokens[player];
+  }
+  game->id_of_player_turn = saved->turn;
+  room->delta.version = saved->version;
+  room->delta.id_of_player_turn = saved->turn;
+  room->restored_seats = (1 << room->config.num_players) - 1;
+
+  pthread_mutex_lock(&lobby_lock);
+  room->next = rooms_head;
+  rooms_head = room;
+  pthread_mutex_unlock(&lobby_lock);
+  printf("Room %d restored at round %d; waiting for its players\n", room->id, saved->version + 1);
+}
+
+/**
+ * Gives up on the games restored from the state directory that are still
+ * waiting for some of their players. Their seats can't be taken back
+ * anymore. A room no one came back to is closed; the game of a room some
+ * of its players came back to is ended by give_up.
+ *
+ * \param give_up - ends the game in a room for the players in it; called
+ *                  with a reference to the room held
+ */
+void lobby_give_up_restored(void (*give_up)(room_t* room)) {
+  while (1) {
+    pthread_mutex_lock(&lobby_lock);
+    room_t* room = rooms_head;
+    while (room != NULL && room->restored_seats == 0) room = room->next;
+    if (room == NULL) {
+      pthread_mutex_unlock(&lobby_lock);
+      return;
+    }
+    room->restored_seats = 0;
+    room->filling = 0;
+    room->refs++;
+    int anyone_back = room->seats_taken > 0;
+    pthread_mutex_unlock(&lobby_lock);
+
+    fprintf(stderr, "Not every player came back to restored room %d; giving up its game\n", room->id);
+    if (anyone_back) give_up(room);
+    room_release(room);
+  }
+}
+
+/**
+ * Stops seating new players in a room that is still filling up, e.g. because
+ * one of its players left before the game started
+ *
+ * \param room - the room to close to new players
+ */
+void lobby_close(room_t* room) {
+  pthread_mutex_lock(&lobby_lock);
+  room->filling = 0;
+  pthread_mutex_unlock(&lobby_lock);
+}
+
+/**
+ * Detaches a player from their room. The last player to leave frees it.
+ *
+ * \param room - the room the player is leaving
+ */
+void room_release(room_t* room) {
+  pthread_mutex_lock(&lobby_lock);
+  room->refs--;
+  if (room->refs > 0) {
+    pthread_mutex_unlock(&lobby_lock);
+    return;
+  }
+
+  // unlink the empty room, keeping its phase times
+  room_t** link = &rooms_head;
+  while (*link != room) link = &(*link)->next;
+  *link = room->next;
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    histogram_merge(&closed_phase_times[phase], &room->phase_times[phase]);
+  }
+  pthread_mutex_unlock(&lobby_lock);
+
+  metric_add(&metrics.rooms_closed, 1);
+  if (journal_fd != -1) {
+    journal_record_t record;
+    memset(&record, 0, sizeof(journal_record_t));
+    record.type = JOURNAL_ROOM_CLOSED;
+    record.room = room->id;
+    journal_append(&record);
+  }
+  printf("Room %d closed\n", room->id);
+  room_destroy(room);
+}
+
+/**
+ * Records how long a phase of a round took in its room
+ *
+ * \param room - the room the round is played in
+ * \param phase - the round_phase that just ended
+ * \param start - when the phase started, from monotonic_ns()
+ * \return - the time the phase ended, from monotonic_ns()
+ */
+int64_t record_phase(room_t* room, int phase, int64_t start) {
+  int64_t now = monotonic_ns();
+  histogram_record(&room->phase_times[phase], now - start);
+  return now;
+}
+
+/**
+ * Prints a table of percentiles of the phase times in a set of histograms
+ *
+ * \param out - where to print the table
+ * \param title - what the histograms are of
+ * \param phase_times - a histogram for each round_phase
+ */
+void print_phase_table(FILE* out, const char* title, const histogram_t* phase_times) {
+  fprintf(out, "%-16s %9s %10s %10s %10s %10s\n", title, "count", "p50 ms", "p99 ms", "p99.9 ms", "max ms");
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    const histogram_t* times = &phase_times[phase];
+    fprintf(out, "  %-14s %9llu %10.3f %10.3f %10.3f %10.3f\n", phase_names[phase],
+            (unsigned long long)times->total, histogram_percentile(times, 50) / 1e6,
+            histogram_percentile(times, 99) / 1e6, histogram_percentile(times, 99.9) / 1e6,
+            times->max / 1e6);
+  }
+}
+
+/**
+ * Adds up the phase times of every round the server has played, in rooms
+ * that have closed and in the rooms still being played in
+ *
+ * \param phase_times - filled in with a histogram for each round_phase
+ */
+void collect_phase_times(histogram_t* phase_times) {
+  pthread_mutex_lock(&lobby_lock);
+  memcpy(phase_times, closed_phase_times, sizeof(closed_phase_times));
+  for (room_t* room = rooms_head; room != NULL; room = room->next) {
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+      histogram_merge(&phase_times[phase], &room->phase_times[phase]);
+    }
+  }
+  pthread_mutex_unlock(&lobby_lock);
+}
+
+/**
+ * Prints percentiles of how long each phase of a round has taken: for each
+ * room being played in, and for every round the server has played
+ *
+ * \param out - where to print the percentiles
+ */
+void print_phase_times(FILE* out) {
+  char title[32];
+  pthread_mutex_lock(&lobby_lock);
+  for (room_t* room = rooms_head; room != NULL; room = room->next) {
+    // rooms still filling up have nothing to show
+    if (room->phase_times[PHASE_SELECT].total == 0) continue;
+    snprintf(title, sizeof(title), "Room %d", room->id);
+    print_phase_table(out, title, room->phase_times);
+  }
+  pthread_mutex_unlock(&lobby_lock);
+
+  histogram_t all_phase_times[NUM_PHASES];
+  collect_phase_times(all_phase_times);
+  print_phase_table(out, "All rooms", all_phase_times);
+  fflush(out);
+}
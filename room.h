@@ -0,0 +1,136 @@
+#ifndef __ROOM__
+#define __ROOM__
+#include <pthread.h>
+#include <stdio.h>
+
+#include "barrier.h"
+#include "deadline.h"
+#include "game_structs.h"
+#include "histogram.h"
+#include "latency.h"
+
+/**
+ * The question picked by the player whose turn it is, kept around so that
+ * the answers submitted during the round can be graded against it.
+ */
+typedef struct round {
+  int col;
+  int row;
+  int value;
+  char* answer;
+  char* normalized_answer;
+} round_t;
+
+// Size of a cache line; each player's answer slot gets its own, so that
+// players submitting at the same time don't write to the same line
+#define CACHE_LINE_SIZE 64
+
+/**
+ * A player's answer for a round. The player's own thread (or the event
+ * loop) is the only writer: it fills in the answer and then publishes it
+ * by storing the round number with release ordering. A slot whose round
+ * number isn't the current round's is empty, so nothing needs clearing
+ * between rounds.
+ */
+typedef struct answer_slot {
+  answer_t answer;
+  int64_t latency_compensation; // taken off the buzz time when ranking it
+  int round; // the round the answer was submitted in, 0 if never
+} __attribute__((aligned(CACHE_LINE_SIZE))) answer_slot_t;
+
+/**
+ * A player's claim on their seat, so they can get it back after losing
+ * their connection. The token is given to the player when they join, and
+ * is all they need to show to resume.
+ */
+typedef struct session {
+  uint64_t token;     // 0 until the player has joined
+  int attached;       // boolean, set while a thread plays the seat (threaded
+                      // server)
+  int resume_fd;      // socket of the player coming back, -1 if none
+  int resume_version; // protocol version spoken over resume_fd
+} session_t;
+
+// Parts of a round whose durations are recorded in each room
+enum round_phase {
+  PHASE_SELECT = 0,       // from the start of the round until the pick arrives
+  PHASE_BUZZ_WINDOW = 1,  // from sending the question until all answers are in
+  PHASE_READ_ANSWER = 2,  // from an answer arriving until it's in its slot
+  PHASE_GRADE = 3,        // grading the answers and updating the scores
+  PHASE_BROADCAST = 4,    // encoding the results and sending them to everyone
+  PHASE_ROUND = 5,        // the whole round
+  NUM_PHASES
+};
+
+/**
+ * A single match and everything needed to play it. Rooms are independent
+ * of each other, so one server can run any number of them at once.
+ */
+typedef struct room {
+  int id;
+  room_config_t config; // settings the players of the room asked for
+  int seats_taken;
+  int filling;    // boolean, set while new players can still be seated
+  int refs;       // players (threads or connections) still attached
+  int aborted;    // boolean, set when the match can't go on
+  int restored_seats; // bit for each seat of a restored game still waiting
+                      // for its player to join again
+
+  // State of the game being played
+  unsigned int seed; // the board was picked with this seed
+  game_t game;
+  int remaining_questions;
+  round_t current_round;
+  game_delta_t delta; // changes made by the last finished round
+  pthread_mutex_t add_player_lock;
+
+  // Checking of submitted answers; the arrays have a slot for each seat
+  answer_slot_t* answers; // indexed by player id
+  int buzzing_open; // boolean, set from picking the question until grading
+  int64_t buzz_deadline; // buzzes arriving after this are too late
+  latency_t* latency; // network delay to each player
+  session_t* sessions; // indexed by player id
+  pthread_cond_t session_cond; // signalled under add_player_lock when a
+                               // player comes back or the room is aborted
+
+  // How long each phase of the rounds played so far took, in nanoseconds
+  histogram_t phase_times[NUM_PHASES];
+  int64_t round_start;    // when the current round started
+  int64_t question_sent;  // when the question of the current round was sent
+
+  // Syncing threads between phases of a round (threaded server)
+  phase_barrier_t barrier;
+  // timerfds expiring at the deadlines of the current round, polled along
+  // with the players' sockets; -1 until the first player joins
+  int select_timer;
+  int answer_timer;
+
+  // Connections of each seat and round progress (event loop server)
+  struct conn** conns;
+  int answers_received;
+  int sent_final_state;
+  int board_sent; // boolean, set once the whole board has been sent
+  deadline_t phase_deadline; // of the phase the current round is in
+
+  struct room* next;
+} room_t;
+
+struct room_snapshot;
+struct wire_buf;
+
+void normalize_room_config(room_config_t* config);
+room_t* room_create(const room_config_t* config, unsigned int seed);
+void room_destroy(room_t* room);
+room_t* lobby_join(const room_config_t* config, int* seat);
+room_t* lobby_resume(uint64_t token, int* seat, int* restored);
+uint64_t new_session_token();
+void encode_room_state(struct wire_buf* buf, room_t* room, int seat);
+void restore_room(const struct room_snapshot* saved);
+void lobby_give_up_restored(void (*give_up)(room_t* room));
+void lobby_close(room_t* room);
+void room_release(room_t* room);
+int64_t record_phase(room_t* room, int phase, int64_t start);
+void collect_phase_times(histogram_t* phase_times);
+void print_phase_times(FILE* out);
+
+#endif
@@ -1,400 +1,481 @@
+#include <errno.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <signal.h>
 #include <time.h>
-
-#include "game_structs.h"
+#include <sys/timerfd.h>
+
+#include "game.h"
+#include "room.h"
+#include "admin.h"
+#include "event_log.h"
+#include "event_loop.h"
+#include "journal.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "clock.h"
 #include "deps/socket.h"
-#include "deps/cJSON.h"
-#include "deps/uthash.h"
-#include "deps/levenshtein.h"
-
-// Parsing JSON variables
-category_t* category_hashmap = NULL;
-
-// Creating game variables
-game_t game;
-pthread_mutex_t add_player_lock;
-int remaining_questions = 25;
-
-// Checking of submitted answers
-pthread_mutex_t answer_list_lock;
-answer_t* answers_head = NULL;
-
-// Syncing threads
-pthread_mutex_t sync_lock_a;
-pthread_mutex_t sync_lock_g;
-int sync_threads_a = 0;
-int sync_threads_g = 0;
-int last_thread_a = 0;
-int last_thread_g = 0;
+
+// How long a player can hold up the rest of their room before the game in
+// it is given up on
+#define PHASE_TIMEOUT_MS (5 * 60 * 1000)
 
 /**
- * Takes in a JSON file and outputs a new file of the first num_lines_wanted
- * lines of the file in order to have a reasonably sized file
+ * Gives up on the game in a room, e.g. because one of its clients broke.
+ * Shutting down every player's socket and breaking the room's barrier wakes
+ * up the threads blocked reading from them or waiting on each other, so they
+ * can leave the room too.
+ *
+ * \param room - the room to abort
  */
-void truncate_questions_file() {
-  FILE* read = fopen("JEOPARDY_QUESTIONS1.json","r");
-  FILE* write = fopen("questions.json","w");
-  int num_lines_wanted = 1000;
-  for (int i=0; i<num_lines_wanted; i++) {
-    char line[100];
-    fgets(line, 100, read);
-    fprintf(write, "%s", line);
+void abort_room(room_t* room) {
+  pthread_mutex_lock(&room->add_player_lock);
+  if (!room->aborted) {
+    room->aborted = 1;
+    fprintf(stderr, "Aborting game in room %d\n", room->id);
+    for (int player = 0; player < room->game.num_players; player++) {
+      shutdown(room->game.players[player].socket_fd, SHUT_RDWR);
+    }
+    // players waiting on someone to come back stop waiting
+    pthread_cond_broadcast(&room->session_cond);
   }
-
-  fclose(read);
-  fclose(write);
+  pthread_mutex_unlock(&room->add_player_lock);
+  barrier_break(&room->barrier);
+  // a room that never filled up can't start anymore
+  lobby_close(room);
 }
 
 /**
- * Convert a value amount of $NUMBER string format into an integer
+ * Syncs up the threads running handle_client so that none of the clients
+ * get out of sync with each other. Threads sleep until every player in the
+ * room has reached the same point of the round.
  *
- * \param val_str - the string that should be parsed
+ * \param args - struct containing ID information for the thread that is
+ *               running it. (and less importantly, communication info
+ *               for the client the thread handles) 
+ * \param timeout_ms - how long to wait for the other players in milliseconds,
+ *                     or -1 to wait as long as it takes
+ * \return - boolean, True once all threads have synced, False if the
+ *           game was aborted
  */
-int parseValue(char* val_str) {
-  int val = 0;
-  if (val_str == NULL) return val;
-  
-  val_str[0] = ' ';
-  char* end;
-  val = (int)strtol(val_str, &end, 10);
-  return val;
+int wait_for_sync(input_t* args, int timeout_ms) {
+  room_t* room = args->room;
+  int result = barrier_wait(&room->barrier, timeout_ms);
+  if (result == BARRIER_TIMEOUT) {
+    fprintf(stderr, "Gave up waiting on the players of room %d\n", room->id);
+    abort_room(room);
+  }
+  return result >= BARRIER_PASSED;
 }
 
 /**
- * Takes in a string and returns the string in all lower case
+ * Waits for a client that lost its connection in the middle of a game to
+ * come back, holding its seat for up to RECONNECT_GRACE_MS. The socket the
+ * client comes back on takes the place of the old one under the same file
+ * descriptor, so the other threads of the room go on sending to it as if
+ * nothing happened, and the client is sent the state of the game.
  *
- * \param string - the string to make lower case
+ * \param args - communication info for the client and the room it is in
+ * \return - boolean, True if the client is back, False if it didn't come
+ *           back in time or can't resume at all
  */
-char* str_tolower(char* string) {
-  int len = strlen(string);
-  char *ret = (char*) malloc(sizeof(char) * len);
-  for(int i = 0; i < len; i++) {
-    ret[i] = tolower(string[i]);
+int await_resume(input_t* args) {
+  room_t* room = args->room;
+  session_t* session = &room->sessions[args->id];
+  if (args->version < RESUME_PROTOCOL_VERSION) return 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += RECONNECT_GRACE_MS / 1000;
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+  int resumed = 0;
+
+  pthread_mutex_lock(&room->add_player_lock);
+  // only games being played can be picked up again
+  int resumable = room->game.num_players == room->config.num_players && !room->game.is_over;
+  if (resumable && !room->aborted && session->resume_fd == -1) {
+    fprintf(stderr, "Lost connection to client %d in room %d; holding the seat for %d s\n",
+            args->id, room->id, RECONNECT_GRACE_MS / 1000);
+    shutdown(args->socket_fd, SHUT_RDWR);
   }
-  return ret;
+  while (resumable && !room->aborted) {
+    if (session->resume_fd == -1) {
+      if (pthread_cond_timedwait(&room->session_cond, &room->add_player_lock, &deadline) == ETIMEDOUT &&
+          session->resume_fd == -1) {
+        break;
+      }
+      continue;
+    }
+
+    // take over the new socket, dropping anything left of the old stream
+    int fd = session->resume_fd;
+    session->resume_fd = -1;
+    int taken = dup2(fd, args->socket_fd) != -1;
+    close(fd);
+    if (!taken) {
+      perror("Unable to take over the client's new socket");
+      break;
+    }
+    args->version = session->resume_version;
+    args->stream->len = 0;
+    args->stream->consumed = 0;
+    buf.len = 0;
+    encode_room_state(&buf, room, args->id);
+    if (send_buf(args->socket_fd, &buf)) {
+      resumed = 1;
+      break;
+    }
+    // lost again already; it may still come back before the deadline
+    shutdown(args->socket_fd, SHUT_RDWR);
+  }
+  pthread_mutex_unlock(&room->add_player_lock);
+  wire_buf_free(&buf);
+
+  if (resumed) {
+    printf("Client %d is back in room %d\n", args->id, room->id);
+    metric_add(&metrics.sessions_resumed, 1);
+  } else if (resumable && !room->aborted) {
+    fprintf(stderr, "Client %d didn't come back to room %d\n", args->id, room->id);
+  }
+  return resumed;
 }
 
 /**
- * Uses the levenshtein algorithm to determine if a guess is close
- * enough to the answer to be considered correct
+ * Gives the socket of a player coming back to their seat to the thread
+ * playing the seat. The seat's old socket is shut down, in case the thread
+ * hasn't noticed that the connection is gone yet.
  *
- * \param guess - the user's guess
- * \param answer - the correct answer
+ * \param room - the room the player is coming back to
+ * \param seat - the id of the player
+ * \param fd - the socket the player came back on
+ * \param version - the protocol version spoken over the socket
+ * \return - boolean, True if the thread took the socket, False if the
+ *           seat's game is no longer being played
  */
-int check_answer(char* guess, char* answer) {
-  int is_correct = 0;
-  char* guess_formatted = str_tolower(guess);
-  char* answer_formatted = str_tolower(answer);
-  
-  size_t difference = levenshtein(guess, answer);
-  int cutoff_factor = 2;
-  if (difference-1 < strlen(answer)/cutoff_factor) is_correct = 1;
-  
-  free(guess_formatted);
-  free(answer_formatted);
-  return is_correct;
+int hand_over_seat(room_t* room, int seat, int fd, int version) {
+  session_t* session = &room->sessions[seat];
+  pthread_mutex_lock(&room->add_player_lock);
+  int taken = session->attached && !room->aborted && !room->game.is_over;
+  if (taken) {
+    // an earlier try that the thread never got to
+    if (session->resume_fd != -1) close(session->resume_fd);
+    session->resume_fd = fd;
+    session->resume_version = version;
+    shutdown(room->game.players[seat].socket_fd, SHUT_RDWR);
+    pthread_cond_broadcast(&room->session_cond);
+  }
+  pthread_mutex_unlock(&room->add_player_lock);
+  return taken;
 }
 
 /**
- * Given a json string for a single board square (containing the question, 
- * answer, value, and category) create a new square and add it to the hashmap
+ * Reads the next message from a client, giving up on the game in its room
+ * if the client broke protocol, or hung up and didn't come back. Answers
+ * to pings are added to the client's latency estimates whenever they
+ * arrive.
  *
- * \param json_str - the json string to parse as a square
+ * \param args - communication info for the client and the room it is in
+ * \param types - the message_types to accept, as a set of MSG_BITs
+ * \param frame - set to the message read
+ * \return - 1 if the message was read, 0 if the game was given up on, or
+ *           -1 if the client ran out of time: the timer of its stream
+ *           expired, or the read timeout of its socket passed
  */
-int add_square_from_json(char* json_str) {
-    cJSON* json_category;
-    cJSON* json_question;
-    cJSON* json_value;
-    cJSON* json_answer;
-    cJSON* json = cJSON_Parse(json_str);
-    
-    if (json == NULL) {
-      return 0;
+int recv_from_client(input_t* args, unsigned types, frame_t* frame) {
+  while (1) {
+    int result;
+    while ((result = recv_message(args->stream, types | MSG_BIT(MSG_PONG), frame)) == 1 &&
+           frame->type == MSG_PONG) {
+      int64_t sent, received, replied;
+      if (!decode_pong(frame, &sent, &received, &replied)) {
+        result = -1;
+        errno = EPROTO;
+        break;
+      }
+      if (latency_add_sample(&args->room->latency[args->id], sent, received, replied,
+                             args->stream->last_read_time)) {
+        metric_latency(&args->room->latency[args->id]);
+      }
+      if (types & MSG_BIT(MSG_PONG)) return 1;
     }
-
-    // Get JSON objects
-    json_question = cJSON_GetObjectItem(json, "question");
-    json_answer = cJSON_GetObjectItem(json, "answer");
-    json_value = cJSON_GetObjectItem(json, "value");
-    json_category = cJSON_GetObjectItem(json, "category");
-
-    // Copy the string versions of the JSON objects into a new struct
-    square_t new_square;
-    strncpy(new_square.question, cJSON_GetStringValue(json_question), MAX_QUESTION_LENGTH-1);
-    new_square.question[MAX_QUESTION_LENGTH-1] = '\0';
-    strncpy(new_square.answer, cJSON_GetStringValue(json_answer), MAX_ANSWER_LENGTH-1);
-    new_square.answer[MAX_ANSWER_LENGTH-1] = '\0';
-    new_square.value = parseValue(cJSON_GetStringValue(json_value));
-    new_square.is_answered = 0;
-
-    char category[MAX_ANSWER_LENGTH];
-    strncpy(category, cJSON_GetStringValue(json_category), MAX_ANSWER_LENGTH-1);
-    category[MAX_ANSWER_LENGTH-1] = '\0';
-
-    /* 
-       Try to find the category of the question in the hashmap. If it's there,
-       add the square to the existing category. If the category isn't not there,
-       create a new hashmap entry and add it
-    */
-    category_t* query;
-    HASH_FIND_STR(category_hashmap, category, query);
-    if (query == NULL) {
-      query = malloc(sizeof(category_t));
-      strncpy(query->title, category, MAX_ANSWER_LENGTH-1);
-      query->title[MAX_ANSWER_LENGTH-1] = '\0';
-      query->questions[0] = new_square;
-      query->num_questions = 1;
-      HASH_ADD_STR(category_hashmap, title, query);
-    } else if (query->num_questions < NUM_QUESTIONS_PER_CATEGORY) {
-      query->questions[query->num_questions] = new_square;
-      query->num_questions++;
+    if (result == 1) return 1;
+
+    int error = errno;
+    if (result == -1 && error == EAGAIN) return -1;
+    int lost = result == 0 || (error != EPROTO && error != EMSGSIZE);
+    if (lost && !args->room->aborted && await_resume(args)) continue;
+    if (lost || args->room->aborted) {
+      fprintf(stderr, "Lost connection to client %d in room %d\n", args->id, args->room->id);
+    } else {
+      fprintf(stderr, "Bad message from client %d in room %d: %s\n",
+              args->id, args->room->id, strerror(error));
     }
-    
-    cJSON_Delete(json);
-    return 1;
+    abort_room(args->room);
+    return 0;
+  }
 }
 
 /**
- * Read in a JSON file object by object and pass each object to the parser
- * 
- * \param input - the JSON file to read from
+ * Sets how long reads from a client's socket wait before failing with
+ * EAGAIN
+ *
+ * \param fd - the client's socket
+ * \param timeout_ms - the timeout in milliseconds, or 0 to wait as long as
+ *                     it takes
  */
-int parse_json(FILE* input) {
-  int max_file_size = 100000;
-  char buffer[max_file_size];
-  fgets(buffer, max_file_size, input);
-  char token[2] = "}";
-  char* next = strtok(buffer, token);
-
-  // Loop over each JSON object
-  while (next != '\0') {
-    char json_buffer[max_file_size];
-    strcpy(json_buffer, next);
-    strcat(json_buffer, "}");
-    if (json_buffer[0] == ',') {
-      json_buffer[0] = ' ';
-    }
-    int success = add_square_from_json(json_buffer);
-    if (!success) return 1;
-
-    next = strtok(NULL, token);
+void set_read_timeout(int fd, int timeout_ms) {
+  struct timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1) {
+    perror("Unable to set the client's read timeout");
   }
-  
-  return 0;
 }
 
 /**
- * Adds a new player to the game with the given name and id if there is room
+ * Makes the timers of a room's rounds, unless it has them already. Must be
+ * called with the room's add_player_lock held. A room left without them
+ * waits on its players for as long as it takes.
  *
- * \param name - the name of the player
- * \param args - contains the (unique) id of the player and the socket number
- *               that can be used to send network data to them
- * \return - boolean, True if player was succesfully added, else False
+ * \param room - the room a player joined
  */
-int add_player(char* name, input_t* args) {
-  pthread_mutex_lock(&add_player_lock);
-  // only add player if the max number has not yet been reached
-  if (game.num_players == MAX_NUM_PLAYERS) return 0;
-
-  // fill in necessary player data
-  player_t new_player;
-  strncpy(new_player.name, name, MAX_ANSWER_LENGTH);
-  new_player.score = 0;
-  new_player.id = args->id;
-  new_player.socket_fd = args->socket_fd;
-  game.players[game.num_players] = new_player;
-  game.num_players++;
-  pthread_mutex_unlock(&add_player_lock);
-  return 1;
+void open_round_timers(room_t* room) {
+  if (room->select_timer != -1) return;
+  room->select_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  room->answer_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (room->select_timer == -1 || room->answer_timer == -1) {
+    perror("Unable to make the timers of a room");
+    if (room->select_timer != -1) close(room->select_timer);
+    if (room->answer_timer != -1) close(room->answer_timer);
+    room->select_timer = -1;
+    room->answer_timer = -1;
+  }
 }
 
 /**
- * Iterates through the hashmap 'index' times to get the entry at 'index'
+ * Sets one of a room's round timers to expire at a deadline. Every thread
+ * polling the timer wakes up once it does, and it stays expired until it
+ * is set again.
  *
- * \param index - the index we want to get
- * \return c - the entry at position index in the category_hashmap
+ * \param timer - the timerfd, or -1 for none
+ * \param deadline - monotonic_ns() to expire at, or 0 to disarm the timer
  */
-category_t* get_category_at_index(int index) {
-  category_t* c = category_hashmap;
-  for (int i=0; i<index; i++) {
-     c = c->hh.next;
+void set_timer(int timer, int64_t deadline) {
+  if (timer == -1) return;
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = deadline / 1000000000;
+  spec.it_value.tv_nsec = deadline % 1000000000;
+  if (timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+    perror("Unable to set a round timer");
   }
-  return c;
 }
 
 /**
- * Creates an empty game, including filling out the Jeopardy board 
+ * Tells whether a pick, buzz or answer from a client is for the round
+ * being played. One for an earlier round comes from a player who ran out
+ * of time, and the server already acted for them.
  *
- * \return game - a filled out game_t struct containing categories parsed 
- *                randomly to make the game different *every time 
+ * \param room - the room the client is in
+ * \param frame - a MSG_SELECT, MSG_BUZZ or MSG_ANSWER from the client
+ * \return - boolean, True if the message is for the current round or
+ *           doesn't say which round it's for
  */
-game_t create_game() {
-  game_t game;
-  game.num_players = 0;
-  game.is_over = 0;
-  game.id_of_player_turn = 0;
-
-  category_t* c;
-  category_t* temp;
-
-  // Get rid of all non-completely filled categories (gets rid of final
-  // jeopardy too as a consequence)
-  HASH_ITER(hh, category_hashmap, c, temp) {
-    if (c->num_questions != NUM_QUESTIONS_PER_CATEGORY) {
-      HASH_DEL(category_hashmap, c);
-    }
-  }
-
-  int map_size = HASH_COUNT(category_hashmap);
-
-  // Selects five random categories next to each other to create a game
-  int r = rand() % (map_size-5);
-  for (int i=0; i<NUM_CATEGORIES; i++) {
-    category_t* c = get_category_at_index(r+i);
-    game.categories[i] = *c;
-  }
-  
-  return game;
+int is_for_this_round(room_t* room, const frame_t* frame) {
+  int round = decode_round(frame);
+  return round == 0 || round == room->delta.version + 1;
 }
 
 /**
- * Adds the answer ans to the list of answers to be checked later (thread safe)
+ * Adds a ping to the messages about to be sent to a client, if the client
+ * speaks a version of the protocol that answers them
  *
- * param ans - the answer struct submitted by a user
+ * \param args - communication info for the client
+ * \param buf - the messages about to be sent to the client
  */
-void add_answer_to_list(answer_t* ans) {
-  pthread_mutex_lock(&answer_list_lock);
-
-  if (answers_head == NULL) {
-    // adding first answer as head
-    answers_head = ans;
-    answers_head->next = NULL;
-  } else {
-    // add new node to front of the list
-    ans->next = answers_head;
-    answers_head = ans;
-  }
-  pthread_mutex_unlock(&answer_list_lock);
+void add_ping(input_t* args, wire_buf_t* buf) {
+  if (args->version >= PING_PROTOCOL_VERSION) encode_ping(buf, monotonic_ns());
 }
 
 /**
- * Returns the user id of the client who correctly answered the question the quickest.
- * Returns -1 if no user answered correctly (or at all) in time 
- * 
- * \param answer - the correct answer to check against all users' answers
- * \return correct_answer_id - the id number of the client who answered
- *                             the question correctly the earliest, or
- *                             if no one answered correctly/at-all, -1
+ * Sends the same encoded messages to every player in a room
+ *
+ * \param game - the game of the room
+ * \param buf - the encoded messages
+ * \param what - description of the messages, for error messages
  */
-int get_quickest_answer(char* answer) {
-  int correct_answer_id = -1;
-  time_t best_time = -1;
-  
-  // get client id of fastest correct answer 
-  while (answers_head != NULL) {
-    printf("checking answer \"%s\". Did answer:%d correctness:%d\n", answers_head->answer, answers_head->did_answer, check_answer(answers_head->answer, answer));
-    if (answers_head->did_answer && check_answer(answers_head->answer, answer)) {
-      if (best_time == -1 || answers_head->time < best_time) {
-        correct_answer_id = answers_head->id;
-        best_time = answers_head->time;
-      }
+void send_to_all(game_t* game, wire_buf_t* buf, char* what) {
+  for (int player = 0; player < game->num_players; player++) {
+    if (!send_buf(game->players[player].socket_fd, buf)) {
+      fprintf(stderr, "Unable to send %s to client %d: %s\n", what, player, strerror(errno));
     }
-    
-    // free node
-    answer_t* temp = answers_head;
-    answers_head = answers_head->next;
-    free(temp);
   }
-
-  printf("Correct answer id: %d\n", correct_answer_id);
-  return correct_answer_id;
 }
 
-
 /**
- * Syncs up the threads running handle_client so that none of the clients
- * get out of sync with each other. This one uses syncing variables for
- * the beginning of the loop, right before the game_t struct is sent.
+ * Plays a game with the designated client until the game in its room is
+ * over (or is aborted)
  *
- * \param args - struct containing ID information for the thread that is
- *               running it. (and less importantly, communication info
- *               for the client the thread handles) 
+ * \param args - communication info for the client and the room it is in
+ * \param buf - buffer to encode messages to the client in
  */
-void wait_for_sync_game(input_t* args) {
-  // show that the client this thread handles is ready
-  pthread_mutex_lock(&sync_lock_g);
-  sync_threads_g++;
-  last_thread_g++; // for preventing deadlock in this function
-  pthread_mutex_unlock(&sync_lock_g);
-
-  while(1) {
-    // check if other threads are ready for next portion of game
-    pthread_mutex_lock(&sync_lock_g);
-    
-    // if all threads have synced, continue with game play
-    if(sync_threads_g == MAX_NUM_PLAYERS) {
-      last_thread_g--;
-      pthread_mutex_unlock(&sync_lock_g);
-      break;
+void play_game(input_t* args, wire_buf_t* buf) {
+  room_t* room = args->room;
+  game_t* game = &room->game;
+  frame_t frame;
+
+  // Wait for enough players to have connected to play game
+  if (!wait_for_sync(args, -1)) return;
+  
+  // communication loop with designated client
+  for (int round = 0; ; round++) {
+    // send the whole game state to the client once, and only what
+    // changed in the last round after that
+    buf->len = 0;
+    if (round == 0) {
+      encode_board(buf, game, room->delta.version);
     } else {
-      pthread_mutex_unlock(&sync_lock_g);
+      encode_delta(buf, &room->delta, game->num_players);
+    }
+    // measure the client's latency once a round; the pong is read along
+    // with the client's next message
+    if (!game->is_over) add_ping(args, buf);
+    if (!send_buf(args->socket_fd, buf)) {
+      // a client that comes back is sent the whole game anyway
+      int error = errno;
+      if (game->is_over || !await_resume(args)) {
+        fprintf(stderr, "Writing game didn't work: %s\n", strerror(error));
+        abort_room(room);
+        return;
+      }
     }
-  }
 
-  // last thread to exit the function must clean up
-  if(last_thread_g < 1) {
-    pthread_mutex_lock(&sync_lock_g);
-    sync_threads_g = 0;
-    pthread_mutex_unlock(&sync_lock_g);
-  }
-}
+    // only exit if game is over after the game state is sent to clients
+    // so that clients also know that game is over.
+    if (game->is_over) return;
 
+    // sync threads so every client has the game state before the
+    // question coords are sent to them
+    if (!wait_for_sync(args, PHASE_TIMEOUT_MS)) return;
+    // the thread whose turn it is times the phases of the round
+    int is_my_turn = game->id_of_player_turn == args->id;
+    if (is_my_turn) room->round_start = monotonic_ns();
+    
+    // get next question
+    if (verbose) printf("Waiting on coords selection from user\n");
+    // get question coordinates from the client, or pick the question for
+    // them once they are out of time
+    if (is_my_turn) {
+      int col = -1, row = -1;
+      int64_t picked_at;
+      set_timer(room->select_timer, room->round_start + SELECT_TIMEOUT_MS * 1000000LL);
+      args->stream->timer_fd = room->select_timer;
+      while (1) {
+        // buzzes and answers are left over from the last round
+        int result = recv_from_client(args, MSG_BIT(MSG_SELECT) | MSG_BIT(MSG_BUZZ) | MSG_BIT(MSG_ANSWER), &frame);
+        if (result == 0) return;
+        if (result == -1) {
+          fprintf(stderr, "Client %d in room %d ran out of time to pick a question\n", args->id, room->id);
+          metric_add(&metrics.deadlines_missed, 1);
+          pick_random_square(room, &col, &row);
+          picked_at = monotonic_ns();
+          break;
+        }
+        if (frame.type == MSG_SELECT && is_for_this_round(room, &frame)) {
+          decode_coords(&frame, &col, &row);
+          picked_at = args->stream->last_read_time;
+          break;
+        }
+      }
+      args->stream->timer_fd = -1;
+      histogram_record(&room->phase_times[PHASE_SELECT], picked_at - room->round_start);
+      // mark the question as done so it cannot be done again, and send
+      // coords to all clients from this thread; a player coming back at
+      // the same time gets either the question or a board with it picked
+      pthread_mutex_lock(&room->add_player_lock);
+      int picked = select_square(room, col, row);
+      if (picked) {
+        buf->len = 0;
+        encode_coords(buf, MSG_QUESTION, col, row, room->delta.version + 1);
+        send_to_all(game, buf, "question coords");
+        room->question_sent = monotonic_ns();
+        set_timer(room->answer_timer, room->buzz_deadline + ANSWER_TIMEOUT_MS * 1000000LL);
+      }
+      pthread_mutex_unlock(&room->add_player_lock);
+      if (!picked) {
+        fprintf(stderr, "Client %d selected an invalid question\n", args->id);
+        abort_room(room);
+        return;
+      }
+    }
 
-/**
- * Syncs up the threads running handle_client so that none of the clients
- * get out of sync with each other. This one uses syncing variables for
- * right before the client submitted answers are to be checked.
- *
- * \param args - struct containing ID information for the thread that is
- *               running it. (and less importantly, communication info
- *               for the client the thread handles) 
- */
-void wait_for_sync_answers(input_t* args) {
-  // show that the client this thread handles is ready
-  pthread_mutex_lock(&sync_lock_a);
-  sync_threads_a++;
-  last_thread_a++; // for preventing deadlock in this function
-  pthread_mutex_unlock(&sync_lock_a);
-
-  while(1) {
-    // check if other threads are ready for next portion of game
-    pthread_mutex_lock(&sync_lock_a);
     
-    // if all threads have synced, continue with game play
-    if(sync_threads_a == MAX_NUM_PLAYERS) {
-      last_thread_a--;
-      pthread_mutex_unlock(&sync_lock_a);
+    // get the buzz (if the player buzzed in) and then the answer from the
+    // client, timing the buzz as soon as it arrives. A client still
+    // without an answer once the room's answer timer expires didn't buzz in.
+    int64_t buzz_time = -1;
+    int64_t answer_arrived;
+    answer_t ans;
+    args->stream->timer_fd = room->answer_timer;
+    while (1) {
+      // a pick is left over from before the question was picked for them
+      int result = recv_from_client(args, MSG_BIT(MSG_BUZZ) | MSG_BIT(MSG_ANSWER) | MSG_BIT(MSG_SELECT), &frame);
+      if (result == 0) return;
+      if (result == -1) {
+        fprintf(stderr, "Client %d in room %d ran out of time to answer\n", args->id, room->id);
+        metric_add(&metrics.deadlines_missed, 1);
+        memset(&ans, 0, sizeof(answer_t));
+        buzz_time = -1;
+        answer_arrived = monotonic_ns();
+        break;
+      }
+      if (frame.type == MSG_SELECT || !is_for_this_round(room, &frame)) continue;
+      if (frame.type == MSG_BUZZ) {
+        record_buzz(room, args->id, &buzz_time, args->stream->last_read_time);
+        continue;
+      }
+      answer_arrived = args->stream->last_read_time;
+      if (!decode_answer(&frame, &ans)) {
+        fprintf(stderr, "Answer was not read properly by server from client %d\n", args->id);
+        abort_room(room);
+        return;
+      }
       break;
-    } else {
-      pthread_mutex_unlock(&sync_lock_a);
     }
-  }
- 
+    args->stream->timer_fd = -1;
+    // put the read information in this player's answer slot for the round
+    ans.buzz_time = buzz_time;
+    ans.id = args->id;
+    submit_answer(room, &ans);
+    record_phase(room, PHASE_READ_ANSWER, answer_arrived);
 
-  // last thread to exit the function must clean up
-  if(last_thread_a < 1) {
-    pthread_mutex_lock(&sync_lock_a);
-    sync_threads_a = 0;
-    pthread_mutex_unlock(&sync_lock_a);
+    // sync up threads so that all the answers are in
+    // before checking for the fastest one
+    if (!wait_for_sync(args, PHASE_TIMEOUT_MS)) return;
+    
+    // thread whose turn it is responsible for updating scores and board
+    if (is_my_turn) {
+      int64_t phase_start = record_phase(room, PHASE_BUZZ_WINDOW, room->question_sent);
+      answer_t result;
+      finish_round(room, &result);
+      phase_start = record_phase(room, PHASE_GRADE, phase_start);
+      // no one reads with it until the next question is picked
+      set_timer(room->answer_timer, 0);
+
+      buf->len = 0;
+      encode_result(buf, &result);
+      send_to_all(game, buf, "correct answer");
+      record_phase(room, PHASE_BROADCAST, phase_start);
+      record_phase(room, PHASE_ROUND, room->round_start);
+    }
+
+    // sync threads so everyone starts the next round at the same time,
+    // after the results of this one have been sent
+    if (!wait_for_sync(args, PHASE_TIMEOUT_MS)) return;
   }
 }
 
-
 /**
  * Thread function to handle each client that connected to the game
  *
@@ -402,240 +483,344 @@ void wait_for_sync_answers(input_t* args) {
  *                for networking with a designated client
  */
 void* handle_client(void* input) {
-  // Parse username
   input_t* args = (input_t*) input;
+  metric_add(&metrics.connections, 1);
+  metric_add(&metrics.players_connected, 1);
+  frame_stream_t stream;
+  frame_stream_init(&stream, args->socket_fd, MAX_CLIENT_FRAME_SIZE);
+  args->stream = &stream;
+  wire_buf_t buf;
+  wire_buf_init(&buf);
+
+  // Parse the protocol version, username and wanted room settings of the
+  // client; the client is only seated in a room once they are known. A
+  // client coming back after losing its connection sends its session
+  // token instead.
+  frame_t frame;
   char username[MAX_ANSWER_LENGTH];
-  int user_len = 0 ;
-  if (read(args->socket_fd, &user_len, sizeof(int)) != sizeof(int)) {
-    perror("Couldn't read username length");
-  }
-  if (read(args->socket_fd, &username, sizeof(char)*user_len) < 0) {
-    char* placeholder = "Anonymous";
-    strncpy(username, placeholder, strlen(placeholder)+1);
-  }
-  // add player to board
-  add_player(username, args); 
-  if (write(args->socket_fd, &args->id, sizeof(int)) != sizeof(int)) {
-    perror("Unable to send id to client!");
-  }
-
-  // Wait for enough players to have connected to play game
-  while (game.num_players < MAX_NUM_PLAYERS) {
-    usleep(500);
+  room_config_t config;
+  uint64_t token = 0;
+  int version = -1;
+  set_read_timeout(args->socket_fd, JOIN_TIMEOUT_MS);
+  int result = recv_message(args->stream, MSG_BIT(MSG_HELLO) | MSG_BIT(MSG_RESUME), &frame);
+  if (result == -1 && errno == EAGAIN) {
+    fprintf(stderr, "Client didn't say hello in time\n");
+  } else if (result != 1) {
+    fprintf(stderr, "Client left before saying hello\n");
+  } else if (frame.type == MSG_RESUME ? !decode_resume(&frame, &version, &token)
+                                      : !decode_hello(&frame, &version, username, &config)) {
+    fprintf(stderr, "Client sent a malformed hello\n");
+    version = -1;
+  } else if ((version = negotiate_version(version)) == -1) {
+    fprintf(stderr, "Client speaks an unsupported protocol version\n");
+    encode_error(&buf, "The server doesn't speak this client's protocol version");
+    send_buf(args->socket_fd, &buf);
   }
-  
-  char* coords = (char*) malloc(sizeof(char)*2);
-  // communication loop with designated client
-  while (1) {
-    // sync threads so everyone starts the round at the same time
-    wait_for_sync_game(args);
-    
-    // send the latest game state to client
-    if (write(args->socket_fd, &game, sizeof(game_t)) != sizeof(game_t)) {
-      perror("Writing game didn't work");
-      return NULL;
-    }
 
-    // only exit if game is over after game_t is sent to clients so 
-    // that clients also know that game is over.
-    if (game.is_over) break;
-    
-    // get next question
-    int question_value = 0;
-    char* correct_ans;
-    int coord_size = 3; //2 coord chars, null char
-    int row, col;
-    printf("Waiting on coords selection from user\n");
-    // get question coordinates from the client
-    if (game.id_of_player_turn == args->id) {
-      // read char type coords from client
-      if (read(args->socket_fd, coords, sizeof(char)*coord_size) != sizeof(char)*coord_size) {
-        perror("Reading in question selection didn't work");
-        exit(2);
-      }
-      // convert coordinates to int 
-      col = coords[0] - 'A';      //range A-E
-      row = coords[1] - '0' - 1;  //range 1-5
-      // get the answer and question value
-      question_value = game.categories[col].questions[row].value;
-      correct_ans = game.categories[col].questions[row].answer;
-
-      // mark the question as done so it cannot be done again
-      game.categories[col].questions[row].is_answered = 1;
-      game.categories[col].questions[row].value = -1;
-      
-      // decrement global count of remaining questions
-      remaining_questions--;
-      
-      // send coords to all clients from this thread
-      for(int player = 0; player < MAX_NUM_PLAYERS; player++) {
-        if(write(game.players[player].socket_fd, coords, sizeof(char)*coord_size) !=
-           sizeof(char)*coord_size) {
-          perror("Unable to send question coords!");
-        }
+  int handed_over = 0;
+  if (version != -1 && frame.type == MSG_RESUME) {
+    int restored;
+    args->room = lobby_resume(token, &args->id, &restored);
+    if (args->room != NULL && restored) {
+      // the server restarted, so the player joins their restored game again
+      strcpy(username, args->room->game.players[args->id].name);
+    } else {
+      set_read_timeout(args->socket_fd, 0);
+      handed_over = args->room != NULL &&
+        hand_over_seat(args->room, args->id, args->socket_fd, version);
+      if (!handed_over) {
+        encode_error(&buf, "That game is no longer being played");
+        send_buf(args->socket_fd, &buf);
       }
+      version = -1;
     }
+  } else if (version != -1) {
+    // older clients can only play with the default settings
+    if (version < CONFIG_PROTOCOL_VERSION) memset(&config, 0, sizeof(room_config_t));
+    normalize_room_config(&config);
+    if (username[0] == '\0') strcpy(username, "Anonymous");
+    args->room = lobby_join(&config, &args->id);
+  }
 
-    
-    // get answer and buzz-time from the client
-    answer_t* ans = (answer_t*)malloc(sizeof(answer_t));
-    while (read(args->socket_fd, ans, sizeof(answer_t)) != sizeof(answer_t)) {
-      fprintf(stderr, "Answer was not read properly by server from client %d\n", args->id);
+  if (version != -1) {
+    args->version = version;
+    printf("Client %d connected to room %d!\n", args->id, args->room->id);
+
+    // add player to board
+    add_player(args->room, username, args->id, args->socket_fd);
+    session_t* session = &args->room->sessions[args->id];
+    pthread_mutex_lock(&args->room->add_player_lock);
+    session->attached = 1;
+    open_round_timers(args->room);
+    pthread_mutex_unlock(&args->room->add_player_lock);
+    encode_welcome(&buf, version, args->id, &args->room->config, session->token);
+    if (!send_buf(args->socket_fd, &buf)) {
+      perror("Unable to send id to client!");
     }
-    // add the read information to the list of answers for this round
-    ans->id = args->id;
-    add_answer_to_list(ans);
 
-    // sync up threads so that all the answers are in
-    // before checking for the fastest one
-    wait_for_sync_answers(args);
-    
-    // thread whose turn it is responsible for updating scores and board
-    int correct_answer_id = -1;
-    if (game.id_of_player_turn == args->id) {
-
-      if(remaining_questions == 0) game.is_over = 1;
-      
-      // check the answers' correctness in order
-      correct_answer_id = get_quickest_answer(correct_ans);
-      if (correct_answer_id != -1) {
-        game.players[correct_answer_id].score += question_value;
-        game.id_of_player_turn = correct_answer_id;
+    // get a first estimate of the client's latency while the room fills
+    // up; a client slow to answer is left with the estimate it has
+    int pings = args->version >= PING_PROTOCOL_VERSION ? PING_BURST : 0;
+    for (int ping = 0; ping < pings && version != -1; ping++) {
+      buf.len = 0;
+      add_ping(args, &buf);
+      if (!send_buf(args->socket_fd, &buf)) {
+        perror("Unable to ping client");
+        abort_room(args->room);
+        version = -1;
+      } else if ((result = recv_from_client(args, MSG_BIT(MSG_PONG), &frame)) == 0) {
+        version = -1;
+      } else if (result == -1) {
+        break;
       }
+    }
 
-      // build answer struct containing results of the answereing round
-      ans->id = game.id_of_player_turn;
-      memcpy(ans->answer, correct_ans, MAX_ANSWER_LENGTH); //write in correct answer
-      if (correct_answer_id == -1) {
-        ans->did_answer = 0;
-      } else {
-        ans->did_answer = 1;
-      }
+    // the rounds' reads are timed by the room's timers instead
+    set_read_timeout(args->socket_fd, 0);
+    if (version != -1) play_game(args, &buf);
 
-      for(int player = 0; player < MAX_NUM_PLAYERS; player++) {
-        if (write(game.players[player].socket_fd, ans, sizeof(answer_t)) != sizeof(answer_t)) {
-          perror("Sending correct answer doesn't work!");
-        }
-      }
-    }
+    // no one can come back to the seat anymore
+    pthread_mutex_lock(&args->room->add_player_lock);
+    session->attached = 0;
+    if (session->resume_fd != -1) close(session->resume_fd);
+    session->resume_fd = -1;
+    pthread_mutex_unlock(&args->room->add_player_lock);
   }
-  
+
+  // leave the room; the last player out cleans it up. A socket handed over
+  // to the thread of the player's seat is that thread's to close.
+  if (!handed_over) close(args->socket_fd);
+  metric_add(&metrics.players_connected, -1);
+  if (args->room != NULL) room_release(args->room);
+  wire_buf_free(&buf);
+  frame_stream_free(&stream);
   free(input);
-  free(coords);
   
   return NULL;
 }
 
 /**
- * Runs the game loop including waiting for clients to connect and setting up
- * the appropriate file streams
+ * Thread function that gives up on the games restored from the state
+ * directory whose players haven't all come back RECONNECT_GRACE_MS after
+ * the server started
+ *
+ * \param input - unused
+ * \return - NULL
+ */
+void* give_up_restored_rooms(void* input) {
+  (void)input;
+  struct timespec grace = {RECONNECT_GRACE_MS / 1000, RECONNECT_GRACE_MS % 1000 * 1000000L};
+  nanosleep(&grace, NULL);
+  lobby_give_up_restored(abort_room);
+  return NULL;
+}
+
+/**
+ * Runs the game loop including waiting for clients to connect and starting
+ * a thread for each of them, which seats its client in a room. Runs
+ * forever; each room plays its game independently of the others.
  *
  * \param server_socket_fd - the fd of the server
- * \param num_connections_allowed - the number of connections the server should allow
  */
-void run_game(int server_socket_fd, int num_connections_allowed) {
-  // threads to handle each of the clients that connects 
-  pthread_t thrd_arr[num_connections_allowed];
+void run_game(int server_socket_fd) {
+  // games restored from the state directory only wait so long for their
+  // players
+  if (journal_fd != -1) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, give_up_restored_rooms, NULL)) {
+      perror("PTHREAD CREATE FAILED:");
+      exit(2);
+    }
+    pthread_detach(thread);
+  }
 
   // launch threads to handle each client
-  for(int client = 0; client < num_connections_allowed; client++) {
+  while (1) {
     
     // Wait for a client to connect
     int client_socket_fd = server_socket_accept(server_socket_fd);
     if(client_socket_fd == -1) {
       perror("accept failed");
-      exit(2);
+      continue;
     }
-	
-    printf("Client %d connected!\n", client);
-  
-    // Set up file streams to access the socket
-    FILE* to_client = fdopen(dup(client_socket_fd), "wb");
-    if(to_client == NULL) {
-      perror("Failed to open stream to client");
-      exit(2);
-    }
-    FILE* from_client = fdopen(dup(client_socket_fd), "rb");
-    if(from_client == NULL) {
-      perror("Failed to open stream from client");
-      exit(2);
+    if (set_nodelay(client_socket_fd) == -1) {
+      perror("Unable to disable Nagle's algorithm");
     }
 
     // Set up arguments and spin up new thread
     input_t* in = (input_t*) malloc(sizeof(input_t));
-    in->to = to_client;
-    in->from = from_client;
+    in->to = NULL;
+    in->from = NULL;
     in->socket_fd = client_socket_fd;
-    in->id = client;
+    in->room = NULL;
+    in->id = -1;
 
-    printf("Starting thread to handle new client \n");
-    if (pthread_create(&thrd_arr[client], NULL, handle_client, in)) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, handle_client, in)) {
       perror("PTHREAD CREATE FAILED:");
+      close(client_socket_fd);
+      free(in);
+      continue;
     }
-  }
-
-  // join threads as each one exits at the end of the game
-  for(int i = 0; i < num_connections_allowed; i++) {
-    if(pthread_join(thrd_arr[i], NULL) != 0) {
-      perror("Failed to join thread");
-    }
+    pthread_detach(thread);
   }
 }
 
 /**
- * Free all the heap memory in the hashmap allocated at the beginning
- * of the game to store the parsed JSON data.
+ * Thread function that handles the signals sent to the server: SIGUSR1
+ * prints how long the phases of rounds are taking, and SIGTERM or SIGINT
+ * shut the server down once the events logged so far are written out
+ *
+ * \param signals - the sigset_t of signals to wait for; they must be
+ *                  blocked in every thread
  */
-void clean_up_game() {
-  // Free category hashmap
-  category_t* c = category_hashmap;
-  while (c != NULL) {
-    category_t* temp = c;
-    c = c->hh.next;
-    free(temp);
+void* handle_signals(void* signals) {
+  int signal;
+  while (sigwait((sigset_t*)signals, &signal) == 0) {
+    if (signal == SIGUSR1) {
+      print_phase_times(stdout);
+      continue;
+    }
+    printf("Server exiting\n");
+    event_log_close();
+    exit(0);
   }
+  return NULL;
 }
 
 /**
  * Sets up the server and starts running the game
+ *
+ * \param argc - the number of command line inputs
+ * \param argv - command line input strings; -e selects the event loop server,
+ *               -l makes up for each player's network delay when buzzing in,
+ *               -v prints the progress of every round, -a opens an admin
+ *               socket reporting metrics at the given path, -o logs the
+ *               events of every game to the given file, -d saves games
+ *               in the given directory and restores the ones saved there,
+ *               listening on the port saved there too, -p listens on the
+ *               given port instead of one picked by the OS
+ * \return - the program exit status
  */
-int main() {
+int main(int argc, char** argv) {
+  int use_event_loop = 0;
+  char* questions_path = "questions.json";
+  char* admin_path = NULL;
+  char* event_log_path = NULL;
+  char* state_dir = NULL;
+  unsigned short port = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "elva:o:d:p:q:")) != -1) {
+    switch (opt) {
+    case 'e':
+      use_event_loop = 1;
+      break;
+    case 'l':
+      buzz_arbitration = ARBITRATE_LATENCY;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'a':
+      admin_path = optarg;
+      break;
+    case 'o':
+      event_log_path = optarg;
+      break;
+    case 'd':
+      state_dir = optarg;
+      break;
+    case 'p': {
+      char* end;
+      long value = strtol(optarg, &end, 10);
+      if (*optarg == '\0' || *end != '\0' || value < 1 || value > 65535) {
+        fprintf(stderr, "The port must be from 1 to 65535\n");
+        exit(1);
+      }
+      port = value;
+      break;
+    }
+    case 'q':
+      questions_path = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-e] [-l] [-v] [-a admin_socket] [-o event_log] [-d state_dir] [-p port] [-q questions_file]\n", argv[0]);
+      exit(1);
+    }
+  }
 
   // Initialize everything
   srand(time(NULL));
-  pthread_mutex_init(&add_player_lock, NULL);
-  pthread_mutex_init(&answer_list_lock, NULL);
-
-  // Parse JSON and create a new game
-  FILE* read = fopen("questions.json","r");
-  parse_json(read);
-  game = create_game();
+  // writing to a client that is gone fails with EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
+
+  // Map the question pack, or parse JSON if the file isn't one; each room
+  // creates its own game from the loaded questions
+  int64_t load_start = monotonic_ns();
+  if (!load_questions(questions_path)) exit(2);
+  printf("Questions loaded in %.1f ms; %d full categories\n",
+         (monotonic_ns() - load_start) / 1e6, count_categories());
+  if (count_categories() == 0) {
+    fprintf(stderr, "No full categories in %s to make a board from\n", questions_path);
+    exit(2);
+  }
   
-  // Open a (arbitrary cpu chosen) server socket
-  unsigned short port = 0;
+  // Print phase times on SIGUSR1, and shut down cleanly on SIGTERM and
+  // SIGINT. The signals are blocked before any other thread starts, so
+  // they all inherit the mask and only sigwait gets them.
+  static sigset_t handled_signals;
+  sigemptyset(&handled_signals);
+  sigaddset(&handled_signals, SIGUSR1);
+  sigaddset(&handled_signals, SIGTERM);
+  sigaddset(&handled_signals, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &handled_signals, NULL);
+  pthread_t signal_thread;
+  if (pthread_create(&signal_thread, NULL, handle_signals, &handled_signals)) {
+    perror("PTHREAD CREATE FAILED:");
+    exit(2);
+  }
+  if (admin_path != NULL) {
+    if (!admin_start(admin_path)) exit(2);
+    printf("Admin socket open at %s\n", admin_path);
+  }
+  if (event_log_path != NULL) {
+    if (!event_log_open(event_log_path)) exit(2);
+    printf("Logging events to %s\n", event_log_path);
+  }
+  if (state_dir != NULL) {
+    if (!journal_open(state_dir)) exit(2);
+    printf("Saving games in %s\n", state_dir);
+    // unless told otherwise, listen where the restored games' players
+    // will be trying to get back in
+    if (port == 0 && !journal_saved_port(&port)) exit(2);
+  }
+
+  // Open a server socket on the port asked for, or one the OS picks
   int server_socket_fd = server_socket_open(&port);
   if(server_socket_fd == -1) {
     perror("Server socket was not opened");
     exit(2);
   }
   printf("Server listening on port %u\n", port);
+  if (state_dir != NULL && !journal_save_port(port)) exit(2);
 	
   // Start listening for connections
-  int num_connections_allowed = MAX_NUM_PLAYERS;
-  if(listen(server_socket_fd, num_connections_allowed)) {
+  if(listen(server_socket_fd, SOMAXCONN)) {
     perror("listen failed");
     exit(2);
   }
 
   // Run the game
-  run_game(server_socket_fd, num_connections_allowed);
+  if (use_event_loop) {
+    run_event_loop(server_socket_fd);
+  } else {
+    run_game(server_socket_fd);
+  }
 
   // Clean everything up
-  printf("Game is over, server exiting\n");
+  printf("Server exiting\n");
   close(server_socket_fd);
   clean_up_game();
 	
   return 0;
 }
-
-